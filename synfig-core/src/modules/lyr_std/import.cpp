@@ -98,7 +98,7 @@ Import::set_param(const String & param, const ValueBase &value)
 			filename=value.get(filename);
 			importer=0;
 			cimporter=0;
-			surface.clear();
+			clear_surface();
 			csurface.set_cairo_surface(NULL);
 			param_filename.set(filename);
 			return true;
@@ -142,9 +142,12 @@ Import::set_param(const String & param, const ValueBase &value)
 		if(newfilename.empty())
 		{
 			filename=newfilename;
-			importer=0;
+			{
+				RWLock::WriterLock lock(surface_lock);
+				importer=0;
+				clear_surface();
+			}
 			cimporter=0;
-			surface.clear();
 			csurface.set_cairo_surface(NULL);
 			param_filename.set(filename);
 			return true;
@@ -176,30 +179,49 @@ Import::set_param(const String & param, const ValueBase &value)
 
 				handle<Importer> newimporter;
 
-				newimporter=Importer::open(file_system->get_identifier(filename_with_path));
+				// Don't decode more pixels than the canvas can show,
+				// the renders reopen the image if they need more
+				int max_width, max_height;
+				get_size_needed(get_canvas()->rend_desc(), max_width, max_height);
+
+				newimporter=Importer::open(file_system->get_identifier(filename_with_path), max_width, max_height);
 
 				if(!newimporter)
 				{
-					newimporter=Importer::open(file_system->get_identifier(get_canvas()->get_file_path()+ETL_DIRECTORY_SEPARATOR+basename(newfilename_orig)));
+					newimporter=Importer::open(file_system->get_identifier(get_canvas()->get_file_path()+ETL_DIRECTORY_SEPARATOR+basename(newfilename_orig)), max_width, max_height);
 					if(!newimporter)
 					{
 						synfig::error(strprintf("Unable to create an importer object with file \"%s\"",filename_with_path.c_str()));
-						importer=0;
+						{
+							RWLock::WriterLock lock(surface_lock);
+							importer=0;
+							clear_surface();
+						}
 						filename=newfilename;
 						abs_filename=filename_with_path;
-						surface.clear();
 						param_filename.set(filename);
 						return false;
 					}
 				}
 
-				surface.clear();
-				if(!newimporter->get_frame(surface,get_canvas()->rend_desc(),Time(0),trimmed,width,height,top,left))
 				{
-					synfig::warning(strprintf("Unable to get frame from \"%s\"",filename_with_path.c_str()));
-				}
+					RWLock::WriterLock lock(surface_lock);
+					clear_surface();
+					if (Surface *buffer = newimporter->is_animated() ? NULL : newimporter->get_frame_buffer())
+					{
+						// The image may still be decoding: share the buffer of the
+						// importer and wait only for the rows each render needs
+						surface.mirror(*buffer);
+						trimmed=false;
+					}
+					else
+					if(!newimporter->get_frame(surface,get_canvas()->rend_desc(),Time(0),trimmed,width,height,top,left))
+					{
+						synfig::warning(strprintf("Unable to get frame from \"%s\"",filename_with_path.c_str()));
+					}
 
-				importer=newimporter;
+					importer=newimporter;
+				}
 				filename=newfilename;
 				abs_filename=filename_with_path;
 				param_filename.set(filename);
@@ -326,9 +348,151 @@ Import::get_param_vocab()const
 	return ret;
 }
 
+void
+Import::clear_surface()
+{
+	// Don't clear the pixels, they may belong to the importer
+	surface.set_wh(0, 0, NULL, 0);
+}
+
+int
+Import::get_rows_needed(const RendDesc &renddesc)const
+{
+	int h = surface.get_h();
+	Point tl(param_tl.get(Point()));
+	Point br(param_br.get(Point()));
+	if (!renddesc.get_transformation_matrix().is_identity() || tl[1] == br[1])
+		return h;
+
+	// Rows of the image covered by the rendered area, plus a margin
+	// for the rows read by the interpolation
+	Real y1 = (renddesc.get_tl()[1] - tl[1])/(br[1] - tl[1])*h;
+	Real y2 = (renddesc.get_br()[1] - tl[1])/(br[1] - tl[1])*h;
+	int rows = (int)ceil(max(y1, y2)) + 3;
+	return std::max(0, std::min(h, rows));
+}
+
+void
+Import::get_size_needed(const RendDesc &renddesc, int &w, int &h)const
+{
+	w = h = 0;
+	if (!renddesc.get_transformation_matrix().is_identity()
+	 || !renddesc.get_w() || !renddesc.get_h())
+		return;
+
+	Point tl(param_tl.get(Point()));
+	Point br(param_br.get(Point()));
+	w = (int)ceil(fabs((br[0] - tl[0])/renddesc.get_pw()));
+	h = (int)ceil(fabs((br[1] - tl[1])/renddesc.get_ph()));
+}
+
+void
+Import::reopen(int w, int h)const
+{
+	Importer::Handle newimporter = Importer::open(importer->identifier, w, h);
+	Surface *buffer = newimporter ? newimporter->get_frame_buffer() : NULL;
+	if (!buffer)
+	{
+		synfig::warning(strprintf("Unable to decode \"%s\" again", abs_filename.c_str()));
+		return;
+	}
+
+	// No render reads the previous pixels anymore, they go with the importer
+	Mutex::Lock lock(mutex);
+	importer = newimporter;
+	surface.mirror(*buffer);
+}
+
+void
+Import::update_resolution(const RendDesc &renddesc)const
+{
+	int w, h;
+	get_size_needed(renddesc, w, h);
+
+	{
+		RWLock::ReaderLock lock(surface_lock);
+		if (!importer || importer->is_animated() || importer->get_reduction() == 1)
+			return;
+		if (w && h && w <= surface.get_w() && h <= surface.get_h())
+			return;
+	}
+
+	// Never render from fewer pixels than needed: the render waits
+	// for the rows it needs at the new resolution
+	RWLock::WriterLock lock(surface_lock);
+	if (importer && !importer->is_animated() && importer->get_reduction() != 1
+	 && (!w || !h || w > surface.get_w() || h > surface.get_h()))
+		reopen(w, h);
+}
+
+bool
+Import::wait_surface()const
+{
+	// The pixels are used out of the renders, to paint or save them:
+	// give them at full resolution, the renders never reduce them again
+	RWLock::WriterLock lock(surface_lock);
+	if (importer && !importer->is_animated() && importer->get_reduction() != 1)
+		reopen(0, 0);
+	Mutex::Lock mutex_lock(mutex);
+	return !importer || importer->wait_rows(surface.get_h());
+}
+
+void
+Import::prepare_surface()const
+{
+	// Decode at the size of the final render before its first frame
+	if (get_canvas())
+		update_resolution(get_canvas()->get_root()->rend_desc());
+
+	RWLock::ReaderLock lock(surface_lock);
+	if (importer)
+		importer->release_decoding();
+}
+
+Color
+Import::get_color(Context context, const Point &pos)const
+{
+	RWLock::ReaderLock lock(surface_lock);
+	bool decoded;
+	{
+		Mutex::Lock lock(mutex);
+		decoded = !importer || importer->wait_rows(surface.get_h());
+	}
+	if (!decoded)
+		synfig::warning(strprintf("Unable to decode \"%s\"", abs_filename.c_str()));
+	return Layer_Bitmap::get_color(context, pos);
+}
+
+bool
+Import::accelerated_render(Context context,Surface *surface,int quality, const RendDesc &renddesc, ProgressCallback *cb)const
+{
+	update_resolution(renddesc);
+
+	// Keep the pixels of the importer until the render is done
+	RWLock::ReaderLock lock(surface_lock);
+	bool decoded;
+	{
+		Mutex::Lock lock(mutex);
+		decoded = !importer || importer->wait_rows(get_rows_needed(renddesc));
+	}
+	if (!decoded)
+		synfig::warning(strprintf("Unable to decode \"%s\"", abs_filename.c_str()));
+	return Layer_Bitmap::accelerated_render(context, surface, quality, renddesc, cb);
+}
+
+bool
+Import::is_static_between(Time a, Time b)const
+{
+	// Animated images show another frame at each time
+	if((importer && importer->is_animated()) || (cimporter && cimporter->is_animated()))
+		return false;
+	return Layer_Bitmap::is_static_between(a,b);
+}
+
 void
 Import::set_time(IndependentContext context, Time time)const
 {
+	prepare_surface();
 	Time time_offset=param_time_offset.get(Time());
 	switch (get_method())
 	{
@@ -365,6 +529,7 @@ Import::set_time(IndependentContext context, Time time)const
 void
 Import::set_time(IndependentContext context, Time time, const Point &pos)const
 {
+	prepare_surface();
 	Time time_offset=param_time_offset.get(Time());
 	switch (get_method())
 	{
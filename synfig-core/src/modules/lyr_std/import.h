@@ -32,6 +32,7 @@
 #include <synfig/color.h>
 #include <synfig/vector.h>
 #include <synfig/importer.h>
+#include <synfig/mutex.h>
 #include <synfig/cairoimporter.h>
 #include <synfig/rendermethod.h>
 
@@ -54,9 +55,29 @@ private:
 	ValueBase param_time_offset;
 
 	String abs_filename;
-	Importer::Handle importer;
+	//! Replaced under surface_lock held for writing
+	mutable Importer::Handle importer;
+	//! Held for reading while the pixels of the importer are rendered,
+	//! for writing to replace the importer
+	mutable RWLock surface_lock;
 	CairoImporter::Handle cimporter;
 
+	//! Drops the image without touching its pixels
+	void clear_surface();
+	//! Returns how many rows of the image must be decoded to render \a renddesc
+	int get_rows_needed(const RendDesc &renddesc)const;
+	//! Gets the size the image covers in \a renddesc, 0 if unknown
+	void get_size_needed(const RendDesc &renddesc, int &w, int &h)const;
+	//! Decodes the image again if it was reduced too much to render \a renddesc.
+	//! Waits for the renders using the previous pixels before replacing them
+	void update_resolution(const RendDesc &renddesc)const;
+	//! Replaces the importer by one decoding at least \a w x \a h pixels,
+	//! or the full image if \a w or \a h is 0. Needs surface_lock held for writing
+	void reopen(int w, int h)const;
+	//! Called by set_time(): decodes the image at the size of the canvas before
+	//! its first render, and frees the file of the importer once decoded
+	void prepare_surface()const;
+
 protected:
 	Import();
 
@@ -71,9 +92,17 @@ public:
 
 	virtual void on_canvas_set();
 
+	virtual Color get_color(Context context, const Point &pos)const;
+
+	virtual bool wait_surface()const;
+
+	virtual bool accelerated_render(Context context,Surface *surface,int quality, const RendDesc &renddesc, ProgressCallback *cb)const;
+
 	virtual void set_time(IndependentContext context, Time time)const;
 
 	virtual void set_time(IndependentContext context, Time time, const Point &point)const;
+
+	virtual bool is_static_between(Time a, Time b)const;
 	
 	virtual void set_render_method(Context context, RenderMethod x);
 };
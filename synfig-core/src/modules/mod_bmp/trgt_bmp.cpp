@@ -160,6 +160,32 @@ bmp::set_rend_desc(RendDesc *given_desc)
     return true;
 }
 
+bool
+bmp::has_frame_targets()const
+{
+	return is_file_sequence(filename,multi_image);
+}
+
+Target_Scanline::Handle
+bmp::create_frame_target(int frame)
+{
+	if(!has_frame_targets())
+		return Target_Scanline::Handle();
+
+	TargetParam params;
+	params.sequence_separator=sequence_separator;
+	bmp *target(new bmp(filename.c_str(),params));
+	init_sequence_target(*target,target->multi_image,target->imagecount,frame);
+	target->pf=PF_BGR;
+	return Target_Scanline::Handle(target);
+}
+
+bool
+bmp::repeat_frame()
+{
+	return repeat_sequence_frame(filename,sequence_separator,multi_image,imagecount);
+}
+
 void
 bmp::end_frame()
 {
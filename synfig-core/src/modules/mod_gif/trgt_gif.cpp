@@ -35,6 +35,8 @@
 #include <ETL/stringf>
 #include "trgt_gif.h"
 #include <cstdio>
+#include <cmath>
+#include <algorithm>
 #endif
 
 /* === M A C R O S ========================================================= */
@@ -45,6 +47,13 @@ using namespace etl;
 
 #define MAX_FRAME_RATE	(20.0)
 
+//! Number of pixels compared to the palette to know if it can be kept
+#define PALETTE_SAMPLES			(1024)
+//! The palette is kept while the frames are not much further from it
+//! than the frame it was built for
+#define PALETTE_REUSE_TOLERANCE	(1.25f)
+#define PALETTE_REUSE_SLACK		(0.005f)
+
 /* === G L O B A L S ======================================================= */
 
 SYNFIG_TARGET_INIT(gif);
@@ -74,7 +83,10 @@ gif::gif(const char *filename_, const synfig::TargetParam & /* params */):
 	color_bits(8),
 	iframe_density(30),
 	loop_count(0x7fff),
-	local_palette(true)
+	local_palette(true),
+	palette_error(0),
+	delay_pos(-1),
+	delay_time(0)
 { }
 
 gif::~gif()
@@ -144,6 +156,7 @@ gif::init(synfig::ProgressCallback *cb)
 	if(!local_palette)
 	{
 		curr_palette=Palette::grayscale(256/(1<<(8-rootsize))-1);
+		lookup.reset(curr_palette);
 		output_curr_palette();
 	}
 
@@ -188,6 +201,25 @@ gif::output_curr_palette()
 	}
 }
 
+float
+gif::palette_distance()const
+{
+	const int w(curr_surface.get_w()), h(curr_surface.get_h());
+	const int step(max(1,(int)sqrtf((float)w*h/PALETTE_SAMPLES)));
+
+	float total(0);
+	int count(0);
+	for(int y=step/2;y<h;y+=step)
+		for(int x=step/2;x<w;x+=step)
+		{
+			float dist;
+			curr_palette.find_closest(curr_surface[y][x].clamped(),&dist);
+			total+=sqrtf(dist);
+			count++;
+		}
+	return count?total/count:0;
+}
+
 bool
 gif::start_frame(synfig::ProgressCallback *callback)
 {
@@ -239,10 +271,14 @@ gif::end_frame()
 		}
 	}
 
-	if(local_palette)
+	// Keep the palette of the previous frame when it still suits this one
+	if(local_palette && (curr_palette.empty() ||
+		palette_distance()>palette_error*PALETTE_REUSE_TOLERANCE+PALETTE_REUSE_SLACK))
 	{
 		curr_palette=Palette(curr_surface,256/(1<<(8-rootsize))-build_off_previous-1);
 		synfig::info("curr_palette.size()=%d",curr_palette.size());
+		palette_error=palette_distance();
+		lookup.reset(curr_palette);
 	}
 
 	int transparent_index(curr_palette.find_closest(Color(1,0,1,0))-curr_palette.begin());
@@ -269,73 +305,25 @@ gif::end_frame()
 	if(has_transparency)
 		gec_flags|=1;
 
-	// output the Graphic Control Extension
-	fputc(0x21,file.get()); // Extension introducer
-	fputc(0xF9,file.get()); // Graphic Control Label
-	fputc(4,file.get()); // Block Size
-	fputc(gec_flags,file.get()); // Flags (Packed Fields)
-	fputc(delaytime&0x000000ff,file.get()); // Delay Time (MSB)
-	fputc((delaytime&0x0000ff00)>>8,file.get()); // Delay Time (LSB)
-	fputc(transparent_index,file.get()); // Transparent Color Index
-	fputc(0,file.get()); // Block Terminator
-
-	// output the image header
-	fputc(',',file.get());
-	fputc(0,file.get());	// image left
-	fputc(0,file.get());	// image left
-	fputc(0,file.get());	// image top
-	fputc(0,file.get());	// image top
-	fputc(w&0x000000ff,file.get());
-	fputc((w&0x0000ff00)>>8,file.get());
-	fputc(h&0x000000ff,file.get());
-	fputc((h&0x0000ff00)>>8,file.get());
-	if(local_palette)
-		fputc(0x80|(rootsize-1),file.get());	// flags
-	else
-		fputc(0x00+ rootsize-1,file.get());	// flags
-
-
-	if(local_palette)
+	// Map the pixels to the palette, and find the rectangle which changed
+	values.resize(w*h);
+	int left(w),top(h),right(-1),bottom(-1);
+	for(int cur_scanline=0;cur_scanline<h;cur_scanline++)
 	{
-		Palette out(curr_palette);
-
-		if(build_off_previous)
-			curr_palette.insert(curr_palette.begin(),Color(1,0,1,0));
-		output_curr_palette();
-		curr_palette=out;
-	}
-
-	bs=bitstream(file);
-
-	// Prepare ourselves for LZW compression
-	codesize=rootsize+1;
-	nextcode=(1<<rootsize)+2;
-	table=lzwcode::NewTable((1<<rootsize));
-	node=table;
-
-	// Output the rootsize
-	fputc(rootsize,file.get());	// rootsize;
-
-	// Push a table reset into the bitstream
-	bs.push_value(1<<rootsize,codesize);
-
-	for(int cur_scanline=0;cur_scanline<desc.get_h();cur_scanline++)
-	{
-		//convert_color_format(curr_frame[cur_scanline], curr_surface[cur_scanline], desc.get_w(), PF_GRAY, gamma());
-
-		// Now we compress it!
 		for(i=0;i<w;i++)
 		{
 			Color color(curr_surface[cur_scanline][i].clamped());
-			Palette::iterator iter(curr_palette.find_closest(color));
+			const int index(lookup.find_closest(color));
+			const Color &closest(curr_palette[index].color);
 
 			if(dithering)
 			{
-				Color error(color-iter->color);
+				Color error(color-closest);
 				//error*=0.25;
 				if(curr_surface.get_h()>cur_scanline+1)
 				{
-					curr_surface[cur_scanline+1][i-1]  += error * ((float)3/(float)16);
+					if(i>0)
+						curr_surface[cur_scanline+1][i-1]  += error * ((float)3/(float)16);
 					curr_surface[cur_scanline+1][i]    += error * ((float)5/(float)16);
 					if(curr_surface.get_w()>i+1)
 						curr_surface[cur_scanline+1][i+1]  += error * ((float)1/(float)16);
@@ -344,9 +332,9 @@ gif::end_frame()
 					curr_surface[cur_scanline][i+1]    += error * ((float)7/(float)16);
 			}
 
-			curr_frame[cur_scanline][i]=iter-curr_palette.begin();
+			curr_frame[cur_scanline][i]=index;
 
-			value=curr_frame[cur_scanline][i];
+			value=index;
 			if(build_off_previous)
 				value++;
 			if(value>(unsigned)(1<<rootsize)-1)
@@ -362,7 +350,8 @@ gif::end_frame()
 
 					// Lossy
 					if(
-						abs( ( iter->color-prev_palette[prev_frame[cur_scanline][i]-1].color ).get_y() ) > (1.0/16.0) ||
+						prev_frame[cur_scanline][i]==0 ||
+						abs( ( closest-prev_palette[prev_frame[cur_scanline][i]-1].color ).get_y() ) > (1.0/16.0) ||
 //						abs((int)value-(int)prev_frame[cur_scanline][i])>2||
 //						(value<=2 && value!=prev_frame[cur_scanline][i]) ||
 						(imagecount%iframe_density)==0 || imagecount==desc.get_frame_end()-1 ) // lossy version
@@ -385,6 +374,81 @@ gif::end_frame()
 			else
 			prev_frame[cur_scanline][i]=value;
 
+			values[cur_scanline*w+i]=value;
+			if(value || !build_off_previous)
+			{
+				left=min(left,i);
+				right=max(right,i);
+				top=min(top,cur_scanline);
+				bottom=max(bottom,cur_scanline);
+			}
+		}
+	}
+
+	// Nothing changed, a transparent pixel keeps the delay
+	if(right<0)
+		left=top=right=bottom=0;
+	const int rect_w(right-left+1),rect_h(bottom-top+1);
+
+	// output the Graphic Control Extension
+	fputc(0x21,file.get()); // Extension introducer
+	fputc(0xF9,file.get()); // Graphic Control Label
+	fputc(4,file.get()); // Block Size
+	fputc(gec_flags,file.get()); // Flags (Packed Fields)
+	delay_pos=ftell(file.get());
+	delay_time=delaytime;
+	fputc(delaytime&0x000000ff,file.get()); // Delay Time (MSB)
+	fputc((delaytime&0x0000ff00)>>8,file.get()); // Delay Time (LSB)
+	fputc(transparent_index,file.get()); // Transparent Color Index
+	fputc(0,file.get()); // Block Terminator
+
+	// output the image header
+	fputc(',',file.get());
+	fputc(left&0x000000ff,file.get());	// image left
+	fputc((left&0x0000ff00)>>8,file.get());	// image left
+	fputc(top&0x000000ff,file.get());	// image top
+	fputc((top&0x0000ff00)>>8,file.get());	// image top
+	fputc(rect_w&0x000000ff,file.get());
+	fputc((rect_w&0x0000ff00)>>8,file.get());
+	fputc(rect_h&0x000000ff,file.get());
+	fputc((rect_h&0x0000ff00)>>8,file.get());
+	if(local_palette)
+		fputc(0x80|(rootsize-1),file.get());	// flags
+	else
+		fputc(0x00+ rootsize-1,file.get());	// flags
+
+
+	if(local_palette)
+	{
+		Palette out(curr_palette);
+
+		if(build_off_previous)
+			curr_palette.insert(curr_palette.begin(),Color(1,0,1,0));
+		output_curr_palette();
+		curr_palette=out;
+	}
+
+	bs=bitstream(file);
+
+	// Prepare ourselves for LZW compression
+	codesize=rootsize+1;
+	nextcode=(1<<rootsize)+2;
+	table=lzwcode::NewTable((1<<rootsize));
+	node=table;
+
+	// Output the rootsize
+	fputc(rootsize,file.get());	// rootsize;
+
+	// Push a table reset into the bitstream
+	bs.push_value(1<<rootsize,codesize);
+
+	for(int cur_scanline=top;cur_scanline<=bottom;cur_scanline++)
+	{
+		// Now we compress it!
+		for(i=left;i<=right;i++)
+		{
+			value=values[cur_scanline*w+i];
+
 			next=node->FindCode(value);
 			if(next)
 				node=next;
@@ -440,6 +504,29 @@ gif::end_frame()
 	imagecount++;
 }
 
+bool
+gif::repeat_frame()
+{
+	// Make the previous frame last longer, when the file can be rewound
+	const int delaytime(delay_time+round_to_int(100.0/desc.get_frame_rate()));
+	if(!file || delay_pos<0 || delaytime>0xffff)
+		return false;
+
+	fflush(file.get());
+	if(fseek(file.get(),delay_pos,SEEK_SET)!=0)
+	{
+		delay_pos=-1;
+		return false;
+	}
+	fputc(delaytime&0x000000ff,file.get());
+	fputc((delaytime&0x0000ff00)>>8,file.get());
+	fseek(file.get(),0,SEEK_END);
+
+	delay_time=delaytime;
+	imagecount++;
+	return true;
+}
+
 synfig::Color*
 gif::start_scanline(int scanline)
 {
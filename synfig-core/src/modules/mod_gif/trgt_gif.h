@@ -36,6 +36,7 @@
 #include <synfig/surface.h>
 #include <synfig/palette.h>
 #include <synfig/targetparam.h>
+#include <vector>
 
 /* === M A C R O S ========================================================= */
 
@@ -191,8 +192,23 @@ private:
 	bool local_palette;
 
 	synfig::Palette curr_palette;
+	//! Closest colors of curr_palette
+	synfig::PaletteLookup lookup;
+	//! Values of the pixels of the frame being written
+	std::vector<unsigned char> values;
 
 	void output_curr_palette();
+	//! Average distance of curr_palette to curr_surface, when it was built
+	float palette_error;
+
+	//! Position of the delay of the last frame in the file, -1 if unknown
+	long delay_pos;
+	//! Delay of the last frame, in hundredths of a second
+	int delay_time;
+
+	//! Returns the average distance of the pixels of curr_surface
+	//! to their closest color in curr_palette
+	float palette_distance()const;
 
 public:
 	gif(const char *filename, const synfig::TargetParam& /* params */);
@@ -201,6 +217,7 @@ public:
 	virtual bool init(synfig::ProgressCallback *cb);
 	virtual bool start_frame(synfig::ProgressCallback *cb);
 	virtual void end_frame();
+	virtual bool repeat_frame();
 
 	virtual ~gif();
 
@@ -57,6 +57,9 @@ using namespace etl;
 
 #define JPEG_CHECK_BYTES 	8
 
+//! Number of rows decoded before they are made available to the renderer
+#define JPEG_BAND_ROWS		32
+
 /* === G L O B A L S ======================================================= */
 
 SYNFIG_IMPORTER_INIT(jpeg_mptr);
@@ -68,14 +71,6 @@ SYNFIG_IMPORTER_SET_SUPPORTS_FILE_SYSTEM_WRAPPER(jpeg_mptr, false);
 
 /* === M E T H O D S ======================================================= */
 
-struct my_error_mgr {
-  struct jpeg_error_mgr pub;	/* "public" fields */
-
-  jmp_buf setjmp_buffer;	/* for return to caller */
-};
-
-typedef struct my_error_mgr * my_error_ptr;
-
 /*
  * Here's the routine that will replace the standard error_exit method:
  */
@@ -83,8 +78,8 @@ typedef struct my_error_mgr * my_error_ptr;
 void
 jpeg_mptr::my_error_exit (j_common_ptr cinfo)
 {
-  /* cinfo->err really points to a my_error_mgr struct, so coerce pointer */
-  my_error_ptr myerr = (my_error_ptr) cinfo->err;
+  /* cinfo->err really points to a error_mgr struct, so coerce pointer */
+  error_mgr *myerr = (error_mgr*) cinfo->err;
 
   /* Always display the message. */
   /* We could postpone this until after returning, if we chose. */
@@ -99,10 +94,13 @@ jpeg_mptr::my_error_exit (j_common_ptr cinfo)
 
 
 jpeg_mptr::jpeg_mptr(const synfig::FileSystem::Identifier &identifier):
-	Importer(identifier)
+	Importer(identifier),
+	file_data(NULL),
+	file_size(0),
+	decompressing(false),
+	frame_width(0),
+	frame_height(0)
 {
-	struct my_error_mgr jerr;
-
 	/* Open the file pointer */
 	FileSystem::ReadStreamHandle stream = identifier.get_read_stream();
 	if (!stream)
@@ -130,12 +128,26 @@ jpeg_mptr::jpeg_mptr(const synfig::FileSystem::Identifier &identifier):
 
 	/* Step 2: specify data source (eg, from memory thrue a String) */
 
-	std::ostringstream tmp;
-	tmp << stream->rdbuf();
-	String streamString = tmp.str();
+	/* The data must outlive the constructor: the pixels are decoded
+	 * in background, where the file system can't be used safely.
+	 */
+	if (stream->data())
+	{
+		file_stream = stream;
+		file_data = stream->data();
+		file_size = stream->data_size();
+	}
+	else
+	{
+		std::ostringstream tmp;
+		tmp << stream->rdbuf();
+		file_buffer = tmp.str();
+		file_data = file_buffer.data();
+		file_size = file_buffer.size();
+	}
 	stream.reset();
 
-	jpeg_mem_src(&cinfo, (unsigned char*)streamString.c_str(), streamString.size());
+	jpeg_mem_src(&cinfo, (unsigned char*)file_data, file_size);
 
 	/* Step 3: read file parameters with jpeg_read_header() */
 
@@ -146,11 +158,46 @@ jpeg_mptr::jpeg_mptr(const synfig::FileSystem::Identifier &identifier):
 	* See libjpeg.doc for more info.
 	*/
 
+	frame_width = cinfo.image_width;
+	frame_height = cinfo.image_height;
+
+	jpeg_calc_output_dimensions(&cinfo);
+	if (cinfo.output_components != 3 && cinfo.output_components != 1)
+	{
+		jpeg_destroy_decompress(&cinfo);
+		synfig::error("Error on jpeg importer, Unsupported color type");
+        //! \todo THROW SOMETHING
+		throw String("Error on jpeg importer, Unsupported color type");
+		return;
+	}
+	decompressing = true;
+}
+
+bool
+jpeg_mptr::get_frame_size(int &width, int &height)const
+{
+	width = frame_width;
+	height = frame_height;
+	return true;
+}
+
+void
+jpeg_mptr::begin_decoding()
+{
+	if (setjmp(jerr.setjmp_buffer))
+	{
+		jpeg_destroy_decompress(&cinfo);
+		decompressing = false;
+		throw String("Error on jpeg importer, unable to start decompression of "+identifier.filename);
+	}
+
 	/* Step 4: set parameters for decompression */
 
-	/* In this example, we don't need to change any of the defaults set by
-	* jpeg_read_header(), so we do nothing here.
-	*/
+	/* Let the library downscale in the DCT domain when a smaller
+	 * frame is enough, it is much faster than decoding everything.
+	 */
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = get_reduction();
 
 	/* Step 5: Start decompressor */
 
@@ -159,11 +206,37 @@ jpeg_mptr::jpeg_mptr(const synfig::FileSystem::Identifier &identifier):
 	* with the stdio data source.
 	*/
 
+	surface_buffer.set_wh(cinfo.output_width,cinfo.output_height);
+
+	/* Step 6: read scanlines in background, a band at a time, so the layer
+	 * can render the first rows while the rest of the image is decoded
+	 */
+	start_decoding(cinfo.output_height);
+}
+
+jpeg_mptr::~jpeg_mptr()
+{
+	stop_decoding();
+	if (decompressing)
+		jpeg_destroy_decompress(&cinfo);
+}
+
+bool
+jpeg_mptr::decode()
+{
+	if (setjmp(jerr.setjmp_buffer))
+	{
+		synfig::error("Error on jpeg importer, unable to decode \"%s\"", identifier.filename.c_str());
+		jpeg_destroy_decompress(&cinfo);
+		decompressing = false;
+		return false;
+	}
+
 	JSAMPARRAY buffer;		/* Output row buffer */
 	int row_stride;		/* physical row width in output buffer */
 	row_stride = cinfo.output_width * cinfo.output_components;
-	/* Make a one-row-high sample array that will go away when done with image */
-	buffer = (*cinfo.mem->alloc_sarray)((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, 1);
+	/* Make a band-high sample array that will go away when done with image */
+	buffer = (*cinfo.mem->alloc_sarray)((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, JPEG_BAND_ROWS);
 
 	if(!buffer)
 	{
@@ -171,63 +244,38 @@ jpeg_mptr::jpeg_mptr(const synfig::FileSystem::Identifier &identifier):
 		throw String("Error on jpeg importer, alloc of \"buffer\" failed (bug?)");
 	}
 
-	int x;
-	int y;
-	surface_buffer.set_wh(cinfo.output_width,cinfo.output_height);
+	const int width = surface_buffer.get_w();
+	const int height = surface_buffer.get_h();
+	int x, y = 0;
 
-	switch(cinfo.output_components)
+	while(y < height)
 	{
-	case 3:
-		for(y=0;y<surface_buffer.get_h();y++)
+		int rows = jpeg_read_scanlines(&cinfo, buffer, std::min(JPEG_BAND_ROWS, height - y));
+		for(int i = 0; i < rows; i++, y++)
 		{
-			int x;
-			jpeg_read_scanlines(&cinfo, buffer, 1);
-			for(x=0;x<surface_buffer.get_w();x++)
+			const JSAMPLE *row = buffer[i];
+			Color *dest = surface_buffer[y];
+			if (cinfo.output_components == 3)
 			{
-				float r=gamma().g_U8_to_F32((unsigned char)buffer[0][x*3+0]);
-				float g=gamma().g_U8_to_F32((unsigned char)buffer[0][x*3+1]);
-				float b=gamma().g_U8_to_F32((unsigned char)buffer[0][x*3+2]);
-				surface_buffer[y][x]=Color(
-					r,
-					g,
-					b,
-					1.0
-				);
-/*
-				surface_buffer[y][x]=Color(
-					(float)(unsigned char)buffer[0][x*3+0]*(1.0/255.0),
-					(float)(unsigned char)buffer[0][x*3+1]*(1.0/255.0),
-					(float)(unsigned char)buffer[0][x*3+2]*(1.0/255.0),
-					1.0
-				);
-*/
-				}
-		}
-		break;
-
-	case 1:
-		for(y=0;y<surface_buffer.get_h();y++)
-		{
-			jpeg_read_scanlines(&cinfo, buffer, 1);
-			for(x=0;x<surface_buffer.get_w();x++)
+				for(x=0;x<width;x++, row+=3)
+					dest[x]=Color(
+						gamma().g_U8_to_F32((unsigned char)row[0]),
+						gamma().g_U8_to_F32((unsigned char)row[1]),
+						gamma().g_U8_to_F32((unsigned char)row[2]),
+						1.0
+					);
+			}
+			else
 			{
-				float gray=gamma().g_U8_to_F32((unsigned char)buffer[0][x]);
-//				float gray=(float)(unsigned char)buffer[0][x]*(1.0/255.0);
-				surface_buffer[y][x]=Color(
-					gray,
-					gray,
-					gray,
-					1.0
-				);
+				for(x=0;x<width;x++)
+				{
+					float gray=gamma().g_U8_to_F32((unsigned char)row[x]);
+					dest[x]=Color(gray, gray, gray, 1.0);
+				}
 			}
 		}
-		break;
-
-	default:
-		synfig::error("Error on jpeg importer, Unsupported color type");
-        //! \todo THROW SOMETHING
-		throw String("Error on jpeg importer, Unsupported color type");
-		return;
+		if (!set_rows_decoded(y))
+			return false;
 	}
 
 	/* Step 7: Finish decompression */
@@ -241,22 +289,26 @@ jpeg_mptr::jpeg_mptr(const synfig::FileSystem::Identifier &identifier):
 
 	/* This is an important step since it will release a good deal of memory. */
 	jpeg_destroy_decompress(&cinfo);
+	decompressing = false;
+	String().swap(file_buffer);
 
-	/* After finish_decompress, we can close the input file.
-	* Here we postpone it until after no more JPEG errors are possible,
-	* so as to simplify the setjmp error logic above.  (Actually, I don't
-	* think that jpeg_destroy can do an error exit, but why assume anything...)
-	*/
-//	fclose(file);
+	return true;
 }
 
-jpeg_mptr::~jpeg_mptr()
+void
+jpeg_mptr::end_decoding()
 {
+	file_stream.reset();
+	file_data = NULL;
+	file_size = 0;
 }
 
 bool
 jpeg_mptr::get_frame(synfig::Surface &surface, const synfig::RendDesc &/*renddesc*/, Time, synfig::ProgressCallback */*cb*/)
 {
+	if (!wait_rows(surface_buffer.get_h()))
+		return false;
+	release_decoding();
 	surface=surface_buffer;
 	return true;
 }
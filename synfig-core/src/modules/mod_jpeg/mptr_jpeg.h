@@ -48,16 +48,40 @@ class jpeg_mptr : public synfig::Importer
 {
 	SYNFIG_IMPORTER_MODULE_EXT
 private:
+	struct error_mgr {
+		struct jpeg_error_mgr pub;	/* "public" fields */
+		jmp_buf setjmp_buffer;	/* for return to caller */
+	};
+
 	synfig::Surface surface_buffer;
 
+	//! Contents of the file, read up front so decoding never touches the file system
+	synfig::String file_buffer;
+	//! The file when it is mapped in memory, it is decoded from there without copy.
+	//! Released by end_decoding() once the frame is decoded
+	synfig::FileSystem::ReadStreamHandle file_stream;
+	const char *file_data;
+	size_t file_size;
+
 	struct jpeg_decompress_struct cinfo;
+	error_mgr jerr;
+	bool decompressing;
+	int frame_width, frame_height;
 
 	static void my_error_exit (j_common_ptr cinfo);
 
+protected:
+	virtual bool get_frame_size(int &width, int &height)const;
+	virtual void begin_decoding();
+	virtual bool decode();
+	virtual void end_decoding();
+
 public:
 	jpeg_mptr(const synfig::FileSystem::Identifier &identifier);
 	~jpeg_mptr();
 
+	virtual synfig::Surface* get_frame_buffer() { return &surface_buffer; }
+
 	virtual bool get_frame(synfig::Surface &surface, const synfig::RendDesc &renddesc, synfig::Time time, synfig::ProgressCallback *callback);
 };
 
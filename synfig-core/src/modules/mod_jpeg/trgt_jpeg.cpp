@@ -99,6 +99,31 @@ jpeg_trgt::set_rend_desc(RendDesc *given_desc)
 	return true;
 }
 
+bool
+jpeg_trgt::has_frame_targets()const
+{
+	return is_file_sequence(filename,multi_image);
+}
+
+Target_Scanline::Handle
+jpeg_trgt::create_frame_target(int frame)
+{
+	if(!has_frame_targets())
+		return Target_Scanline::Handle();
+
+	TargetParam params;
+	params.sequence_separator=sequence_separator;
+	jpeg_trgt *target(new jpeg_trgt(filename.c_str(),params));
+	init_sequence_target(*target,target->multi_image,target->imagecount,frame);
+	return Target_Scanline::Handle(target);
+}
+
+bool
+jpeg_trgt::repeat_frame()
+{
+	return repeat_sequence_frame(filename,sequence_separator,multi_image,imagecount);
+}
+
 bool
 jpeg_trgt::start_frame(synfig::ProgressCallback *callback)
 {
@@ -65,8 +65,12 @@ extern "C"
 #	include "trgt_av.h"
 #	include <synfig/general.h>
 #	include <cstdio>
+#	include <cstdlib>
 #	include <algorithm>
 #	include <functional>
+#	ifndef _WIN32
+#		include <unistd.h>
+#	endif
 #endif
 
 #endif
@@ -311,6 +315,20 @@ public:
 
 #endif
 
+//! Returns the number of threads the codec should use, \a requested if greater than one
+static int encoder_threads(int requested)
+{
+	if(getenv("SYNFIG_LIBAV_THREADS"))
+		return max(1, atoi(getenv("SYNFIG_LIBAV_THREADS")));
+	if(requested > 1)
+		return requested;
+#ifdef _SC_NPROCESSORS_ONLN
+	return max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+#else
+	return 1;
+#endif
+}
+
 class VideoEncoder
 {
 public:
@@ -320,8 +338,25 @@ public:
 
 	bool 	startedencoding;
 
+	//number of threads used by the codec
+	int		threads;
+
+#ifdef WITH_LIBSWSCALE
+	//converts RGB24 to the codec pixel format, kept for the whole encode
+	struct SwsContext *scaler;
+#endif
+
 	//int		stream_nb_frames;
 
+	VideoEncoder():
+		encodable(0),
+		startedencoding(false),
+		threads(1)
+#ifdef WITH_LIBSWSCALE
+		, scaler(0)
+#endif
+	{ }
+
 	bool open(AVFormatContext *formatc, AVStream *stream)
 	{
 		if(!formatc || !stream)
@@ -345,6 +380,19 @@ public:
 			return 0;
 		}
 
+		//let the codec encode several frames or slices at once
+		if(threads > 1)
+		{
+#if LIBAVCODEC_VERSION_INT < (53<<16)
+			avcodec_thread_init(context, threads);
+#else
+			context->thread_count = threads;
+#endif
+#ifdef FF_THREAD_FRAME
+			context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+#endif
+		}
+
 		//try to open the codec
 		if(avcodec_open(context, codec) < 0)
 		{
@@ -386,6 +434,17 @@ public:
 				synfig::warning("open_video: could not allocate encodable picture");
 				return 0;
 			}
+
+#ifdef WITH_LIBSWSCALE
+			scaler = sws_getContext(context->width, context->height, PIX_FMT_RGB24,
+				context->width, context->height, context->pix_fmt,
+				SWS_BICUBIC, NULL, NULL, NULL);
+			if(!scaler)
+			{
+				synfig::warning("open_video: could not create the pixel format converter");
+				return 0;
+			}
+#endif
 		}
 
 		return true;
@@ -418,17 +477,9 @@ public:
 		{
 			//We're using RGBA at the moment, write custom conversion code later (get less accuracy errors)
 #ifdef WITH_LIBSWSCALE
-			struct SwsContext* img_convert_ctx =
-				sws_getContext(context->width, context->height, PIX_FMT_RGB24,
-					context->width, context->height, context->pix_fmt,
-					SWS_BICUBIC, NULL, NULL, NULL);
-
-			sws_scale(img_convert_ctx, pict->data, pict->linesize,
-
+			sws_scale(scaler, pict->data, pict->linesize,
 				0, context->height, encodable->data,
 				encodable->linesize);
-
-			sws_freeContext (img_convert_ctx);
 #else
 			img_convert((AVPicture *)encodable, context->pix_fmt,
 						(AVPicture *)pict, PIX_FMT_RGB24,
@@ -507,6 +558,14 @@ public:
 			encodable = 0;
 		}
 
+#ifdef WITH_LIBSWSCALE
+		if (scaler)
+		{
+			sws_freeContext(scaler);
+			scaler = 0;
+		}
+#endif
+
 		videobuffer.resize(0);
 	}
 };
@@ -828,6 +887,8 @@ Target_LibAVCodec::Target_LibAVCodec(const char *Filename,
 		av_register_all();
 	}
 	set_remove_alpha();
+	// encode on the writer thread, while the next frames render
+	set_queue_size(2);
 
 	data = new LibAVEncoder;
 }
@@ -902,9 +963,6 @@ void
 Target_LibAVCodec::end_frame()
 {
 	//AVStream *audio_st = data->audio_st;
-	AVStream *video_st = data->video_st;
-
-	AVFormatContext *formatc = data->formatc;
 
 	//double &audio_pts = data->audio_pts;
 	//double &video_pts = data->video_pts;
@@ -930,8 +988,32 @@ Target_LibAVCodec::end_frame()
 	//copy the current surface to the buffer
 	if(data->picture)convert_surface_frame(data->picture,surface,gamma());
 
+	write_picture();
+
+	/* write interleaved audio and video frames */
+	/*if (!video_st || (video_st && audio_st && audio_pts < video_pts)) {
+		data->aud.write_frame(formatc,audio_st);
+	} else {
+		data->vid.write_frame(formatc,video_st);
+    }*/
+}
+
+bool
+Target_LibAVCodec::repeat_frame()
+{
+	// The buffer still holds the previous frame, encode it again
+	if(!data->picture || data->frame_count==0 || data->frame_count >= data->num_frames)
+		return false;
+
+	write_picture();
+	return true;
+}
+
+void
+Target_LibAVCodec::write_picture()
+{
 	//encode the frame and write it to the file
-	if(!data->vid.write_frame(formatc,video_st,data->picture))
+	if(!data->vid.write_frame(data->formatc,data->video_st,data->picture))
 	{
 		synfig::warning("Unable to write a frame");
 	}
@@ -942,13 +1024,6 @@ Target_LibAVCodec::end_frame()
 	{
 		data->CleanUp();
 	}
-
-	/* write interleaved audio and video frames */
-	/*if (!video_st || (video_st && audio_st && audio_pts < video_pts)) {
-		data->aud.write_frame(formatc,audio_st);
-	} else {
-		data->vid.write_frame(formatc,video_st);
-    }*/
 }
 
 bool
@@ -976,6 +1051,8 @@ Target_LibAVCodec::end_scanline()
 
 bool Target_LibAVCodec::init(synfig::ProgressCallback *cb)
 {
+	data->vid.threads = encoder_threads(get_encoders());
+
 	//hardcoded test for mpeg
 	if(!data->Initialize(filename.c_str(),NULL))
 	{
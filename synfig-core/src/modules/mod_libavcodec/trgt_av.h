@@ -52,6 +52,9 @@ private:
 
 	synfig::Surface	surface;
 
+	//! Encodes the converted frame and writes it to the file
+	void write_picture();
+
 public:
 	Target_LibAVCodec(const char *filename,
 					  const synfig::TargetParam& /* params */);
@@ -62,6 +65,7 @@ public:
 	virtual bool set_rend_desc(synfig::RendDesc *desc);
 	virtual bool start_frame(synfig::ProgressCallback *cb);
 	virtual void end_frame();
+	virtual bool repeat_frame();
 	virtual synfig::Color * start_scanline(int scanline);
 	virtual bool end_scanline();
 };
@@ -152,6 +152,13 @@ NoiseDistort::calc_supersample(const synfig::Point &/*x*/, float /*pw*/,float /*
 	return 0.0f;
 }
 
+bool
+NoiseDistort::is_static_between(synfig::Time a, synfig::Time b)const
+{
+	// The noise moves with the time at the given speed
+	return Layer_Composite::is_static_between(a,b) && !get_param_at("speed",a).get(Real());
+}
+
 void
 NoiseDistort::set_time(synfig::IndependentContext context, synfig::Time t)const
 {
@@ -192,6 +192,13 @@ Noise::calc_supersample(const synfig::Point &/*x*/, float /*pw*/,float /*ph*/)co
 	return 0.0f;
 }
 
+bool
+Noise::is_static_between(synfig::Time a, synfig::Time b)const
+{
+	// The noise moves with the time at the given speed
+	return Layer_Composite::is_static_between(a,b) && !get_param_at("speed",a).get(Real());
+}
+
 void
 Noise::set_time(synfig::IndependentContext context, synfig::Time t)const
 {
@@ -90,6 +90,7 @@ public:
 	synfig::Layer::Handle hit_check(synfig::Context context, const synfig::Point &point)const;
 	virtual void set_time(synfig::IndependentContext context, synfig::Time time)const;
 	virtual void set_time(synfig::IndependentContext context, synfig::Time time, const synfig::Point &point)const;
+	virtual bool is_static_between(synfig::Time a, synfig::Time b)const;
 
 	virtual Vocab get_param_vocab()const;
 };
@@ -33,10 +33,17 @@
 #endif
 
 #include "trgt_openexr.h"
+#include <synfig/general.h>
 #include <ETL/stringf>
 #include <cstdio>
+#include <cstring>
 #include <algorithm>
 #include <functional>
+#include <OpenEXR/OpenEXRConfig.h>
+#include <OpenEXR/ImfChannelList.h>
+#include <OpenEXR/ImfFrameBuffer.h>
+#include <OpenEXR/ImfHeader.h>
+#include <OpenEXR/half.h>
 #endif
 
 /* === M A C R O S ========================================================= */
@@ -53,12 +60,44 @@ SYNFIG_TARGET_SET_EXT(exr_trgt,"exr");
 SYNFIG_TARGET_SET_VERSION(exr_trgt,"1.0.4");
 SYNFIG_TARGET_SET_CVS_ID(exr_trgt,"$Id$");
 
+/* === P R O C E D U R E S ================================================= */
+
+//! Returns the compression named \a name, ZIP when empty or unknown
+static Imf::Compression
+compression_from_name(const String &name)
+{
+	if(name.empty() || name=="zip")
+		return Imf::ZIP_COMPRESSION;
+	if(name=="none")
+		return Imf::NO_COMPRESSION;
+	if(name=="rle")
+		return Imf::RLE_COMPRESSION;
+	if(name=="zips")
+		return Imf::ZIPS_COMPRESSION;
+	if(name=="piz")
+		return Imf::PIZ_COMPRESSION;
+	if(name=="pxr24")
+		return Imf::PXR24_COMPRESSION;
+	if(name=="b44")
+		return Imf::B44_COMPRESSION;
+	if(name=="b44a")
+		return Imf::B44A_COMPRESSION;
+#if defined(OPENEXR_VERSION_HEX) && OPENEXR_VERSION_HEX >= 0x02020000
+	if(name=="dwaa")
+		return Imf::DWAA_COMPRESSION;
+	if(name=="dwab")
+		return Imf::DWAB_COMPRESSION;
+#endif
+	synfig::warning("exr_trgt: Unknown compression \"%s\", using zip",name.c_str());
+	return Imf::ZIP_COMPRESSION;
+}
+
 /* === M E T H O D S ======================================================= */
 
 bool
 exr_trgt::ready()
 {
-	return (bool)exr_file;
+	return exr_file || exr_tiled_file;
 }
 
 exr_trgt::exr_trgt(const char *Filename, const synfig::TargetParam &params):
@@ -67,11 +106,11 @@ exr_trgt::exr_trgt(const char *Filename, const synfig::TargetParam &params):
 	scanline(),
 	filename(Filename),
 	exr_file(NULL),
-	buffer(NULL)
-#ifndef USE_HALF_TYPE
-	,
-	buffer_color(NULL)
-#endif
+	exr_tiled_file(NULL),
+	compression(compression_from_name(params.compression)),
+	tile_size(params.tile_size),
+	float_pixels(params.float_pixels),
+	rows_start(0)
 {
 	// OpenEXR uses linear gamma
 	gamma().set_gamma(1.0);
@@ -80,13 +119,8 @@ exr_trgt::exr_trgt(const char *Filename, const synfig::TargetParam &params):
 
 exr_trgt::~exr_trgt()
 {
-	if(exr_file)
-		delete exr_file;
-
-	if(buffer) delete [] buffer;
-#ifndef USE_HALF_TYPE
-	if(buffer_color) delete [] buffer_color;
-#endif
+	delete exr_file;
+	delete exr_tiled_file;
 }
 
 bool
@@ -102,6 +136,34 @@ exr_trgt::set_rend_desc(RendDesc *given_desc)
 	return true;
 }
 
+bool
+exr_trgt::has_frame_targets()const
+{
+	return is_file_sequence(filename,multi_image);
+}
+
+Target_Scanline::Handle
+exr_trgt::create_frame_target(int frame)
+{
+	if(!has_frame_targets())
+		return Target_Scanline::Handle();
+
+	TargetParam params;
+	params.sequence_separator=sequence_separator;
+	params.tile_size=tile_size;
+	params.float_pixels=float_pixels;
+	exr_trgt *target(new exr_trgt(filename.c_str(),params));
+	target->compression=compression;
+	init_sequence_target(*target,target->multi_image,target->imagecount,frame);
+	return Target_Scanline::Handle(target);
+}
+
+bool
+exr_trgt::repeat_frame()
+{
+	return repeat_sequence_frame(filename,sequence_separator,multi_image,imagecount);
+}
+
 bool
 exr_trgt::start_frame(synfig::ProgressCallback *cb)
 {
@@ -109,8 +171,11 @@ exr_trgt::start_frame(synfig::ProgressCallback *cb)
 
 	String frame_name;
 
-	if(exr_file)
-		delete exr_file;
+	delete exr_file;
+	delete exr_tiled_file;
+	exr_file=0;
+	exr_tiled_file=0;
+
 	if(multi_image)
 	{
 		frame_name = (filename_sans_extension(filename) +
@@ -124,30 +189,73 @@ exr_trgt::start_frame(synfig::ProgressCallback *cb)
 		frame_name=filename;
 		if(cb)cb->task(filename);
 	}
-	exr_file=new Imf::RgbaOutputFile(frame_name.c_str(),w,h,Imf::WRITE_RGBA,desc.get_pixel_aspect());
-#ifndef USE_HALF_TYPE
-	if(buffer_color) delete [] buffer_color;
-	buffer_color=new Color[w];
-#endif
-	//if(buffer) delete [] buffer;
-	//buffer=new Imf::Rgba[w];
-	out_surface.set_wh(w,h);
+
+	Imf::Header header(w,h,desc.get_pixel_aspect());
+	header.compression()=compression;
+	const Imf::PixelType type(float_pixels?Imf::FLOAT:Imf::HALF);
+	header.channels().insert("R",Imf::Channel(type));
+	header.channels().insert("G",Imf::Channel(type));
+	header.channels().insert("B",Imf::Channel(type));
+	header.channels().insert("A",Imf::Channel(type));
+
+	try
+	{
+		if(tile_size>0)
+		{
+			header.setTileDescription(Imf::TileDescription(tile_size,tile_size,Imf::ONE_LEVEL));
+			exr_tiled_file=new Imf::TiledOutputFile(frame_name.c_str(),header);
+		}
+		else
+			exr_file=new Imf::OutputFile(frame_name.c_str(),header);
+	}
+	catch(const std::exception &x)
+	{
+		synfig::error("exr_trgt: Unable to open %s: %s",frame_name.c_str(),x.what());
+		return false;
+	}
+
+	buffer_color.resize(w);
+	rows.resize((size_t)w*4*channel_size()*(tile_size>0?tile_size:1));
+	rows_start=0;
 
 	return true;
 }
 
 void
-exr_trgt::end_frame()
+exr_trgt::write_rows(int count)
 {
-	if(exr_file)
-	{
-		exr_file->setFrameBuffer(out_surface[0],1,desc.get_w());
-		exr_file->writePixels(desc.get_h());
+	const size_t xstride(4*channel_size());
+	const size_t ystride(xstride*desc.get_w());
+	// Slices address the pixels from the origin of the image
+	char *base(&rows[0]-rows_start*ystride);
+	const Imf::PixelType type(float_pixels?Imf::FLOAT:Imf::HALF);
+
+	Imf::FrameBuffer frame_buffer;
+	frame_buffer.insert("R",Imf::Slice(type,base,xstride,ystride));
+	frame_buffer.insert("G",Imf::Slice(type,base+channel_size(),xstride,ystride));
+	frame_buffer.insert("B",Imf::Slice(type,base+2*channel_size(),xstride,ystride));
+	frame_buffer.insert("A",Imf::Slice(type,base+3*channel_size(),xstride,ystride));
 
-		delete exr_file;
+	if(exr_tiled_file)
+	{
+		const int tile_row(rows_start/tile_size);
+		exr_tiled_file->setFrameBuffer(frame_buffer);
+		exr_tiled_file->writeTiles(0,exr_tiled_file->numXTiles()-1,tile_row,tile_row);
+	}
+	else
+	{
+		exr_file->setFrameBuffer(frame_buffer);
+		exr_file->writePixels(count);
 	}
+}
 
+void
+exr_trgt::end_frame()
+{
+	delete exr_file;
+	delete exr_tiled_file;
 	exr_file=0;
+	exr_tiled_file=0;
 
 	imagecount++;
 }
@@ -156,12 +264,8 @@ Color *
 exr_trgt::start_scanline(int i)
 {
 	scanline=i;
-#ifndef USE_HALF_TYPE
-	return reinterpret_cast<Color *>(buffer_color);
-#else
-	return reinterpret_cast<Color *>(out_surface[scanline]);
-//	return reinterpret_cast<unsigned char *>(buffer);
-#endif
+	rows_start=tile_size>0?i-i%tile_size:i;
+	return &buffer_color[0];
 }
 
 bool
@@ -170,22 +274,47 @@ exr_trgt::end_scanline()
 	if(!ready())
 		return false;
 
-#ifndef USE_HALF_TYPE
-	int i;
-	for(i=0;i<desc.get_w();i++)
+	const int w(desc.get_w());
+	char *row(&rows[(size_t)(scanline-rows_start)*w*4*channel_size()]);
+	if(float_pixels)
 	{
-//		Imf::Rgba &rgba=buffer[i];
-		Imf::Rgba &rgba=out_surface[scanline][i];
-		Color &color=buffer_color[i];
-		rgba.r=color.get_r();
-		rgba.g=color.get_g();
-		rgba.b=color.get_b();
-		rgba.a=color.get_a();
+		float *out(reinterpret_cast<float*>(row));
+		for(int i=0;i<w;i++,out+=4)
+		{
+			const Color &color(buffer_color[i]);
+			out[0]=color.get_r();
+			out[1]=color.get_g();
+			out[2]=color.get_b();
+			out[3]=color.get_a();
+		}
+	}
+	else
+	{
+		half *out(reinterpret_cast<half*>(row));
+		for(int i=0;i<w;i++,out+=4)
+		{
+			const Color &color(buffer_color[i]);
+			out[0]=color.get_r();
+			out[1]=color.get_g();
+			out[2]=color.get_b();
+			out[3]=color.get_a();
+		}
 	}
-#endif
 
-    //exr_file->setFrameBuffer(buffer,1,desc.get_w());
-	//exr_file->writePixels(1);
+	// Write the row, or the row of tiles once its last row is done
+	const bool last(scanline==desc.get_h()-1);
+	if(tile_size>0 && (scanline+1)%tile_size!=0 && !last)
+		return true;
+
+	try
+	{
+		write_rows(scanline-rows_start+1);
+	}
+	catch(const std::exception &x)
+	{
+		synfig::error("exr_trgt: Unable to write: %s",x.what());
+		return false;
+	}
 
 	return true;
 }
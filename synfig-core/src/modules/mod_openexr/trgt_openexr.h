@@ -34,8 +34,10 @@
 #include <synfig/surface.h>
 #include <synfig/targetparam.h>
 #include <cstdio>
-#include <OpenEXR/ImfArray.h>
-#include <OpenEXR/ImfRgbaFile.h>
+#include <vector>
+#include <OpenEXR/ImfCompression.h>
+#include <OpenEXR/ImfOutputFile.h>
+#include <OpenEXR/ImfTiledOutputFile.h>
 #include <exception>
 
 /* === M A C R O S ========================================================= */
@@ -44,6 +46,13 @@
 
 /* === C L A S S E S & S T R U C T S ======================================= */
 
+/*!	\class exr_trgt
+**	\brief Writes OpenEXR images
+**
+**	Rows are written as they are rendered, or by rows of tiles when a
+**	tile size is given. The compression and the channel type (half or
+**	float) are taken from the target parameters.
+*/
 class exr_trgt : public synfig::Target_Scanline
 {
 public:
@@ -51,20 +60,38 @@ private:
 	bool multi_image;
 	int imagecount,scanline;
 	synfig::String filename;
-	Imf::RgbaOutputFile *exr_file;
-	Imf::Rgba *buffer;
-	etl::surface<Imf::Rgba> out_surface;
-#ifndef USE_HALF_TYPE
-	synfig::Color *buffer_color;
-#endif
+
+	//! Written when no tile size is given
+	Imf::OutputFile *exr_file;
+	//! Written when a tile size is given
+	Imf::TiledOutputFile *exr_tiled_file;
+
+	Imf::Compression compression;
+	int tile_size;
+	bool float_pixels;
+
+	//! The rendered row
+	std::vector<synfig::Color> buffer_color;
+	//! Converted rows waiting to be written, one or a row of tiles
+	std::vector<char> rows;
+	//! First image row held in \a rows
+	int rows_start;
 
 	bool ready();
 	synfig::String sequence_separator;
+
+	//! Size of one channel of a pixel, in bytes
+	int channel_size()const { return float_pixels?4:2; }
+	//! Writes the rows held in \a rows
+	void write_rows(int count);
 public:
 	exr_trgt(const char *filename, const synfig::TargetParam& /* params */);
 	virtual ~exr_trgt();
 
 	virtual bool set_rend_desc(synfig::RendDesc *desc);
+	virtual synfig::Target_Scanline::Handle create_frame_target(int frame);
+	virtual bool has_frame_targets()const;
+	virtual bool repeat_frame();
 	virtual bool start_frame(synfig::ProgressCallback *cb);
 	virtual void end_frame();
 
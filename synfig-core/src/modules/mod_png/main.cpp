@@ -37,6 +37,7 @@
 #include <synfig/module.h>
 #include "trgt_png.h"
 #include "trgt_png_spritesheet.h"
+#include "trgt_png_atlas.h"
 #include "trgt_cairo_png.h"
 #include "mptr_png.h"
 #include "mptr_cairo_png.h"
@@ -57,6 +58,7 @@ MODULE_INVENTORY_BEGIN(mod_png)
 		TARGET(cairo_png_trgt)
 		TARGET(png_trgt)
 		TARGET(png_trgt_spritesheet)
+		TARGET(png_trgt_atlas)
 		TARGET_EXT(png_trgt, "png")
 	END_TARGETS
 	BEGIN_IMPORTERS
@@ -45,8 +45,11 @@
 
 
 #include <cstdio>
+#include <cstring>
 #include <algorithm>
 #include <functional>
+#include <sstream>
+#include <vector>
 #endif
 
 /* === M A C R O S ========================================================= */
@@ -57,6 +60,9 @@ using namespace etl;
 
 #define PNG_CHECK_BYTES 	8
 
+//! Number of rows decoded before they are made available to the renderer
+#define PNG_BAND_ROWS		32
+
 /* === G L O B A L S ======================================================= */
 
 SYNFIG_IMPORTER_INIT(png_mptr);
@@ -87,16 +93,23 @@ png_mptr::png_out_warning(png_struct */*png_data*/,const char *msg)
 void
 png_mptr::read_callback(png_structp png_ptr, png_bytep out_bytes, png_size_t bytes_count_to_read)
 {
-	FileSystem::ReadStream *stream = (FileSystem::ReadStream*)png_get_io_ptr(png_ptr);
-	png_size_t s = stream == NULL
-				 ? 0
-				 : stream->read_block(out_bytes, bytes_count_to_read);
+	png_mptr *importer = (png_mptr*)png_get_io_ptr(png_ptr);
+	png_size_t s = std::min(bytes_count_to_read, (png_size_t)(importer->file_size - importer->file_pos));
+	memcpy(out_bytes, importer->file_data + importer->file_pos, s);
+	importer->file_pos += s;
 	if (s < bytes_count_to_read)
 		memset(out_bytes + s, 0, bytes_count_to_read - s);
 }
 
 png_mptr::png_mptr(const synfig::FileSystem::Identifier &identifier):
-	Importer(identifier)
+	Importer(identifier),
+	file_data(NULL),
+	file_size(0),
+	file_pos(0),
+	png_ptr(NULL),
+	info_ptr(NULL),
+	end_info(NULL),
+	trim(false)
 {
 	/* Open the file pointer */
 	FileSystem::ReadStreamHandle stream = identifier.get_read_stream();
@@ -107,23 +120,41 @@ png_mptr::png_mptr(const synfig::FileSystem::Identifier &identifier):
 		return;
     }
 
+	// Read the whole file now: the image is decoded in background
+	// and file systems are not safe to share between threads
+	if (stream->data())
+	{
+		file_stream = stream;
+		file_data = stream->data();
+		file_size = stream->data_size();
+	}
+	else
+	{
+		std::ostringstream tmp;
+		tmp << stream->rdbuf();
+		file_buffer = tmp.str();
+		file_data = file_buffer.data();
+		file_size = file_buffer.size();
+	}
+	stream.reset();
+
 	/* Make sure we are dealing with a PNG format file */
-	png_byte header[PNG_CHECK_BYTES];
-	if (!stream->read_variable(header))
+	if (file_size < PNG_CHECK_BYTES)
 	{
         //! \todo THROW SOMETHING
 		throw strprintf("Cannot read header from \"%s\"",identifier.filename.c_str());
 		return;
 	}
 
-    if (0 != png_sig_cmp(header, 0, PNG_CHECK_BYTES))
+    if (0 != png_sig_cmp((png_bytep)file_data, 0, PNG_CHECK_BYTES))
     {
         //! \todo THROW SOMETHING
 		throw strprintf("This (\"%s\") doesn't appear to be a PNG file",identifier.filename.c_str());
 		return;
     }
+	file_pos = PNG_CHECK_BYTES;
 
-	png_structp png_ptr = png_create_read_struct
+	png_ptr = png_create_read_struct
        (PNG_LIBPNG_VER_STRING, (png_voidp)this,
         &png_mptr::png_out_error, &png_mptr::png_out_warning);
 	if (!png_ptr)
@@ -133,7 +164,7 @@ png_mptr::png_mptr(const synfig::FileSystem::Identifier &identifier):
 		return;
     }
 
-    png_infop info_ptr = png_create_info_struct(png_ptr);
+    info_ptr = png_create_info_struct(png_ptr);
     if (!info_ptr)
     {
         png_destroy_read_struct(&png_ptr,
@@ -143,7 +174,7 @@ png_mptr::png_mptr(const synfig::FileSystem::Identifier &identifier):
 		return;
     }
 
-    png_infop end_info = png_create_info_struct(png_ptr);
+    end_info = png_create_info_struct(png_ptr);
     if (!end_info)
     {
         png_destroy_read_struct(&png_ptr, &info_ptr,
@@ -153,18 +184,62 @@ png_mptr::png_mptr(const synfig::FileSystem::Identifier &identifier):
 		return;
     }
 
-    png_set_read_fn(png_ptr, stream.get(), read_callback);
+    png_set_read_fn(png_ptr, this, read_callback);
 	png_set_sig_bytes(png_ptr,PNG_CHECK_BYTES);
 
 	png_read_info(png_ptr, info_ptr);
 
-	int bit_depth,color_type,interlace_type, compression_type,filter_method;
-	png_uint_32 width,height;
+	int bit_depth,compression_type,filter_method;
 
-	png_get_IHDR(png_ptr, info_ptr, &width, &height,
+	png_get_IHDR(png_ptr, info_ptr, &frame_width, &frame_height,
 				 &bit_depth, &color_type, &interlace_type,
 				 &compression_type, &filter_method);
 
+	switch(color_type)
+	{
+	case PNG_COLOR_TYPE_RGB:
+	case PNG_COLOR_TYPE_RGB_ALPHA:
+	case PNG_COLOR_TYPE_GRAY:
+	case PNG_COLOR_TYPE_GRAY_ALPHA:
+		break;
+
+	case PNG_COLOR_TYPE_PALETTE:
+	{
+        png_colorp png_palette;
+        int num_palette;
+	    png_get_PLTE(png_ptr, info_ptr, &png_palette, &num_palette);
+	    png_bytep trans_alpha = NULL;
+	    int num_trans = 0;
+	    bool has_alpha = (png_get_tRNS(png_ptr, info_ptr, &trans_alpha, &num_trans,
+	                                   NULL) & PNG_INFO_tRNS);
+		if (!has_alpha || trans_alpha == NULL)
+			num_trans = 0;
+
+		// Convert the palette once instead of once per pixel
+		for(int i = 0; i < 256; i++)
+		{
+			if (i >= num_palette)
+			{
+				palette[i] = Color::black();
+				continue;
+			}
+			palette[i] = Color(
+				gamma().r_U8_to_F32((unsigned char)png_palette[i].red),
+				gamma().g_U8_to_F32((unsigned char)png_palette[i].green),
+				gamma().b_U8_to_F32((unsigned char)png_palette[i].blue),
+				i < num_trans ? trans_alpha[i]*(1.0/255.0) : 1.0
+			);
+		}
+		break;
+	}
+	default:
+		png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+		synfig::error("png_mptr: error: Unsupported color type");
+        //! \todo THROW SOMETHING
+		throw String("error on importer construction, *WRITEME*6");
+		return;
+	}
+
 	if (bit_depth == 16)
 		png_set_strip_16(png_ptr);
 
@@ -178,18 +253,8 @@ png_mptr::png_mptr(const synfig::FileSystem::Identifier &identifier):
 		png_set_gamma(png_ptr, gamma().get_gamma(), fgamma);
 	}
 
-
-	/*
-	if (setjmp(png_jmpbuf(png_ptr)))
-	{
-		synfig::error("Unable to setup longjump");
-		png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
-		fclose(file);
-        //! \todo THROW SOMETHING
-		throw String("error on importer construction, *WRITEME*5");
-		return;
-	}
-	*/
+	if (interlace_type != PNG_INTERLACE_NONE)
+		png_set_interlace_handling(png_ptr);
 
 	// man libpng tells me:
 	//   You must use png_transforms and not call any
@@ -198,225 +263,213 @@ png_mptr::png_mptr(const synfig::FileSystem::Identifier &identifier):
 	//   png_read_png(png_ptr, info_ptr, PNG_TRANSFORM_PACKING|PNG_TRANSFORM_STRIP_16, NULL);
 
 	png_read_update_info(png_ptr, info_ptr);
-	png_uint_32 rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+	rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+}
 
-	// allocate buffer to read image data into
-	png_bytep *row_pointers=new png_bytep[height];
-	png_byte *data = new png_byte[rowbytes*height];
-	for (png_uint_32 i = 0; i < height; i++)
-		row_pointers[i] = &(data[rowbytes*i]);
+bool
+png_mptr::get_frame_size(int &width, int &height)const
+{
+	width = frame_width;
+	height = frame_height;
+	return true;
+}
 
-	png_read_image(png_ptr, row_pointers);
+void
+png_mptr::begin_decoding()
+{
+	const int reduction = get_reduction();
+	surface_buffer.set_wh((frame_width + reduction - 1)/reduction, (frame_height + reduction - 1)/reduction);
 
-	png_uint_32 x, y;
-	surface_buffer.set_wh(width,height);
+	// Decode the pixels in background, so the layer can render the first
+	// rows, and other images can be decoded, while this one is not finished
+	start_decoding(surface_buffer.get_h());
+}
+
+png_mptr::~png_mptr()
+{
+	stop_decoding();
+	if (png_ptr)
+		png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+}
+
+void
+png_mptr::convert_row(const png_byte *row, Color *dest)const
+{
+	const int width = frame_width;
+	int x;
 
 	switch(color_type)
 	{
 	case PNG_COLOR_TYPE_RGB:
-		for(y=0;y<height;y++)
-			for(x=0;x<width;x++)
-			{
-				float r=gamma().r_U8_to_F32((unsigned char)row_pointers[y][x*3+0]);
-				float g=gamma().g_U8_to_F32((unsigned char)row_pointers[y][x*3+1]);
-				float b=gamma().b_U8_to_F32((unsigned char)row_pointers[y][x*3+2]);
-				surface_buffer[y][x]=Color(
-					r,
-					g,
-					b,
-					1.0
-				);
-/*
-				surface_buffer[y][x]=Color(
-					(float)(unsigned char)row_pointers[y][x*3+0]*(1.0/255.0),
-					(float)(unsigned char)row_pointers[y][x*3+1]*(1.0/255.0),
-					(float)(unsigned char)row_pointers[y][x*3+2]*(1.0/255.0),
-					1.0
-				);
-*/
-			}
+		for(x=0;x<width;x++, row+=3)
+			dest[x]=Color(
+				gamma().r_U8_to_F32((unsigned char)row[0]),
+				gamma().g_U8_to_F32((unsigned char)row[1]),
+				gamma().b_U8_to_F32((unsigned char)row[2]),
+				1.0
+			);
 		break;
 
 	case PNG_COLOR_TYPE_RGB_ALPHA:
-		for(y=0;y<height;y++)
-			for(x=0;x<width;x++)
-			{
-				float r=gamma().r_U8_to_F32((unsigned char)row_pointers[y][x*4+0]);
-				float g=gamma().g_U8_to_F32((unsigned char)row_pointers[y][x*4+1]);
-				float b=gamma().b_U8_to_F32((unsigned char)row_pointers[y][x*4+2]);
-				surface_buffer[y][x]=Color(
-					r,
-					g,
-					b,
-					(float)(unsigned char)row_pointers[y][x*4+3]*(1.0/255.0)
-				);
-				/*
-				surface_buffer[y][x]=Color(
-					(float)(unsigned char)row_pointers[y][x*4+0]*(1.0/255.0),
-					(float)(unsigned char)row_pointers[y][x*4+1]*(1.0/255.0),
-					(float)(unsigned char)row_pointers[y][x*4+2]*(1.0/255.0),
-					(float)(unsigned char)row_pointers[y][x*4+3]*(1.0/255.0)
-				);
-				*/
-			}
+		for(x=0;x<width;x++, row+=4)
+			dest[x]=Color(
+				gamma().r_U8_to_F32((unsigned char)row[0]),
+				gamma().g_U8_to_F32((unsigned char)row[1]),
+				gamma().b_U8_to_F32((unsigned char)row[2]),
+				(float)(unsigned char)row[3]*(1.0/255.0)
+			);
 		break;
 
 	case PNG_COLOR_TYPE_GRAY:
-		for(y=0;y<height;y++)
-			for(x=0;x<width;x++)
-			{
-				float gray=gamma().g_U8_to_F32((unsigned char)row_pointers[y][x]);
-				//float gray=(float)(unsigned char)row_pointers[y][x]*(1.0/255.0);
-				surface_buffer[y][x]=Color(
-					gray,
-					gray,
-					gray,
-					1.0
-				);
-			}
+		for(x=0;x<width;x++)
+		{
+			float gray=gamma().g_U8_to_F32((unsigned char)row[x]);
+			dest[x]=Color(gray, gray, gray, 1.0);
+		}
 		break;
 
 	case PNG_COLOR_TYPE_GRAY_ALPHA:
-		for(y=0;y<height;y++)
-			for(x=0;x<width;x++)
-			{
-				float gray=gamma().g_U8_to_F32((unsigned char)row_pointers[y][x*2]);
-//				float gray=(float)(unsigned char)row_pointers[y][x*2]*(1.0/255.0);
-				surface_buffer[y][x]=Color(
-					gray,
-					gray,
-					gray,
-					(float)(unsigned char)row_pointers[y][x*2+1]*(1.0/255.0)
-				);
-			}
+		for(x=0;x<width;x++, row+=2)
+		{
+			float gray=gamma().g_U8_to_F32((unsigned char)row[0]);
+			dest[x]=Color(
+				gray,
+				gray,
+				gray,
+				(float)(unsigned char)row[1]*(1.0/255.0)
+			);
+		}
 		break;
 
 	case PNG_COLOR_TYPE_PALETTE:
-	{
-        png_colorp palette;
-        int num_palette;
-	    png_get_PLTE(png_ptr, info_ptr, &palette, &num_palette);
-	    png_bytep trans_alpha = NULL;
-	    int num_trans = 0;
-	    bool has_alpha = (png_get_tRNS(png_ptr, info_ptr, &trans_alpha, &num_trans,
-	                                   NULL) & PNG_INFO_tRNS);
-		for(y=0;y<height;y++)
-			for(x=0;x<width;x++)
-			{
-				float r=gamma().r_U8_to_F32((unsigned char)palette[row_pointers[y][x]].red);
-				float g=gamma().g_U8_to_F32((unsigned char)palette[row_pointers[y][x]].green);
-				float b=gamma().b_U8_to_F32((unsigned char)palette[row_pointers[y][x]].blue);
-				float a=1.0;
-
-                if (has_alpha && num_trans > 0 && trans_alpha != NULL)
-                {
-                    a = row_pointers[y][x] < num_trans ?
-                            (trans_alpha[row_pointers[y][x]]*(1.0/255.0)) : 1.0;
-                }
-
-				surface_buffer[y][x]=Color(
-					r,
-					g,
-					b,
-					a
-				);
-			}
+		for(x=0;x<width;x++)
+			dest[x]=palette[row[x]];
 		break;
 	}
-	default:
-		png_read_end(png_ptr, end_info);
-		png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
-		synfig::error("png_mptr: error: Unsupported color type");
-        //! \todo THROW SOMETHING
-		throw String("error on importer construction, *WRITEME*6");
+}
+
+void
+png_mptr::put_row(const png_byte *row, png_uint_32 y, Color *line, Color *sum)
+{
+	const int reduction = get_reduction();
+	if (reduction == 1)
+	{
+		convert_row(row, surface_buffer[y]);
 		return;
 	}
 
-	png_read_end(png_ptr, end_info);
-	png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
-	stream.reset();
-
-	delete [] row_pointers;
-	delete [] data;
-
-	trim = false;
+	// Average blocks of reduction x reduction pixels, with premultiplied alpha
+	const int width = surface_buffer.get_w();
+	const ColorPrep prep;
+	int x;
 
-	//if (getenv("SYNFIG_DISABLE_CROP_IMPORTED_IMAGES"))
-		return;
+	convert_row(row, line);
+	if (y % reduction == 0)
+		std::fill(sum, sum + width, Color(0, 0, 0, 0));
+	for(x = 0; x < (int)frame_width; x++)
+		sum[x/reduction] += prep.cook(line[x]);
 
-	switch(color_type)
+	if ((int)(y % reduction) == reduction - 1 || y == frame_height - 1)
 	{
-	case PNG_COLOR_TYPE_RGB_ALPHA:
-	case PNG_COLOR_TYPE_GRAY_ALPHA:
-	case PNG_COLOR_TYPE_PALETTE:
-		for(y=0;y<height;y++)
+		const int rows = y % reduction + 1;
+		Color *dest = surface_buffer[y/reduction];
+		for(x = 0; x < width; x++)
 		{
-			for(x=0;x<width;x++)
-				if (surface_buffer[y][x].get_a()) break;
-			if (x != width) break;
+			const int cols = std::min(reduction, (int)frame_width - x*reduction);
+			dest[x] = prep.uncook(sum[x]/(float)(rows*cols));
 		}
+	}
+}
 
-		if (y != height)
-		{
-#define BORDER 1				// don't chop off all the transparent space - leave a border this many pixels wide for the interpolation
-
-			png_uint_32 min_x, min_y, max_x, max_y;
-			if (y>BORDER) min_y = y-BORDER; else min_y = 0;
-
-			for(y=height-1;y>0;y--)
-			{
-				for(x=0;x<width;x++)
-					if (surface_buffer[y][x].get_a()) break;
-				if (x != width) break;
-			}
-			max_y = std::min(y+BORDER,height-1);
+bool
+png_mptr::decode()
+{
+	const png_uint_32 height = frame_height;
+	const int reduction = get_reduction();
+	const bool interlaced = interlace_type != PNG_INTERLACE_NONE;
+
+	// Interlaced images are only complete after the last pass,
+	// so they need a buffer for the whole image
+	const png_uint_32 buffer_rows = interlaced ? height : std::min<png_uint_32>(PNG_BAND_ROWS, height);
+	row_data.resize(rowbytes*buffer_rows);
+	row_pointers.resize(buffer_rows);
+	for (png_uint_32 i = 0; i < buffer_rows; i++)
+		row_pointers[i] = &row_data[rowbytes*i];
+
+	line_buffer.resize(reduction > 1 ? frame_width : 0);
+	sum_buffer.resize(reduction > 1 ? surface_buffer.get_w() : 0);
+	Color *line_ptr = line_buffer.empty() ? NULL : &line_buffer[0];
+	Color *sum_ptr = sum_buffer.empty() ? NULL : &sum_buffer[0];
 
-			for(x=0;x<width;x++)
-			{
-				for(y=0;y<height;y++)
-					if (surface_buffer[y][x].get_a()) break;
-				if (y != height) break;
-			}
-			if (x>BORDER) min_x = x-BORDER; else min_x = 0;
+	if (setjmp(png_jmpbuf(png_ptr)))
+	{
+		png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+		free_decode_buffers();
+		return false;
+	}
 
-			for(x=width-1;x>0;x--)
+	if (interlaced)
+	{
+		png_read_image(png_ptr, &row_pointers[0]);
+		for(png_uint_32 y = 0; y < height; y++)
+		{
+			put_row(row_pointers[y], y, line_ptr, sum_ptr);
+			if ((y+1) % PNG_BAND_ROWS == 0 && !set_rows_decoded((y+1)/reduction))
 			{
-				for(y=0;y<height;y++)
-					if (surface_buffer[y][x].get_a()) break;
-				if (y != height) break;
+				free_decode_buffers();
+				return false;
 			}
-			max_x = std::min(x+BORDER,width-1);
-
-			if (min_x != 0 || max_x != width-1 ||
-				min_y != 0 || max_y != height-1)
+		}
+	}
+	else
+	{
+		// PNG_BAND_ROWS is a multiple of any reduction, so bands end on reduced rows
+		for(png_uint_32 y = 0; y < height; )
+		{
+			png_uint_32 rows = std::min<png_uint_32>(buffer_rows, height - y);
+			png_read_rows(png_ptr, &row_pointers[0], NULL, rows);
+			for(png_uint_32 i = 0; i < rows; i++)
+				put_row(row_pointers[i], y+i, line_ptr, sum_ptr);
+			y += rows;
+			if (!set_rows_decoded(y == height ? surface_buffer.get_h() : y/reduction))
 			{
-				trim = true;
-				orig_width = width;
-				orig_height = height;
-				trimmed_x = min_x;
-				trimmed_y = min_y;
-
-				width=max_x-min_x+1;
-				height=max_y-min_y+1;
-				synfig::Surface tmp_buffer;
-				tmp_buffer.set_wh(width,height);
-				for(y=0;y<height;y++)
-					for(x=0;x<width;x++)
-						tmp_buffer[y][x] = surface_buffer[y+min_y][x+min_x];
-				surface_buffer = tmp_buffer;
+				free_decode_buffers();
+				return false;
 			}
 		}
 	}
+
+	png_read_end(png_ptr, end_info);
+	png_destroy_read_struct(&png_ptr, &info_ptr, &end_info);
+	free_decode_buffers();
+	String().swap(file_buffer);
+	return true;
 }
 
-png_mptr::~png_mptr()
+void
+png_mptr::free_decode_buffers()
+{
+	std::vector<png_byte>().swap(row_data);
+	std::vector<png_bytep>().swap(row_pointers);
+	std::vector<Color>().swap(line_buffer);
+	std::vector<Color>().swap(sum_buffer);
+}
+
+void
+png_mptr::end_decoding()
 {
+	file_stream.reset();
+	file_data = NULL;
+	file_size = 0;
 }
 
 bool
 png_mptr::get_frame(synfig::Surface &surface, const synfig::RendDesc &/*renddesc*/, Time, synfig::ProgressCallback */*cb*/)
 {
 	//assert(0);					// shouldn't be called?
+	if (!wait_rows(surface_buffer.get_h()))
+		return false;
+	release_decoding();
 	surface=surface_buffer;
 	return true;
 }
@@ -426,6 +479,9 @@ png_mptr::get_frame(synfig::Surface &surface, const synfig::RendDesc &/*renddesc
 					bool &trimmed, unsigned int &width, unsigned int &height, unsigned int &top, unsigned int &left,
 					synfig::ProgressCallback */*cb*/)
 {
+	if (!wait_rows(surface_buffer.get_h()))
+		return false;
+	release_decoding();
 	surface=surface_buffer;
 	if ((trimmed = trim))
 	{
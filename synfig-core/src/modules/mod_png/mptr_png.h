@@ -29,6 +29,7 @@
 
 /* === H E A D E R S ======================================================= */
 
+#include <vector>
 #include <png.h>
 #include <synfig/importer.h>
 #include <synfig/string.h>
@@ -46,6 +47,34 @@ class png_mptr : public synfig::Importer
 private:
 	synfig::Surface surface_buffer;
 
+	//! Contents of the file, read up front so decoding never touches the file system
+	synfig::String file_buffer;
+	//! The file when it is mapped in memory, it is decoded from there without copy.
+	//! Released by end_decoding() once the frame is decoded
+	synfig::FileSystem::ReadStreamHandle file_stream;
+	const char *file_data;
+	size_t file_size;
+	size_t file_pos;
+
+	png_structp png_ptr;
+	png_infop info_ptr;
+	png_infop end_info;
+	png_uint_32 frame_width, frame_height;
+	int color_type;
+	int interlace_type;
+	png_uint_32 rowbytes;
+	//! Palette converted to colors, for PNG_COLOR_TYPE_PALETTE images
+	synfig::Color palette[256];
+
+	//! Buffers of decode(), members so that libpng errors can longjmp past them
+	std::vector<png_byte> row_data;
+	std::vector<png_bytep> row_pointers;
+	//! Full resolution row and sums of the current reduced row, when reducing
+	std::vector<synfig::Color> line_buffer;
+	std::vector<synfig::Color> sum_buffer;
+
+	void free_decode_buffers();
+
 	bool trim;
 	unsigned int orig_width, orig_height, trimmed_x, trimmed_y;
 
@@ -53,10 +82,21 @@ private:
 	static void png_out_warning(png_struct *png_data,const char *msg);
 	static void read_callback(png_structp png_ptr, png_bytep out_bytes, png_size_t bytes_count_to_read);
 
+	void convert_row(const png_byte *row, synfig::Color *dest)const;
+	void put_row(const png_byte *row, png_uint_32 y, synfig::Color *line, synfig::Color *sum);
+
+protected:
+	virtual bool get_frame_size(int &width, int &height)const;
+	virtual void begin_decoding();
+	virtual bool decode();
+	virtual void end_decoding();
+
 public:
 	png_mptr(const synfig::FileSystem::Identifier &identifier);
 	~png_mptr();
 
+	virtual synfig::Surface* get_frame_buffer() { return &surface_buffer; }
+
 	virtual bool get_frame(synfig::Surface &surface, const synfig::RendDesc &renddesc, synfig::Time time, synfig::ProgressCallback *callback);
 	virtual bool get_frame(synfig::Surface &surface, const synfig::RendDesc &renddesc, synfig::Time time,
 						   bool &trimmed, unsigned int &width, unsigned int &height, unsigned int &top, unsigned int &left,
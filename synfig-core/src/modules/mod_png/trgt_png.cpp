@@ -113,6 +113,36 @@ png_trgt::set_rend_desc(RendDesc *given_desc)
 	return true;
 }
 
+bool
+png_trgt::has_frame_targets()const
+{
+	return is_file_sequence(filename,multi_image);
+}
+
+Target_Scanline::Handle
+png_trgt::create_frame_target(int frame)
+{
+	if(!has_frame_targets())
+		return Target_Scanline::Handle();
+
+	TargetParam params;
+	params.sequence_separator=sequence_separator;
+	png_trgt *target(new png_trgt(filename.c_str(),params));
+	init_sequence_target(*target,target->multi_image,target->imagecount,frame);
+	if(get_canvas())
+	{
+		target->canvas_name=get_canvas()->get_name();
+		target->canvas_description=get_canvas()->get_description();
+	}
+	return Target_Scanline::Handle(target);
+}
+
+bool
+png_trgt::repeat_frame()
+{
+	return repeat_sequence_frame(filename,sequence_separator,multi_image,imagecount);
+}
+
 void
 png_trgt::end_frame()
 {
@@ -134,6 +164,12 @@ png_trgt::start_frame(synfig::ProgressCallback *callback)
 {
 	int w=desc.get_w(),h=desc.get_h();
 
+	if(get_canvas())
+	{
+		canvas_name=get_canvas()->get_name();
+		canvas_description=get_canvas()->get_description();
+	}
+
 	if(file && file!=stdout)
 		fclose(file);
 	if(filename=="-")
@@ -215,10 +251,10 @@ png_trgt::start_frame(synfig::ProgressCallback *callback)
 	// Output any text info along with the file
 	png_text comments[]=
 	{
-		{ PNG_TEXT_COMPRESSION_NONE, title, const_cast<char *>(get_canvas()->get_name().c_str()),
-		  strlen(get_canvas()->get_name().c_str()) },
-		{ PNG_TEXT_COMPRESSION_NONE, description, const_cast<char *>(get_canvas()->get_description().c_str()),
-		  strlen(get_canvas()->get_description().c_str()) },
+		{ PNG_TEXT_COMPRESSION_NONE, title, const_cast<char *>(canvas_name.c_str()),
+		  strlen(canvas_name.c_str()) },
+		{ PNG_TEXT_COMPRESSION_NONE, description, const_cast<char *>(canvas_description.c_str()),
+		  strlen(canvas_description.c_str()) },
 //		{ PNG_TEXT_COMPRESSION_NONE, copyright, voria, strlen(voria) },
 		{ PNG_TEXT_COMPRESSION_NONE, software, synfig, strlen(synfig) },
 	};
@@ -58,11 +58,16 @@ private:
 	unsigned char *buffer;
 	synfig::Color *color_buffer;
 	synfig::String sequence_separator;
+	//! Texts of the canvas written in the file, frame targets have no canvas
+	synfig::String canvas_name, canvas_description;
 public:
 	png_trgt(const char *filename, const synfig::TargetParam& /* params */);
 	virtual ~png_trgt();
 
 	virtual bool set_rend_desc(synfig::RendDesc *desc);
+	virtual synfig::Target_Scanline::Handle create_frame_target(int frame);
+	virtual bool has_frame_targets()const;
+	virtual bool repeat_frame();
 	virtual bool start_frame(synfig::ProgressCallback *cb);
 	virtual void end_frame();
 
@@ -0,0 +1,398 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file trgt_png_atlas.cpp
+**	\brief Texture atlas render target
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+**
+** === N O T E S ===========================================================
+**
+** ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "trgt_png_atlas.h"
+#include <png.h>
+#include <synfig/general.h>
+#include <ETL/stringf>
+#include <ETL/misc>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#endif
+
+/* === M A C R O S ========================================================= */
+
+using namespace synfig;
+using namespace std;
+using namespace etl;
+
+/* === G L O B A L S ======================================================= */
+
+SYNFIG_TARGET_INIT(png_trgt_atlas);
+SYNFIG_TARGET_SET_NAME(png_trgt_atlas,"png-atlas");
+SYNFIG_TARGET_SET_EXT(png_trgt_atlas,"png");
+SYNFIG_TARGET_SET_VERSION(png_trgt_atlas,"0.1");
+SYNFIG_TARGET_SET_CVS_ID(png_trgt_atlas,"$Id$");
+
+/* === P R O C E D U R E S ================================================= */
+
+//! FNV-1a hash of \a size bytes
+static unsigned long long
+hash_bytes(unsigned long long hash, const unsigned char *data, size_t size)
+{
+	for(size_t i=0;i<size;i++)
+	{
+		hash^=data[i];
+		hash*=1099511628211ULL;
+	}
+	return hash;
+}
+
+//! Escapes \a x for a JSON string
+static String
+json_escape(const String &x)
+{
+	String ret;
+	for(String::const_iterator i=x.begin();i!=x.end();++i)
+	{
+		if(*i=='"' || *i=='\\')
+			ret+='\\';
+		ret+=*i;
+	}
+	return ret;
+}
+
+/* === M E T H O D S ======================================================= */
+
+void
+png_trgt_atlas::png_out_error(png_struct *png_data,const char *msg)
+{
+	png_trgt_atlas *me=(png_trgt_atlas*)png_get_error_ptr(png_data);
+	synfig::error(strprintf("png_trgt_atlas: error: %s",msg));
+	me->ready=false;
+}
+
+void
+png_trgt_atlas::png_out_warning(png_struct *png_data,const char *msg)
+{
+	png_trgt_atlas *me=(png_trgt_atlas*)png_get_error_ptr(png_data);
+	synfig::warning(strprintf("png_trgt_atlas: warning: %s",msg));
+}
+
+png_trgt_atlas::png_trgt_atlas(const char *Filename, const synfig::TargetParam &params):
+	ready(false),
+	finished(false),
+	imagecount(0),
+	lastimage(0),
+	filename(Filename),
+	params(params),
+	atlas_width(0),
+	shelf_x(0),
+	shelf_y(0),
+	spool(NULL)
+{ }
+
+png_trgt_atlas::~png_trgt_atlas()
+{
+	// The render stopped before the last frame
+	if(ready && !finished && !sprites.empty())
+		finish();
+	if(spool)
+		fclose(spool);
+}
+
+bool
+png_trgt_atlas::set_rend_desc(RendDesc *given_desc)
+{
+	desc=*given_desc;
+	imagecount=desc.get_frame_start();
+	lastimage=desc.get_frame_end();
+
+	// Shelves are as wide as the given number of columns of frames,
+	// or make a square of untrimmed frames
+	int columns(params.columns);
+	if(columns<=0)
+		columns=max(1,(int)ceil(sqrt((double)(lastimage-imagecount+1))));
+	atlas_width=columns*desc.get_w();
+
+	frame.set_wh(desc.get_w(),desc.get_h());
+	frame_bytes.resize(desc.get_w()*desc.get_h()*4);
+
+	if(spool)
+		fclose(spool);
+	spool=tmpfile();
+	if(!spool)
+	{
+		synfig::error("png_trgt_atlas: Unable to create a temporary file");
+		return false;
+	}
+
+	shelf.clear();
+	shelf_x=shelf_y=0;
+	sprites.clear();
+	sprite_hashes.clear();
+	ready=true;
+	finished=false;
+	return true;
+}
+
+bool
+png_trgt_atlas::start_frame(synfig::ProgressCallback *callback)
+{
+	if(callback)
+		callback->task(strprintf("%s, (frame %d/%d)",filename.c_str(),
+			imagecount-desc.get_frame_start()+1,lastimage-desc.get_frame_start()+1));
+	return ready;
+}
+
+Color *
+png_trgt_atlas::start_scanline(int scanline)
+{
+	return frame[scanline];
+}
+
+bool
+png_trgt_atlas::end_scanline()
+{
+	return ready;
+}
+
+void
+png_trgt_atlas::end_frame()
+{
+	const int w(desc.get_w()),h(desc.get_h());
+
+	for(int y=0;y<h;y++)
+		convert_color_format(&frame_bytes[y*w*4],frame[y],w,PF_RGB|PF_A,gamma());
+
+	// Trim the transparent borders
+	Sprite sprite;
+	sprite.frame=imagecount;
+	int left(w),top(h),right(-1),bottom(-1);
+	for(int y=0;y<h;y++)
+		for(int x=0;x<w;x++)
+			if(frame_bytes[(y*w+x)*4+3])
+			{
+				left=min(left,x);
+				right=max(right,x);
+				top=min(top,y);
+				bottom=max(bottom,y);
+			}
+	if(right<0)
+		left=top=0, right=bottom=-1;
+	sprite.offset_x=left;
+	sprite.offset_y=top;
+	sprite.w=right-left+1;
+	sprite.h=bottom-top+1;
+	sprite.x=sprite.y=0;
+
+	if(sprite.w>0)
+	{
+		// Identical frames share their pixels
+		unsigned long long hash(14695981039346656037ULL);
+		hash=hash_bytes(hash,(const unsigned char*)&sprite.w,sizeof(sprite.w));
+		hash=hash_bytes(hash,(const unsigned char*)&sprite.h,sizeof(sprite.h));
+		for(int y=top;y<=bottom;y++)
+			hash=hash_bytes(hash,&frame_bytes[(y*w+left)*4],sprite.w*4);
+
+		bool found(false);
+		typedef multimap<unsigned long long, size_t>::const_iterator iterator;
+		pair<iterator,iterator> range(sprite_hashes.equal_range(hash));
+		for(iterator i=range.first;i!=range.second;++i)
+		{
+			const Sprite &other(sprites[i->second]);
+			if(other.w==sprite.w && other.h==sprite.h)
+			{
+				sprite.x=other.x;
+				sprite.y=other.y;
+				found=true;
+				break;
+			}
+		}
+
+		if(!found)
+		{
+			place(sprite);
+			sprite_hashes.insert(make_pair(hash,sprites.size()));
+		}
+	}
+	sprites.push_back(sprite);
+
+	if(imagecount>=lastimage && ready)
+		finish();
+	imagecount++;
+}
+
+void
+png_trgt_atlas::place(Sprite &sprite)
+{
+	// Start a new shelf when the frame doesn't fit in this one
+	if(shelf_x>0 && shelf_x+sprite.w>atlas_width)
+		flush_shelf();
+
+	// A trimmed frame is never wider than a column
+	sprite.x=shelf_x;
+	sprite.y=shelf_y;
+
+	if((int)shelf.size()<sprite.h)
+		shelf.resize(sprite.h,vector<unsigned char>(atlas_width*4,0));
+
+	const int w(desc.get_w());
+	for(int y=0;y<sprite.h;y++)
+		memcpy(&shelf[y][sprite.x*4],
+			&frame_bytes[((sprite.offset_y+y)*w+sprite.offset_x)*4],
+			sprite.w*4);
+
+	shelf_x+=sprite.w;
+}
+
+bool
+png_trgt_atlas::flush_shelf()
+{
+	for(size_t y=0;y<shelf.size();y++)
+		if(fwrite(&shelf[y][0],atlas_width*4,1,spool)!=1)
+		{
+			synfig::error("png_trgt_atlas: Unable to write to the temporary file");
+			ready=false;
+			return false;
+		}
+
+	shelf_y+=shelf.size();
+	shelf_x=0;
+	shelf.clear();
+	return true;
+}
+
+bool
+png_trgt_atlas::finish()
+{
+	finished=true;
+	if(!flush_shelf())
+		return false;
+	return write_png_file() && write_index_file();
+}
+
+bool
+png_trgt_atlas::write_png_file()
+{
+	// An empty atlas still needs a pixel
+	const int height(max(1,shelf_y));
+	vector<unsigned char> buffer(atlas_width*4,0);
+
+	FILE *file(filename=="-"?stdout:fopen(filename.c_str(),POPEN_BINARY_WRITE_TYPE));
+	if(!file)
+	{
+		synfig::error(strprintf(_("Unable to open \"%s\" for write access!"),filename.c_str()));
+		return false;
+	}
+
+	png_structp png_ptr=png_create_write_struct(PNG_LIBPNG_VER_STRING,(png_voidp)this,png_out_error,png_out_warning);
+	if(!png_ptr)
+	{
+		synfig::error("Unable to setup PNG struct");
+		if(file!=stdout)
+			fclose(file);
+		return false;
+	}
+
+	png_infop info_ptr=png_create_info_struct(png_ptr);
+	if(!info_ptr)
+	{
+		synfig::error("Unable to setup PNG info struct");
+		png_destroy_write_struct(&png_ptr,(png_infopp)NULL);
+		if(file!=stdout)
+			fclose(file);
+		return false;
+	}
+
+	if(setjmp(png_jmpbuf(png_ptr)))
+	{
+		synfig::error("png_trgt_atlas: Unable to write the image");
+		png_destroy_write_struct(&png_ptr,&info_ptr);
+		if(file!=stdout)
+			fclose(file);
+		return false;
+	}
+
+	png_init_io(png_ptr,file);
+	png_set_IHDR(png_ptr,info_ptr,atlas_width,height,8,
+		PNG_COLOR_TYPE_RGBA,PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_DEFAULT,PNG_FILTER_TYPE_DEFAULT);
+	png_set_gAMA(png_ptr,info_ptr,gamma().get_gamma());
+	png_set_pHYs(png_ptr,info_ptr,round_to_int(desc.get_x_res()),round_to_int(desc.get_y_res()),PNG_RESOLUTION_METER);
+	png_write_info(png_ptr,info_ptr);
+
+	// Copy the spooled shelves, row by row
+	rewind(spool);
+	for(int y=0;y<height;y++)
+	{
+		if(y<shelf_y && fread(&buffer[0],atlas_width*4,1,spool)!=1)
+		{
+			synfig::error("png_trgt_atlas: Unable to read the temporary file");
+			ready=false;
+			break;
+		}
+		png_write_row(png_ptr,&buffer[0]);
+	}
+
+	png_write_end(png_ptr,info_ptr);
+	png_destroy_write_struct(&png_ptr,&info_ptr);
+	if(file!=stdout)
+		fclose(file);
+	return ready;
+}
+
+bool
+png_trgt_atlas::write_index_file()
+{
+	if(filename=="-")
+		return true;
+
+	const String index_name(filename_sans_extension(filename)+".json");
+	FILE *file(fopen(index_name.c_str(),"w"));
+	if(!file)
+	{
+		synfig::error(strprintf(_("Unable to open \"%s\" for write access!"),index_name.c_str()));
+		return false;
+	}
+
+	fprintf(file,"{\n\t\"frames\": [\n");
+	for(size_t i=0;i<sprites.size();i++)
+	{
+		const Sprite &s(sprites[i]);
+		fprintf(file,
+			"\t\t{ \"frame\": %d, \"x\": %d, \"y\": %d, \"w\": %d, \"h\": %d, "
+			"\"offset_x\": %d, \"offset_y\": %d, \"source_w\": %d, \"source_h\": %d }%s\n",
+			s.frame,s.x,s.y,s.w,s.h,s.offset_x,s.offset_y,desc.get_w(),desc.get_h(),
+			i+1<sprites.size()?",":"");
+	}
+	fprintf(file,"\t],\n");
+	fprintf(file,"\t\"meta\": { \"image\": \"%s\", \"w\": %d, \"h\": %d, \"fps\": %g }\n",
+		json_escape(basename(filename)).c_str(),atlas_width,max(1,shelf_y),desc.get_frame_rate());
+	fprintf(file,"}\n");
+
+	const bool ok(!ferror(file));
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,119 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file trgt_png_atlas.h
+**	\brief Texture atlas render target
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+**
+** === N O T E S ===========================================================
+**
+** ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_TRGT_PNG_ATLAS_H
+#define __SYNFIG_TRGT_PNG_ATLAS_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <png.h>
+#include <synfig/target_scanline.h>
+#include <synfig/string.h>
+#include <synfig/surface.h>
+#include <synfig/targetparam.h>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+/*!	\class png_trgt_atlas
+**	\brief Packs the frames into one PNG image and writes its index as JSON
+**
+**	Frames are trimmed to their non transparent pixels and identical
+**	frames are stored once. They are packed from left to right in shelves
+**	as wide as the given number of columns of frames. Completed shelves
+**	are spooled to a temporary file, so that only the shelf being filled
+**	is kept in memory until the image is written.
+*/
+class png_trgt_atlas : public synfig::Target_Scanline
+{
+	SYNFIG_TARGET_MODULE_EXT
+private:
+	//! Where a frame is stored in the atlas
+	struct Sprite
+	{
+		int frame;
+		//! Position in the atlas
+		int x, y;
+		//! Size of the trimmed frame
+		int w, h;
+		//! Position of the trimmed frame in the frame
+		int offset_x, offset_y;
+	};
+
+	static void png_out_error(png_struct *png,const char *msg);
+	static void png_out_warning(png_struct *png,const char *msg);
+
+	bool ready;
+	bool finished;
+	int imagecount;
+	int lastimage;
+	synfig::String filename;
+	synfig::TargetParam params;
+
+	//! The frame being rendered
+	synfig::Surface frame;
+	//! The frame converted to 8 bits RGBA
+	std::vector<unsigned char> frame_bytes;
+
+	int atlas_width;
+	//! Rows of the shelf being filled, 8 bits RGBA
+	std::vector<std::vector<unsigned char> > shelf;
+	int shelf_x, shelf_y;
+	//! Completed shelves
+	FILE *spool;
+
+	std::vector<Sprite> sprites;
+	//! Sprites by hash of their pixels
+	std::multimap<unsigned long long, size_t> sprite_hashes;
+
+	//! Places the trimmed frame in the shelf, or in a new one
+	void place(Sprite &sprite);
+	//! Spools the shelf being filled
+	bool flush_shelf();
+	//! Writes the atlas image and its index
+	bool finish();
+	bool write_png_file();
+	bool write_index_file();
+
+public:
+	png_trgt_atlas(const char *filename, const synfig::TargetParam &params);
+	virtual ~png_trgt_atlas();
+
+	virtual bool set_rend_desc(synfig::RendDesc *desc);
+	virtual bool start_frame(synfig::ProgressCallback *cb);
+	virtual void end_frame();
+
+	virtual synfig::Color * start_scanline(int scanline);
+	virtual bool end_scanline();
+};
+
+/* === E N D =============================================================== */
+
+#endif
@@ -86,6 +86,31 @@ ppm::set_rend_desc(RendDesc *given_desc)
 	return true;
 }
 
+bool
+ppm::has_frame_targets()const
+{
+	return is_file_sequence(filename,multi_image);
+}
+
+Target_Scanline::Handle
+ppm::create_frame_target(int frame)
+{
+	if(!has_frame_targets())
+		return Target_Scanline::Handle();
+
+	TargetParam params;
+	params.sequence_separator=sequence_separator;
+	ppm *target(new ppm(filename.c_str(),params));
+	init_sequence_target(*target,target->multi_image,target->imagecount,frame);
+	return Target_Scanline::Handle(target);
+}
+
+bool
+ppm::repeat_frame()
+{
+	return repeat_sequence_frame(filename,sequence_separator,multi_image,imagecount);
+}
+
 void
 ppm::end_frame()
 {
@@ -58,6 +58,9 @@ public:
 	virtual ~ppm();
 
 	virtual bool set_rend_desc(synfig::RendDesc *desc);
+	virtual synfig::Target_Scanline::Handle create_frame_target(int frame);
+	virtual bool has_frame_targets()const;
+	virtual bool repeat_frame();
 	virtual bool start_frame(synfig::ProgressCallback *cb);
 	virtual void end_frame();
 
@@ -35,6 +35,7 @@
 
 #include <synfig/module.h>
 #include "trgt_yuv.h"
+#include "trgt_raw.h"
 #endif
 
 /* === E N T R Y P O I N T ================================================= */
@@ -50,5 +51,7 @@ MODULE_DESC_END
 MODULE_INVENTORY_BEGIN(mod_yuv420p)
 	BEGIN_TARGETS
 		TARGET(yuv)
+		TARGET(raw_trgt)
+		TARGET(y4m_trgt)
 	END_TARGETS
 MODULE_INVENTORY_END
@@ -0,0 +1,367 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file trgt_raw.cpp
+**	\brief Raw video stream targets, for piping frames into encoders
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "trgt_raw.h"
+#include <synfig/general.h>
+#include <ETL/stringf>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+struct iovec { void *iov_base; size_t iov_len; };
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+using namespace synfig;
+using namespace std;
+using namespace etl;
+
+/* === M A C R O S ========================================================= */
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
+#define Y_FLOOR	(16)
+#define Y_RANGE	(235-16)
+#define UV_FLOOR	(16)
+#define UV_RANGE	(240-16)
+
+/* === G L O B A L S ======================================================= */
+
+SYNFIG_TARGET_INIT(raw_trgt);
+SYNFIG_TARGET_SET_NAME(raw_trgt,"raw");
+SYNFIG_TARGET_SET_EXT(raw_trgt,"rgba");
+SYNFIG_TARGET_SET_VERSION(raw_trgt,"0.1");
+SYNFIG_TARGET_SET_CVS_ID(raw_trgt,"$Id$");
+
+SYNFIG_TARGET_INIT(y4m_trgt);
+SYNFIG_TARGET_SET_NAME(y4m_trgt,"y4m");
+SYNFIG_TARGET_SET_EXT(y4m_trgt,"y4m");
+SYNFIG_TARGET_SET_VERSION(y4m_trgt,"0.1");
+SYNFIG_TARGET_SET_CVS_ID(y4m_trgt,"$Id$");
+
+/* === P R O C E D U R E S ================================================= */
+
+//! Writes all of \a count buffers to \a fd, returns \c false on error
+static bool
+write_all(int fd, struct iovec *iov, int count)
+{
+	while(count>0)
+	{
+#ifdef _WIN32
+		int written=_write(fd, iov->iov_base, iov->iov_len);
+#else
+		ssize_t written=writev(fd, iov, min(count, IOV_MAX));
+#endif
+		if(written<0)
+		{
+			if(errno==EINTR)
+				continue;
+			return false;
+		}
+
+		// skip what was written, the last buffer may be partially written
+		size_t left(written);
+		while(count>0 && left>=iov->iov_len)
+		{
+			left-=iov->iov_len;
+			iov++;
+			count--;
+		}
+		if(count>0)
+		{
+			iov->iov_base=(char*)iov->iov_base+left;
+			iov->iov_len-=left;
+		}
+	}
+	return true;
+}
+
+/* === M E T H O D S ======================================================= */
+
+raw_trgt::raw_trgt(const char *Filename, Format format):
+	filename(Filename),
+	format(format),
+	fd(-1),
+	close_fd(false),
+	write_failed(false),
+	scanline(0)
+{ }
+
+raw_trgt::raw_trgt(const char *Filename, const synfig::TargetParam &params):
+	filename(Filename),
+	format(FORMAT_RGBA8),
+	fd(-1),
+	close_fd(false),
+	write_failed(false),
+	scanline(0)
+{
+	if(params.video_codec=="rgba16")
+		format=FORMAT_RGBA16;
+	else
+	if(params.video_codec=="rgbaf")
+	{
+		format=FORMAT_RGBAF;
+		// Float frames keep linear colors
+		gamma().set_gamma(1.0);
+	}
+	else
+	if(params.video_codec!="none" && params.video_codec!="rgba")
+		synfig::warning("raw_trgt: Unknown pixel format \"%s\", using rgba",params.video_codec.c_str());
+}
+
+raw_trgt::~raw_trgt()
+{
+	if(close_fd)
+		close(fd);
+}
+
+bool
+raw_trgt::init(synfig::ProgressCallback */*cb*/)
+{
+	if(filename=="-")
+		fd=1;
+	else
+	if(filename.compare(0,3,"fd:")==0)
+	{
+		const char *number(filename.c_str()+3);
+		char *end;
+		errno=0;
+		long value(strtol(number,&end,10));
+		if(end==number || *end || errno || value<0 || value>INT_MAX)
+		{
+			synfig::error("raw_trgt: Invalid file descriptor in %s",filename.c_str());
+			return false;
+		}
+		fd=value;
+	}
+	else
+	{
+		fd=open(filename.c_str(),O_WRONLY|O_CREAT|O_TRUNC|O_BINARY,0666);
+		close_fd=fd>=0;
+	}
+
+	if(fd<0)
+	{
+		synfig::error("raw_trgt: Unable to open %s: %s",filename.c_str(),strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+bool
+raw_trgt::set_rend_desc(RendDesc *given_desc)
+{
+	if(format==FORMAT_Y4M)
+		given_desc->clear_flags();
+	desc=*given_desc;
+
+	color_buffer.resize(desc.get_w());
+	frame_buffer.resize(frame_size());
+	return true;
+}
+
+size_t
+raw_trgt::frame_size()const
+{
+	const size_t pixels(desc.get_w()*desc.get_h());
+	switch(format)
+	{
+	case FORMAT_RGBA16:	return pixels*4*sizeof(unsigned short);
+	case FORMAT_RGBAF:	return pixels*4*sizeof(float);
+	case FORMAT_Y4M:	return pixels*3;
+	default:			return pixels*4;
+	}
+}
+
+bool
+raw_trgt::start_frame(synfig::ProgressCallback */*callback*/)
+{
+	scanline=0;
+	return fd>=0 && !write_failed;
+}
+
+Color *
+raw_trgt::start_scanline(int y)
+{
+	scanline=y;
+	return &color_buffer[0];
+}
+
+bool
+raw_trgt::end_scanline()
+{
+	convert_row(scanline);
+	return true;
+}
+
+void
+raw_trgt::convert_row(int y)
+{
+	const int w(desc.get_w());
+	const Color *row(&color_buffer[0]);
+	const Gamma &g(gamma());
+
+	switch(format)
+	{
+	case FORMAT_RGBA8:
+	{
+		unsigned char *out(&frame_buffer[(size_t)y*w*4]);
+		for(int x=0;x<w;x++,out+=4)
+		{
+			const Color c(row[x].clamped());
+			out[0]=g.r_F32_to_U8(c.get_r());
+			out[1]=g.g_F32_to_U8(c.get_g());
+			out[2]=g.b_F32_to_U8(c.get_b());
+			out[3]=(unsigned char)(c.get_a()*255.0f+0.5f);
+		}
+		break;
+	}
+	case FORMAT_RGBA16:
+	{
+		unsigned short *out((unsigned short*)&frame_buffer[(size_t)y*w*4*sizeof(unsigned short)]);
+		const bool linear(g.get_gamma_r()==1.0f && g.get_gamma_g()==1.0f && g.get_gamma_b()==1.0f && g.get_black_level()==0.0f);
+		for(int x=0;x<w;x++,out+=4)
+		{
+			Color c(row[x].clamped());
+			if(!linear)
+			{
+				c.set_r(g.r_F32_to_F32(c.get_r()));
+				c.set_g(g.g_F32_to_F32(c.get_g()));
+				c.set_b(g.b_F32_to_F32(c.get_b()));
+			}
+			out[0]=(unsigned short)(c.get_r()*65535.0f+0.5f);
+			out[1]=(unsigned short)(c.get_g()*65535.0f+0.5f);
+			out[2]=(unsigned short)(c.get_b()*65535.0f+0.5f);
+			out[3]=(unsigned short)(c.get_a()*65535.0f+0.5f);
+		}
+		break;
+	}
+	case FORMAT_RGBAF:
+	{
+		float *out((float*)&frame_buffer[(size_t)y*w*4*sizeof(float)]);
+		for(int x=0;x<w;x++,out+=4)
+		{
+			out[0]=row[x].get_r();
+			out[1]=row[x].get_g();
+			out[2]=row[x].get_b();
+			out[3]=row[x].get_a();
+		}
+		break;
+	}
+	case FORMAT_Y4M:
+	{
+		// Y, U and V planes
+		const size_t plane((size_t)w*desc.get_h());
+		unsigned char *out_y(&frame_buffer[(size_t)y*w]);
+		unsigned char *out_u(out_y+plane);
+		unsigned char *out_v(out_u+plane);
+		for(int x=0;x<w;x++)
+		{
+			Color c(row[x].clamped());
+			c.set_r(g.r_F32_to_F32(c.get_r()));
+			c.set_g(g.g_F32_to_F32(c.get_g()));
+			c.set_b(g.b_F32_to_F32(c.get_b()));
+			out_y[x]=(unsigned char)(max(min(round_to_int(c.get_y()*Y_RANGE),Y_RANGE),0)+Y_FLOOR);
+			out_u[x]=(unsigned char)(max(min(round_to_int((c.get_u()+0.5f)*UV_RANGE),UV_RANGE),0)+UV_FLOOR);
+			out_v[x]=(unsigned char)(max(min(round_to_int((c.get_v()+0.5f)*UV_RANGE),UV_RANGE),0)+UV_FLOOR);
+		}
+		break;
+	}
+	}
+}
+
+bool
+raw_trgt::write_frame(const String &header)
+{
+	struct iovec iov[2];
+	int count(0);
+	if(!header.empty())
+	{
+		iov[count].iov_base=const_cast<char*>(header.c_str());
+		iov[count].iov_len=header.size();
+		count++;
+	}
+	iov[count].iov_base=&frame_buffer[0];
+	iov[count].iov_len=frame_buffer.size();
+	count++;
+
+	if(!write_all(fd,iov,count))
+	{
+		synfig::error("raw_trgt: Unable to write frame: %s",strerror(errno));
+		write_failed=true;
+		return false;
+	}
+	return true;
+}
+
+void
+raw_trgt::end_frame()
+{
+	write_frame(String());
+}
+
+y4m_trgt::y4m_trgt(const char *Filename, const synfig::TargetParam &/*params*/):
+	raw_trgt(Filename,FORMAT_Y4M)
+{
+	// YUV4MPEG2 doesn't have an alpha channel
+	set_alpha_mode(TARGET_ALPHA_MODE_FILL);
+}
+
+bool
+y4m_trgt::init(synfig::ProgressCallback *cb)
+{
+	if(!raw_trgt::init(cb))
+		return false;
+
+	const String header(strprintf("YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C444\n",
+		desc.get_w(), desc.get_h(), round_to_int(desc.get_frame_rate()*1000)));
+	struct iovec iov;
+	iov.iov_base=const_cast<char*>(header.c_str());
+	iov.iov_len=header.size();
+	return write_all(fd,&iov,1);
+}
+
+void
+y4m_trgt::end_frame()
+{
+	write_frame("FRAME\n");
+}
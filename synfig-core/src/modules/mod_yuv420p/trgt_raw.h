@@ -0,0 +1,113 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file trgt_raw.h
+**	\brief Raw video stream targets, for piping frames into encoders
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_TRGT_RAW_H
+#define __SYNFIG_TRGT_RAW_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <synfig/target_scanline.h>
+#include <synfig/string.h>
+#include <synfig/targetparam.h>
+#include <vector>
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+/*!	\class raw_trgt
+**	\brief Writes the frames as a headerless stream of interleaved pixels
+**
+**	The pixel format is given by the video codec parameter: \c rgba
+**	(8 bits per channel, the default), \c rgba16 (16 bits, native endianness)
+**	or \c rgbaf (linear 32 bits floats).
+**	Each frame is written at once to the file, to the standard output
+**	for "-", or to an open file descriptor given as "fd:N".
+*/
+class raw_trgt : public synfig::Target_Scanline
+{
+	SYNFIG_TARGET_MODULE_EXT
+
+public:
+	enum Format
+	{
+		FORMAT_RGBA8,
+		FORMAT_RGBA16,
+		FORMAT_RGBAF,
+		FORMAT_Y4M
+	};
+
+protected:
+	synfig::String filename;
+	Format format;
+	int fd;
+	bool close_fd;
+	//! A frame could not be written, the next start_frame() fails
+	bool write_failed;
+
+	//! One row of the rendered frame
+	std::vector<synfig::Color> color_buffer;
+	//! The converted frame, written by end_frame()
+	std::vector<unsigned char> frame_buffer;
+	int scanline;
+
+	//! Returns the size of a frame in bytes
+	size_t frame_size()const;
+	//! Converts the row in color_buffer into frame_buffer
+	void convert_row(int y);
+	//! Writes \a header then the frame, returns \c false on error
+	bool write_frame(const synfig::String &header);
+
+	raw_trgt(const char *filename, Format format);
+
+public:
+	raw_trgt(const char *filename, const synfig::TargetParam &params);
+	virtual ~raw_trgt();
+
+	virtual bool init(synfig::ProgressCallback *cb);
+	virtual bool set_rend_desc(synfig::RendDesc *desc);
+	virtual bool start_frame(synfig::ProgressCallback *cb);
+	virtual void end_frame();
+
+	virtual synfig::Color* start_scanline(int scanline);
+	virtual bool end_scanline();
+};
+
+/*!	\class y4m_trgt
+**	\brief Writes the frames as a YUV4MPEG2 stream, in 4:4:4 planes
+*/
+class y4m_trgt : public raw_trgt
+{
+	SYNFIG_TARGET_MODULE_EXT
+
+public:
+	y4m_trgt(const char *filename, const synfig::TargetParam &params);
+
+	virtual bool init(synfig::ProgressCallback *cb);
+	virtual void end_frame();
+};
+
+/* === E N D =============================================================== */
+
+#endif
@@ -0,0 +1,323 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file canvasbinary.cpp
+**	\brief Binary canvas file format
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "canvasbinary.h"
+
+#include <libxml++/libxml++.h>
+#include <libxml/tree.h>
+
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#endif
+
+/* === U S I N G =========================================================== */
+
+using namespace std;
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+#define BINARY_CANVAS_MAGIC		"SIFB"
+
+#define TAG_ELEMENT		1
+#define TAG_TEXT		2
+
+//! Deeper documents are rejected, they can't have been written by synfig
+#define MAX_DEPTH		1024
+
+/* === G L O B A L S ======================================================= */
+
+namespace {
+
+typedef vector<unsigned char> Buffer;
+
+//! Encodes the tree of a document, collecting its strings
+class Encoder
+{
+	map<string, size_t> indices;
+
+public:
+	vector<string> strings;
+	Buffer tree;
+
+	void put_number(Buffer &buffer, size_t x)
+	{
+		while(x>=0x80)
+		{
+			buffer.push_back((unsigned char)(x|0x80));
+			x>>=7;
+		}
+		buffer.push_back((unsigned char)x);
+	}
+
+	void put_string(const string &x)
+	{
+		map<string, size_t>::iterator i(indices.find(x));
+		if(i==indices.end())
+		{
+			i=indices.insert(make_pair(x,strings.size())).first;
+			strings.push_back(x);
+		}
+		put_number(tree,i->second);
+	}
+
+	static bool is_blank(const xmlChar *x)
+	{
+		for(;*x;x++)
+			if(*x!=' ' && *x!='\t' && *x!='\n' && *x!='\r')
+				return false;
+		return true;
+	}
+
+	static bool has_elements(const xmlNode *node)
+	{
+		for(const xmlNode *child=node->children;child;child=child->next)
+			if(child->type==XML_ELEMENT_NODE)
+				return true;
+		return false;
+	}
+
+	//! \param between_elements \a node is a child of an element with element children
+	static bool is_encoded(const xmlNode *node, bool between_elements)
+	{
+		if(node->type==XML_ELEMENT_NODE)
+			return true;
+		// Comments and the indentation between elements are dropped,
+		// blank values like <string> </string> are kept
+		return (node->type==XML_TEXT_NODE || node->type==XML_CDATA_SECTION_NODE)
+			&& node->content && !(between_elements && is_blank(node->content));
+	}
+
+	void put_node(const xmlNode *node)
+	{
+		if(node->type!=XML_ELEMENT_NODE)
+		{
+			tree.push_back(TAG_TEXT);
+			put_string((const char*)node->content);
+			return;
+		}
+
+		tree.push_back(TAG_ELEMENT);
+		put_string((const char*)node->name);
+
+		size_t count(0);
+		for(const xmlAttr *attr=node->properties;attr;attr=attr->next)
+			count++;
+		put_number(tree,count);
+		for(const xmlAttr *attr=node->properties;attr;attr=attr->next)
+		{
+			put_string((const char*)attr->name);
+			xmlChar *value(xmlNodeListGetString(node->doc,attr->children,1));
+			put_string(value?(const char*)value:"");
+			xmlFree(value);
+		}
+
+		const bool between_elements(has_elements(node));
+		count=0;
+		for(const xmlNode *child=node->children;child;child=child->next)
+			if(is_encoded(child,between_elements))
+				count++;
+		put_number(tree,count);
+		for(const xmlNode *child=node->children;child;child=child->next)
+			if(is_encoded(child,between_elements))
+				put_node(child);
+	}
+};
+
+//! Decodes a binary canvas from memory
+class Decoder
+{
+	const unsigned char *pos, *end;
+	xmlDoc *doc;
+	vector<string> strings;
+
+	static void fail(const char *what)
+	{
+		throw runtime_error(string("Invalid binary canvas: ")+what);
+	}
+
+public:
+	Decoder(const Buffer &data, xmlDoc *doc):
+		pos(data.empty()?NULL:&data[0]),
+		end(data.empty()?NULL:&data[0]+data.size()),
+		doc(doc)
+	{ }
+
+	size_t get_number()
+	{
+		size_t x(0);
+		for(int shift=0;shift<(int)sizeof(size_t)*8;shift+=7)
+		{
+			if(pos==end)
+				fail("unexpected end of data");
+			const unsigned char byte(*pos++);
+			x|=(size_t)(byte&0x7f)<<shift;
+			if(!(byte&0x80))
+				return x;
+		}
+		fail("number out of range");
+		return 0;
+	}
+
+	const string &get_string()
+	{
+		const size_t i(get_number());
+		if(i>=strings.size())
+			fail("string index out of range");
+		return strings[i];
+	}
+
+	void get_header()
+	{
+		if(end-pos<4 || memcmp(pos,BINARY_CANVAS_MAGIC,4))
+			fail("bad magic");
+		pos+=4;
+		if(get_number()!=BINARY_CANVAS_VERSION)
+			fail("unsupported version");
+
+		const size_t count(get_number());
+		if(count>(size_t)(end-pos))
+			fail("string table out of range");
+		strings.reserve(count);
+		for(size_t i=0;i<count;i++)
+		{
+			const size_t size(get_number());
+			if(size>(size_t)(end-pos))
+				fail("string out of range");
+			strings.push_back(string((const char*)pos,size));
+			pos+=size;
+		}
+	}
+
+	xmlNode *get_node(int depth)
+	{
+		if(depth>MAX_DEPTH)
+			fail("too deep");
+		if(pos==end)
+			fail("unexpected end of data");
+
+		const unsigned char tag(*pos++);
+		if(tag==TAG_TEXT)
+		{
+			const string &text(get_string());
+			return xmlNewDocTextLen(doc,(const xmlChar*)text.c_str(),text.size());
+		}
+		if(tag!=TAG_ELEMENT)
+			fail("unknown node");
+
+		xmlNode *node(xmlNewDocNode(doc,NULL,(const xmlChar*)get_string().c_str(),NULL));
+		try
+		{
+			for(size_t count=get_number();count>0;count--)
+			{
+				const string &name(get_string());
+				xmlNewProp(node,(const xmlChar*)name.c_str(),(const xmlChar*)get_string().c_str());
+			}
+			for(size_t count=get_number();count>0;count--)
+				xmlAddChild(node,get_node(depth+1));
+		}
+		catch(...)
+		{
+			xmlFreeNode(node);
+			throw;
+		}
+		return node;
+	}
+
+	void get_document()
+	{
+		get_header();
+		xmlNode *root(get_node(0));
+		if(root->type!=XML_ELEMENT_NODE)
+		{
+			xmlFreeNode(root);
+			fail("no root element");
+		}
+		xmlDocSetRootElement(doc,root);
+	}
+};
+
+}; // END of anonymous namespace
+
+/* === P R O C E D U R E S ================================================= */
+
+bool
+synfig::write_binary_canvas(std::ostream &stream, const xmlpp::Document &document)
+{
+	const xmlNode *root(xmlDocGetRootElement(const_cast<xmlDoc*>(document.cobj())));
+	if(!root)
+		return false;
+
+	Encoder encoder;
+	encoder.put_node(root);
+
+	Buffer header(BINARY_CANVAS_MAGIC,BINARY_CANVAS_MAGIC+4);
+	encoder.put_number(header,BINARY_CANVAS_VERSION);
+	encoder.put_number(header,encoder.strings.size());
+	stream.write((const char*)&header[0],header.size());
+
+	for(vector<string>::const_iterator i=encoder.strings.begin();i!=encoder.strings.end();++i)
+	{
+		Buffer size;
+		encoder.put_number(size,i->size());
+		stream.write((const char*)&size[0],size.size());
+		stream.write(i->data(),i->size());
+	}
+
+	stream.write((const char*)&encoder.tree[0],encoder.tree.size());
+	stream.flush();
+	return !stream.fail();
+}
+
+void
+synfig::read_binary_canvas(std::istream &stream, xmlpp::Document &document)
+{
+	read_binary_canvas(stream,document.cobj());
+}
+
+void
+synfig::read_binary_canvas(std::istream &stream, xmlDoc *doc)
+{
+	// Read everything at once, decoding from memory is the fast part
+	Buffer data;
+	char chunk[64*1024];
+	while(stream)
+	{
+		stream.read(chunk,sizeof(chunk));
+		data.insert(data.end(),chunk,chunk+stream.gcount());
+	}
+	if(stream.bad())
+		throw runtime_error("Unable to read binary canvas");
+
+	Decoder(data,doc).get_document();
+}
@@ -0,0 +1,75 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file canvasbinary.h
+**	\brief Binary canvas file format
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_CANVASBINARY_H
+#define __SYNFIG_CANVASBINARY_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <istream>
+#include <ostream>
+
+/* === M A C R O S ========================================================= */
+
+//! Version of the binary canvas format written by write_binary_canvas()
+#define BINARY_CANVAS_VERSION	1
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace xmlpp { class Document; };
+struct _xmlDoc;
+
+namespace synfig {
+
+/*!	\file canvasbinary.h
+**	The binary canvas files (.sifb) hold the same document as the .sif
+**	files, without the XML syntax: after the "SIFB" magic and the version,
+**	a table of all the distinct names, values and texts of the document,
+**	then its elements in document order, as packed indices into the table.
+**	Numbers are LEB128 encoded.
+**
+**	The ids, GUIDs and the values repeated across waypoints and vertices
+**	are stored once, and the whole file is decoded from memory in a
+**	single pass, without tokenizing any markup. The values themselves stay
+**	text, parsed by the loader as for .sif files. Comments and the blanks
+**	between elements are not kept.
+*/
+
+//! Writes \a document in the binary canvas format
+/*!	\return \c false if it could not be written */
+bool write_binary_canvas(std::ostream &stream, const xmlpp::Document &document);
+
+//! Reads a document written by write_binary_canvas() into \a document
+/*!	Throws a std::runtime_error if the data is not a valid binary canvas */
+void read_binary_canvas(std::istream &stream, xmlpp::Document &document);
+
+//! Reads a document written by write_binary_canvas() into the empty libxml document \a doc
+/*!	Throws a std::runtime_error if the data is not a valid binary canvas */
+void read_binary_canvas(std::istream &stream, _xmlDoc *doc);
+
+}; // END of namespace synfig
+
+/* === E N D =============================================================== */
+
+#endif
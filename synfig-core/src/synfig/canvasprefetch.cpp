@@ -0,0 +1,419 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file canvasprefetch.cpp
+**	\brief Background reading of the external canvas files
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "canvasprefetch.h"
+#include "canvasbinary.h"
+#include "filesystem.h"
+#include "loadstats.h"
+
+#include <libxml++/libxml++.h>
+#include <libxml/tree.h>
+#include <libxml/xmlreader.h>
+
+#include <ETL/clock>
+#include <ETL/stringf>
+#include <glibmm.h>
+#include <zlib.h>
+
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#endif
+
+/* === U S I N G =========================================================== */
+
+using namespace std;
+using namespace etl;
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+//! Default number of threads reading the files
+#define DEFAULT_PREFETCH_THREADS	4
+
+/* === G L O B A L S ======================================================= */
+
+namespace {
+
+struct Entry
+{
+	enum State { QUEUED, LOADING, READY, TAKEN };
+
+	State state;
+	//! Only the references of the file are collected
+	bool scan_only;
+	//! The file, or NULL if it could not be read
+	xmlDoc *doc;
+	time_t mtime;
+	//! Left by a load, dropped if the next one doesn't take it either
+	bool left;
+
+	Entry(): state(QUEUED), scan_only(false), doc(NULL), mtime(0), left(false) { }
+};
+
+//! Files by absolute path
+typedef map<String, Entry> EntryMap;
+
+Glib::Mutex mutex;
+Glib::Cond cond;
+EntryMap entries;
+deque<String> queue;
+int thread_count(-1);
+int threads_started(0);
+
+}; // END of anonymous namespace
+
+/* === P R O C E D U R E S ================================================= */
+
+static String
+native_path(const String &filename)
+{
+#ifdef WIN32
+	return Glib::locale_from_utf8(FileSystem::fix_slashes(filename));
+#else
+	return FileSystem::fix_slashes(filename);
+#endif
+}
+
+static time_t
+get_mtime(const String &filename)
+{
+	struct stat buf;
+	if(stat(native_path(filename).c_str(),&buf)!=0)
+		return 0;
+	return buf.st_mtime;
+}
+
+static bool
+is_prefetched_file(const String &filename)
+{
+	const String ext(filename_extension(filename));
+	return ext==".sif" || ext==".sifz" || ext==".sifb";
+}
+
+//! Adds the file referenced by \a use, as seen from \a filename, to \a files
+static void
+add_reference(const String &filename, const String &use, vector<String> &files)
+{
+	const String::size_type pos(use.find('#'));
+	if(pos==String::npos || pos==0)
+		return;
+
+	String file_name(unix_to_local_path(String(use,0,pos)));
+	if(!is_absolute_path(file_name))
+		file_name=dirname(FileSystem::fix_slashes(filename))+ETL_DIRECTORY_SEPARATOR+file_name;
+	if(is_prefetched_file(file_name))
+		files.push_back(absolute_path(file_name));
+}
+
+static void
+collect_references(const String &filename, const xmlNode *node, vector<String> &files)
+{
+	for(;node;node=node->next)
+	{
+		if(node->type!=XML_ELEMENT_NODE)
+			continue;
+		xmlChar *use(xmlGetProp(const_cast<xmlNode*>(node),(const xmlChar*)"use"));
+		if(use)
+		{
+			add_reference(filename,(const char*)use,files);
+			xmlFree(use);
+		}
+		collect_references(filename,node->children,files);
+	}
+}
+
+//! Feeds the XML reader from a (possibly compressed) file
+static int
+read_file(void *context, char *buffer, int len)
+{
+	return gzread((gzFile)context,buffer,len);
+}
+
+static int
+close_file(void */*context*/)
+{
+	return 0;
+}
+
+//! Collects the references of \a filename without building its tree
+static void
+scan_file(const String &filename, vector<String> &files)
+{
+	// Binary canvases are decoded at once, they are quick to read
+	if(is_binary_file(filename))
+	{
+		if(xmlDoc *doc=read_document(filename))
+		{
+			collect_references(filename,xmlDocGetRootElement(doc),files);
+			xmlFreeDoc(doc);
+		}
+		return;
+	}
+
+	gzFile file(gzopen(native_path(filename).c_str(),"rb"));
+	if(!file)
+		return;
+
+	xmlTextReaderPtr reader(xmlReaderForIO(read_file,close_file,file,filename.c_str(),NULL,0));
+	if(reader)
+	{
+		while(xmlTextReaderRead(reader)==1)
+		{
+			if(xmlTextReaderNodeType(reader)!=XML_READER_TYPE_ELEMENT)
+				continue;
+			xmlChar *use(xmlTextReaderGetAttribute(reader,(const xmlChar*)"use"));
+			if(use)
+			{
+				add_reference(filename,(const char*)use,files);
+				xmlFree(use);
+			}
+		}
+		xmlFreeTextReader(reader);
+	}
+	gzclose(file);
+}
+
+static bool
+is_binary_file(const String &filename)
+{
+	return filename_extension(filename)==".sifb";
+}
+
+//! Reads \a filename without a dictionary, so that its nodes can be moved to another document
+static xmlDoc *
+read_document(const String &filename)
+{
+	if(is_binary_file(filename))
+	{
+		std::ifstream stream(native_path(filename).c_str(),std::ios::binary);
+		if(!stream)
+			return NULL;
+		xmlDoc *doc(xmlNewDoc((const xmlChar*)"1.0"));
+		try
+		{
+			read_binary_canvas(stream,doc);
+		}
+		catch(const std::exception &)
+		{
+			xmlFreeDoc(doc);
+			return NULL;
+		}
+		return doc;
+	}
+
+	gzFile file(gzopen(native_path(filename).c_str(),"rb"));
+	if(!file)
+		return NULL;
+
+	vector<char> data;
+	char chunk[64*1024];
+	int size;
+	while((size=gzread(file,chunk,sizeof(chunk)))>0)
+		data.insert(data.end(),chunk,chunk+size);
+	gzclose(file);
+
+	if(size<0 || data.empty())
+		return NULL;
+	return xmlReadMemory(&data[0],data.size(),filename.c_str(),NULL,XML_PARSE_NODICT);
+}
+
+//! Queues the files which are not known yet, \a mutex must be locked
+static void
+queue_files(const vector<String> &files)
+{
+	for(vector<String>::const_iterator i=files.begin();i!=files.end();++i)
+		if(!entries.count(*i))
+		{
+			entries[*i]=Entry();
+			queue.push_back(*i);
+		}
+	cond.broadcast();
+}
+
+static void
+prefetch_thread()
+{
+	while(true)
+	{
+		String filename;
+		bool scan_only;
+		{
+			Glib::Mutex::Lock lock(mutex);
+			while(queue.empty())
+				cond.wait(mutex);
+			filename=queue.front();
+			queue.pop_front();
+
+			EntryMap::iterator i(entries.find(filename));
+			if(i==entries.end() || i->second.state!=Entry::QUEUED)
+				continue;
+			i->second.state=Entry::LOADING;
+			scan_only=i->second.scan_only;
+		}
+
+		etl::clock_realtime clock;
+		const time_t mtime(get_mtime(filename));
+		xmlDoc *doc(NULL);
+		vector<String> files;
+		if(scan_only)
+			scan_file(filename,files);
+		else
+		if((doc=read_document(filename)))
+			collect_references(filename,xmlDocGetRootElement(doc),files);
+		LoadStats::charge_background(clock());
+
+		Glib::Mutex::Lock lock(mutex);
+		EntryMap::iterator i(entries.find(filename));
+		if(i==entries.end() || i->second.state!=Entry::LOADING)
+		{
+			// Dropped by end_load() meanwhile
+			if(doc)
+				xmlFreeDoc(doc);
+			continue;
+		}
+		i->second.state=Entry::READY;
+		i->second.doc=doc;
+		i->second.mtime=mtime;
+		queue_files(files);
+	}
+}
+
+//! Starts the threads on first use, \a mutex must be locked
+static bool
+start_threads()
+{
+	if(thread_count<0)
+	{
+		thread_count=DEFAULT_PREFETCH_THREADS;
+		if(getenv("SYNFIG_PREFETCH_THREADS"))
+			thread_count=atoi(getenv("SYNFIG_PREFETCH_THREADS"));
+	}
+
+	for(;threads_started<thread_count;threads_started++)
+		Glib::Thread::create(sigc::ptr_fun(&prefetch_thread),false);
+	return thread_count>0;
+}
+
+/* === M E T H O D S ======================================================= */
+
+void
+CanvasPrefetch::scan(const String &filename)
+{
+	if(!is_prefetched_file(filename))
+		return;
+
+	Glib::Mutex::Lock lock(mutex);
+	if(!start_threads())
+		return;
+
+	const String path(absolute_path(filename));
+	if(entries.count(path))
+		return;
+	entries[path].scan_only=true;
+	queue.push_front(path);
+	cond.broadcast();
+}
+
+bool
+CanvasPrefetch::take(const String &filename, xmlpp::Document &document)
+{
+	xmlDoc *doc;
+	time_t mtime;
+	{
+		Glib::Mutex::Lock lock(mutex);
+		EntryMap::iterator i(entries.find(absolute_path(filename)));
+		if(i==entries.end() || i->second.scan_only || i->second.state==Entry::TAKEN)
+			return false;
+
+		// Not started yet, the caller reads it sooner than a thread would
+		if(i->second.state==Entry::QUEUED)
+		{
+			i->second.state=Entry::TAKEN;
+			return false;
+		}
+
+		while(i->second.state==Entry::LOADING)
+			cond.wait(mutex);
+		if(i->second.state!=Entry::READY)
+			return false;
+
+		doc=i->second.doc;
+		mtime=i->second.mtime;
+		i->second.doc=NULL;
+		i->second.state=Entry::TAKEN;
+	}
+
+	if(!doc)
+		return false;
+	if(mtime!=get_mtime(filename))
+	{
+		xmlFreeDoc(doc);
+		return false;
+	}
+
+	// The document has no dictionary, its tree can change of document
+	xmlNode *root(xmlDocGetRootElement(doc));
+	xmlUnlinkNode(root);
+	xmlDocSetRootElement(document.cobj(),root);
+	xmlFreeDoc(doc);
+	return true;
+}
+
+void
+CanvasPrefetch::end_load()
+{
+	Glib::Mutex::Lock lock(mutex);
+	for(EntryMap::iterator i=entries.begin();i!=entries.end();)
+	{
+		Entry &entry(i->second);
+		if(entry.state==Entry::QUEUED || entry.state==Entry::LOADING)
+		{
+			// Still needed by a thread, they're kept for the next load
+			entry.left=true;
+			++i;
+			continue;
+		}
+		if(entry.state==Entry::READY && !entry.scan_only && entry.doc && !entry.left)
+		{
+			entry.left=true;
+			++i;
+			continue;
+		}
+		if(entry.doc)
+			xmlFreeDoc(entry.doc);
+		entries.erase(i++);
+	}
+}
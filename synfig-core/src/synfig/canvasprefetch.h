@@ -0,0 +1,79 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file canvasprefetch.h
+**	\brief Background reading of the external canvas files
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_CANVASPREFETCH_H
+#define __SYNFIG_CANVASPREFETCH_H
+
+/* === H E A D E R S ======================================================= */
+
+#include "string.h"
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace xmlpp { class Document; };
+
+namespace synfig {
+
+/*!	\class CanvasPrefetch
+**	\brief Reads the files of the external canvases while the loader is busy
+**
+**	When a file is loaded, its "file#canvas" references are collected by
+**	a background thread, and each referenced file is read, uncompressed
+**	and parsed into an XML document by a pool of threads, as are the files
+**	they reference in turn. The loader takes the documents when it reaches
+**	the references, so that only the building of the canvases is serial.
+**
+**	The documents are kept by absolute path for the whole process: the ones
+**	a load did not take are still there for the next load, and dropped if
+**	it doesn't take them either. A document is dropped if its file was
+**	modified since it was read. Loaded canvases are shared through the
+**	open canvas map instead.
+**
+**	Only the .sif, .sifz and .sifb files of the native file system are
+**	prefetched. SYNFIG_PREFETCH_THREADS sets the number of threads,
+**	0 disables it.
+*/
+class CanvasPrefetch
+{
+public:
+	//! Starts collecting the external canvases referenced by \a filename
+	static void scan(const String &filename);
+
+	//! Moves the tree of the document of \a filename into \a document, without copying it
+	/*!	Waits for it if it is being read.
+	**	\return \c false if the file was not prefetched */
+	static bool take(const String &filename, xmlpp::Document &document);
+
+	//! Called when a top-level load is complete: the files it took can be
+	//! prefetched again, the documents it left are kept for the next load only
+	static void end_load();
+};
+
+}; // END of namespace synfig
+
+/* === E N D =============================================================== */
+
+#endif
@@ -0,0 +1,151 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file halfcolor.h
+**	\brief HalfColor Class, 16 bits floating point storage for Color
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_COLOR_HALFCOLOR_H
+#define __SYNFIG_COLOR_HALFCOLOR_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <cstring>
+#include <synfig/color/color.h>
+
+// The F16C instructions convert four channels at once.
+// They are used when the compiler targets them (-mf16c or -march=native)
+#if defined(__F16C__) && !defined(USE_HALF_TYPE)
+#include <immintrin.h>
+#define SYNFIG_HALFCOLOR_F16C
+#endif
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace synfig {
+
+/*!	\class HalfColor
+**	\brief ARGB 64 bits color, for storage only
+**
+**	Channels are IEEE 754 half precision floats, in the same order as
+**	in Color. There is no arithmetic: colors are converted from and to
+**	Color when stored and loaded.
+*/
+class HalfColor
+{
+public:
+	typedef uint16_t value_type;
+
+private:
+	value_type a_, r_, g_, b_;
+
+public:
+	HalfColor(): a_(0), r_(0), g_(0), b_(0) { }
+
+	HalfColor(const Color &c):
+		a_(from_float(c.get_a())),
+		r_(from_float(c.get_r())),
+		g_(from_float(c.get_g())),
+		b_(from_float(c.get_b())) { }
+
+	operator Color()const
+		{ return Color(to_float(r_), to_float(g_), to_float(b_), to_float(a_)); }
+
+	//! Converts a float to half, rounding to nearest
+	static value_type from_float(float f)
+	{
+		uint32_t x;
+		memcpy(&x, &f, sizeof(x));
+		const uint32_t sign((x>>16)&0x8000);
+		x&=0x7fffffff;
+
+		// NaN and infinity
+		if(x>=0x7f800000)
+			return sign|0x7c00|(x>0x7f800000?0x200:0);
+		// Too big, infinity
+		if(x>=0x477ff000)
+			return sign|0x7c00;
+		// Denormals
+		if(x<0x38800000)
+		{
+			if(x<0x33000000)
+				return sign;
+			const uint32_t shift(113-(x>>23));
+			const uint32_t mantissa((x&0x7fffff)|0x800000);
+			return sign|((mantissa+(1<<(shift+12))+((mantissa>>(shift+13))&1)-1)>>(shift+13));
+		}
+		return sign|((x-0x38000000+0xfff+((x>>13)&1))>>13);
+	}
+
+	//! Converts a half to float
+	static float to_float(value_type h)
+	{
+		const uint32_t sign(uint32_t(h&0x8000)<<16);
+		uint32_t exponent((h>>10)&0x1f);
+		uint32_t mantissa(h&0x3ff);
+		uint32_t x;
+
+		if(exponent==0x1f)
+			x=sign|0x7f800000|(mantissa<<13);
+		else if(exponent)
+			x=sign|((exponent+112)<<23)|(mantissa<<13);
+		else if(mantissa)
+		{
+			// Normalize the denormal
+			exponent=113;
+			while(!(mantissa&0x400))
+				mantissa<<=1, exponent--;
+			x=sign|(exponent<<23)|((mantissa&0x3ff)<<13);
+		}
+		else
+			x=sign;
+
+		float f;
+		memcpy(&f, &x, sizeof(f));
+		return f;
+	}
+
+	//! Converts \a n colors to half floats
+	static void pack(HalfColor *dest, const Color *src, int n)
+	{
+#ifdef SYNFIG_HALFCOLOR_F16C
+		for(;n>=2;n-=2,src+=2,dest+=2)
+		{
+			const __m128i x(_mm256_cvtps_ph(_mm256_loadu_ps((const float*)src), _MM_FROUND_TO_NEAREST_INT));
+			_mm_storeu_si128((__m128i*)dest, x);
+		}
+#endif
+		for(;n>0;n--)
+			*dest++=*src++;
+	}
+
+	//! Converts \a n half float colors back to Color
+	static void unpack(Color *dest, const HalfColor *src, int n)
+	{
+#ifdef SYNFIG_HALFCOLOR_F16C
+		for(;n>=2;n-=2,src+=2,dest+=2)
+			_mm256_storeu_ps((float*)dest, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)src)));
+#endif
+		for(;n>0;n--)
+			*dest++=*src++;
+	}
+}; // END of class HalfColor
+
+}; // END of namespace synfig
+
+#endif
@@ -133,6 +133,18 @@ IndependentContext::set_time(Time time)const
 	}
 }
 
+bool
+IndependentContext::is_static_between(Time a, Time b)const
+{
+	if(a.is_equal(b))
+		return true;
+
+	for(IndependentContext context(*this);!(context)->empty();++context)
+		if((*context)->active() && !(*context)->is_static_between(a,b))
+			return false;
+	return true;
+}
+
 void
 IndependentContext::set_time(Time time,const Vector &/*pos*/)const
 {
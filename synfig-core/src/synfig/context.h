@@ -76,6 +76,9 @@ public:
 	//!	Sets the context to the Time \time. It is done recursively. Vector \pos is not used
 	void set_time(Time time,const Vector &pos)const;
 
+	//! Returns true if the active layers render the same at the times \a a and \a b
+	bool is_static_between(Time a, Time b)const;
+
 	//! Sets dirty (dirty_time_= Time::end()) to all Outline type layers
 	void set_dirty_outlines();
 };
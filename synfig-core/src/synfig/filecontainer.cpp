@@ -50,7 +50,14 @@ using namespace synfig;
 // ReadStream
 
 FileContainer::ReadStream::ReadStream(Handle file_system):
-	FileSystem::ReadStream(file_system) { }
+	FileSystem::ReadStream(file_system)
+{
+	etl::handle< FileContainer > container ( etl::handle< FileContainer >::cast_static(file_system_) );
+	const char *data;
+	size_t size;
+	if (container->file_map(data, size))
+		set_data(data, size, false);
+}
 
 FileContainer::ReadStream::~ReadStream()
 {
@@ -95,6 +102,8 @@ FileContainer::~FileContainer() { }
 
 bool FileContainer::file_open_read_whole_container() { return false; }
 
+bool FileContainer::file_map(const char *& /* data */, size_t & /* size */) { return false; }
+
 void FileContainer::file_close() { stream_valid_ = false; }
 
 FileSystem::ReadStreamHandle FileContainer::get_read_stream_whole_container()
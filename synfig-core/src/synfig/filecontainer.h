@@ -88,6 +88,10 @@ namespace synfig
 		virtual size_t file_read(void *buffer, size_t size) = 0;
 		virtual size_t file_write(const void *buffer, size_t size) = 0;
 
+		//! Gives the contents of the file opened for read, when they are in memory
+		/*!	They must stay valid until the file is closed */
+		virtual bool file_map(const char *&data, size_t &size);
+
 		inline bool file_is_opened()
 		{
 			return file_is_opened_for_read() || file_is_opened_for_write();
@@ -30,10 +30,25 @@
 #endif
 
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
 #include <stdint.h>
 #include <cstddef>
+#include <algorithm>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include <ETL/stringf>
 #include <libxml++/libxml++.h>
+#include <zlib.h>
 #include "filecontainerzip.h"
 
 #endif
@@ -46,10 +61,30 @@ using namespace synfig;
 
 /* === M A C R O S ========================================================= */
 
+//! By default, the storage is compacted once it holds four times more
+//! replaced and removed data than current data
+#define DEFAULT_COMPACT_RATIO	4
+
 /* === G L O B A L S ======================================================= */
 
 /* === P R O C E D U R E S ================================================= */
 
+static bool truncate_file(FILE *f, long int size)
+{
+	fflush(f);
+#ifdef _WIN32
+	return _chsize(_fileno(f), size) == 0;
+#else
+	return ftruncate(fileno(f), size) == 0;
+#endif
+}
+
+static int get_compact_ratio()
+{
+	const char *ratio = getenv("SYNFIG_ZIP_COMPACT_RATIO");
+	return ratio ? atoi(ratio) : DEFAULT_COMPACT_RATIO;
+}
+
 /* === M E T H O D S ======================================================= */
 
 namespace synfig
@@ -210,6 +245,38 @@ namespace synfig
 
 using namespace synfig::FileContainerZip_InternalStructs;
 
+//! Reads the local header at \a header_offset and gets where the file data begins
+static bool get_data_offset(FILE *f, FileContainerZip::file_size_t header_offset, FileContainerZip::file_size_t &data_offset)
+{
+	LocalFileHeader lfh;
+	if (fseek(f, (long int)header_offset, SEEK_SET) != 0
+	 || sizeof(lfh) != fread(&lfh, 1, sizeof(lfh), f)
+	 || lfh.signature != LocalFileHeader::valid_signature__)
+		return false;
+	data_offset = header_offset + sizeof(lfh) + lfh.filename_length + lfh.extrafield_length;
+	return true;
+}
+
+//! Compares \a size bytes of \a f at \a offset_a and \a offset_b
+static bool same_data(FILE *f, FileContainerZip::file_size_t offset_a, FileContainerZip::file_size_t offset_b, FileContainerZip::file_size_t size)
+{
+	std::vector<char> buffer_a(1 << 16), buffer_b(1 << 16);
+	while(size > 0)
+	{
+		size_t s = (size_t)std::min(size, (FileContainerZip::file_size_t)buffer_a.size());
+		if (fseek(f, (long int)offset_a, SEEK_SET) != 0
+		 || s != fread(&buffer_a[0], 1, s, f)
+		 || fseek(f, (long int)offset_b, SEEK_SET) != 0
+		 || s != fread(&buffer_b[0], 1, s, f)
+		 || memcmp(&buffer_a[0], &buffer_b[0], s) != 0)
+			return false;
+		offset_a += s;
+		offset_b += s;
+		size -= s;
+	}
+	return true;
+}
+
 void FileContainerZip::FileInfo::split_name()
 {
 	size_t pos = name.rfind('/');
@@ -227,59 +294,34 @@ void FileContainerZip::FileInfo::split_name()
 
 FileContainerZip::FileContainerZip():
 storage_file_(NULL),
+map_(NULL),
+map_size_(0),
 prev_storage_size_(0),
 file_reading_whole_container_(false),
 file_reading_(false),
 file_writing_(false),
 file_processed_size_(0),
-changed_(false)
+changed_(false),
+file_replacing_(false),
+file_replaced_changed_(false)
 { }
 
 FileContainerZip::~FileContainerZip() { close(); }
 
 unsigned int FileContainerZip::crc32(unsigned int previous_crc, const void *buffer, size_t size)
 {
-	static const unsigned int table[] = {
-	    0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
-	    0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
-	    0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
-	    0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5,
-	    0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172, 0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B,
-	    0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
-	    0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
-	    0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924, 0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D,
-	    0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
-	    0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01,
-	    0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E, 0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457,
-	    0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
-	    0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB,
-	    0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0, 0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
-	    0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
-	    0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81, 0xB7BD5C3B, 0xC0BA6CAD,
-	    0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A, 0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683,
-	    0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
-	    0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7,
-	    0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC, 0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5,
-	    0xD6D6A3E8, 0xA1D1937E, 0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
-	    0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79,
-	    0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236, 0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F,
-	    0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
-	    0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713,
-	    0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38, 0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21,
-	    0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
-	    0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
-	    0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2, 0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB,
-	    0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
-	    0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
-	    0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
-	};
-
-	unsigned int crc = previous_crc ^ 0xFFFFFFFFUL;
-	unsigned char *char_buf = (unsigned char *)buffer;
-	size_t remain = size;
-	while (remain--)
-		crc = table[(crc ^ *char_buf++) & 0xFF] ^ (crc >> 8);
-	return crc ^ 0xFFFFFFFFUL;
+	// zlib computes several bytes per step, and zlib-ng uses the CPU
+	// instructions when available
+	const Bytef *char_buf = (const Bytef *)buffer;
+	uLong crc = previous_crc;
+	while (size > 0)
+	{
+		uInt chunk = size > 0x40000000 ? 0x40000000 : (uInt)size;
+		crc = ::crc32(crc, char_buf, chunk);
+		char_buf += chunk;
+		size -= chunk;
+	}
+	return (unsigned int)crc;
 }
 
 std::string FileContainerZip::encode_history(const FileContainerZip::HistoryRecord &history_record)
@@ -390,6 +432,7 @@ bool FileContainerZip::create(const std::string &container_filename)
 	if (is_opened()) return false;
 	storage_file_ = fopen(fix_slashes(container_filename).c_str(), "w+b");
 	if (is_opened()) changed_ = true;
+	if (is_opened()) storage_filename_ = fix_slashes(container_filename);
 	return is_opened();
 }
 
@@ -492,6 +535,7 @@ bool FileContainerZip::open_from_history(const std::string &container_filename,
 	// loaded
 	fseek(f, 0, SEEK_END);
 	storage_file_ = f;
+	storage_filename_ = fix_slashes(container_filename);
 	files_.swap( files );
 	prev_storage_size_ = actual_filesize;
 	file_reading_ = false;
@@ -505,15 +549,10 @@ bool FileContainerZip::open(const std::string &container_filename)
 	return open_from_history(container_filename);
 }
 
-bool FileContainerZip::save()
+bool FileContainerZip::write_directory(FILE *f, FileMap &files, file_size_t prev_storage_size)
 {
-	if (file_is_opened()) return false;
-	if (!changed_) return true;
-
-	fseek(storage_file_, 0, SEEK_END);
-
 	// write headers of new directories
-	for(FileMap::iterator i = files_.begin(); i != files_.end(); i++)
+	for(FileMap::iterator i = files.begin(); i != files.end(); i++)
 	{
 		FileInfo &info = i->second;
 		if (info.is_directory && !info.directory_saved)
@@ -525,12 +564,12 @@ bool FileContainerZip::save()
 			lfh.modification_time = dos_timestamp.dos_time;
 			lfh.modification_date = dos_timestamp.dos_date;
 
-			info.header_offset = ftell(storage_file_);
-			if (sizeof(lfh) != fwrite(&lfh, 1, sizeof(lfh), storage_file_))
+			info.header_offset = ftell(f);
+			if (sizeof(lfh) != fwrite(&lfh, 1, sizeof(lfh), f))
 				return false;
-			if (info.name.size() != fwrite(info.name.c_str(), 1, info.name.size(), storage_file_))
+			if (info.name.size() != fwrite(info.name.c_str(), 1, info.name.size(), f))
 				return false;
-			if ((int)'/' != fputc('/', storage_file_))
+			if ((int)'/' != fputc('/', f))
 				return false;
 
 			info.directory_saved = true;
@@ -538,8 +577,8 @@ bool FileContainerZip::save()
 	}
 
 	// write central directory
-	uint32_t central_directory_offset = (uint32_t)ftell(storage_file_);
-	for(FileMap::iterator i = files_.begin(); i != files_.end(); i++)
+	uint32_t central_directory_offset = (uint32_t)ftell(f);
+	for(FileMap::iterator i = files.begin(); i != files.end(); i++)
 	{
 		FileInfo &info = i->second;
 		CentralDirectoryFileHeader cdfh;
@@ -555,42 +594,146 @@ bool FileContainerZip::save()
 		cdfh.modification_date = dos_timestamp.dos_date;
 
 		// write header
-		if (sizeof(cdfh) != fwrite(&cdfh, 1, sizeof(cdfh), storage_file_))
+		if (sizeof(cdfh) != fwrite(&cdfh, 1, sizeof(cdfh), f))
 			return false;
 
 		// write name
-		if (info.name.size() != fwrite(info.name.c_str(), 1, info.name.size(), storage_file_))
+		if (info.name.size() != fwrite(info.name.c_str(), 1, info.name.size(), f))
 			return false;
 		if (info.is_directory)
-			if ((int)'/' != fputc('/', storage_file_))
+			if ((int)'/' != fputc('/', f))
 				return false;
 	}
 
 	// end of central directory
 	EndOfCentralDirectory ecd;
 	ecd.offset = central_directory_offset;
-	ecd.current_records = ecd.total_records = files_.size();
-	ecd.size = ftell(storage_file_) - central_directory_offset;
-	std::string comment = encode_history(HistoryRecord(prev_storage_size_));
+	ecd.current_records = ecd.total_records = files.size();
+	ecd.size = ftell(f) - central_directory_offset;
+	std::string comment = encode_history(HistoryRecord(prev_storage_size));
 	ecd.comment_length = comment.size();
 
 	// write header
-	if (sizeof(ecd) != fwrite(&ecd, 1, sizeof(ecd), storage_file_))
+	if (sizeof(ecd) != fwrite(&ecd, 1, sizeof(ecd), f))
 		return false;
 
 	// write comment
 	if (ecd.comment_length > 0
-	 && ecd.comment_length != fwrite(comment.c_str(), 1, ecd.comment_length, storage_file_))
+	 && ecd.comment_length != fwrite(comment.c_str(), 1, ecd.comment_length, f))
 	{
 		return false;
 	}
 
+	return true;
+}
+
+bool FileContainerZip::write_changes()
+{
+	fseek(storage_file_, 0, SEEK_END);
+	if (!write_directory(storage_file_, files_, prev_storage_size_))
+		return false;
+
 	prev_storage_size_ = ftell(storage_file_);
 	fflush(storage_file_);
 	changed_ = false;
 	return true;
 }
 
+bool FileContainerZip::save()
+{
+	if (file_is_opened()) return false;
+	if (!changed_) return true;
+	if (!write_changes()) return false;
+
+	// The previous versions are kept for the history,
+	// until they take too much space
+	int ratio = get_compact_ratio();
+	if (ratio > 0 && prev_storage_size_ > get_live_size()*(ratio + 1))
+		compact();
+	return true;
+}
+
+FileContainerZip::file_size_t FileContainerZip::get_live_size() const
+{
+	file_size_t size = sizeof(EndOfCentralDirectory);
+	for(FileMap::const_iterator i = files_.begin(); i != files_.end(); i++)
+	{
+		file_size_t name_size = i->second.name.size() + (i->second.is_directory ? 1 : 0);
+		size += sizeof(LocalFileHeader) + sizeof(CentralDirectoryFileHeader)
+		      + 2*name_size + i->second.size;
+	}
+	return size;
+}
+
+bool FileContainerZip::compact()
+{
+	if (!is_opened() || file_is_opened() || storage_filename_.empty()) return false;
+	if (changed_ && !write_changes()) return false;
+
+	std::string filename = storage_filename_;
+	std::string tmp_filename = filename + ".TMP";
+	FILE *f = fopen(tmp_filename.c_str(), "w+b");
+	if (f == NULL) return false;
+
+	// copy the current files, then write the directories
+	FileMap files = files_;
+	std::vector<char> buffer(1 << 16);
+	bool ok = true;
+	for(FileMap::iterator i = files.begin(); ok && i != files.end(); i++)
+	{
+		FileInfo &info = i->second;
+		if (info.is_directory)
+		{
+			info.directory_saved = false;
+			continue;
+		}
+
+		LocalFileHeader lfh;
+		fseek(storage_file_, info.header_offset, SEEK_SET);
+		if (sizeof(lfh) != fread(&lfh, 1, sizeof(lfh), storage_file_)
+		 || lfh.signature != LocalFileHeader::valid_signature__)
+			{ ok = false; break; }
+		fseek(storage_file_, lfh.filename_length + lfh.extrafield_length, SEEK_CUR);
+
+		// the data descriptor is not copied, the header gets its values
+		lfh.flags &= ~0x0008;
+		lfh.crc32 = info.crc32;
+		lfh.compressed_size = lfh.uncompressed_size = info.size;
+		lfh.filename_length = info.name.size();
+		lfh.extrafield_length = 0;
+		info.header_offset = ftell(f);
+		ok = sizeof(lfh) == fwrite(&lfh, 1, sizeof(lfh), f)
+		  && info.name.size() == fwrite(info.name.c_str(), 1, info.name.size(), f);
+
+		for(file_size_t remain = info.size; ok && remain > 0; )
+		{
+			size_t size = (size_t)std::min(remain, (file_size_t)buffer.size());
+			ok = size == fread(&buffer[0], 1, size, storage_file_)
+			  && size == fwrite(&buffer[0], 1, size, f);
+			remain -= size;
+		}
+	}
+	ok = ok && write_directory(f, files, 0);
+	ok = fclose(f) == 0 && ok;
+	if (!ok)
+	{
+		remove(tmp_filename.c_str());
+		return false;
+	}
+
+	close();
+#ifdef _WIN32
+	remove(filename.c_str());
+#endif
+	if (rename(tmp_filename.c_str(), filename.c_str()) != 0)
+	{
+		remove(tmp_filename.c_str());
+		open_from_history(filename);
+		return false;
+	}
+	return open_from_history(filename);
+}
+
 void FileContainerZip::close()
 {
 	if (!is_opened()) return;
@@ -601,8 +744,10 @@ void FileContainerZip::close()
 	save();
 
 	// close storage file and clead variables
+	unmap();
 	fclose(storage_file_);
 	storage_file_ = NULL;
+	storage_filename_.clear();
 	files_.clear();
 	prev_storage_size_ = 0;
 	file_reading_ = false;
@@ -727,6 +872,9 @@ bool FileContainerZip::file_open_write(const std::string &filename)
 	if (!is_opened() || file_is_opened()) return false;
 	if (!file_check_name(filename)) return false;
 
+	// the storage will change, it is mapped again when needed
+	unmap();
+
 	file_ = files_.find(fix_slashes(filename));
 
 	FileInfo new_info;
@@ -753,6 +901,13 @@ bool FileContainerZip::file_open_write(const std::string &filename)
 	lfh.modification_time = dos_timestamp.dos_time;
 	lfh.modification_date = dos_timestamp.dos_date;
 
+	file_replacing_ = file_ != files_.end();
+	if (file_replacing_)
+	{
+		file_replaced_ = file_->second;
+		file_replaced_changed_ = changed_;
+	}
+
 	fseek(storage_file_, 0, SEEK_END);
 	long int offset = ftell(storage_file_);
 	changed_ = true;
@@ -787,6 +942,22 @@ void FileContainerZip::file_close()
 		fwrite(&lfho, 1, sizeof(lfho), storage_file_);
 		file_writing_ = false;
 		fflush(storage_file_);
+
+		// The same contents were written again, drop the new copy
+		file_size_t replaced_offset, written_offset;
+		if (file_replacing_
+		 && file_replaced_.size == file_->second.size
+		 && file_replaced_.crc32 == file_->second.crc32
+		 && get_data_offset(storage_file_, file_replaced_.header_offset, replaced_offset)
+		 && get_data_offset(storage_file_, file_->second.header_offset, written_offset)
+		 && same_data(storage_file_, replaced_offset, written_offset, file_->second.size)
+		 && truncate_file(storage_file_, (long int)file_->second.header_offset))
+		{
+			file_->second = file_replaced_;
+			changed_ = file_replaced_changed_;
+		}
+		fseek(storage_file_, 0, SEEK_END);
+		file_replacing_ = false;
 	}
 	file_reading_whole_container_ = false;
 	file_reading_ = false;
@@ -819,6 +990,46 @@ size_t FileContainerZip::file_read(void *buffer, size_t size)
 	return s;
 }
 
+bool FileContainerZip::file_map(const char *&data, size_t &size)
+{
+#ifdef HAVE_MMAP
+	if (!file_reading_ || file_processed_size_ != 0 || getenv("SYNFIG_DISABLE_MMAP"))
+		return false;
+
+	// the storage is mapped once, and again when files were appended
+	file_size_t offset = ftell(storage_file_);
+	file_size_t end = offset + file_->second.size;
+	if (end > map_size_)
+	{
+		unmap();
+		fflush(storage_file_);
+		struct stat buf;
+		if (fstat(fileno(storage_file_), &buf) != 0 || (file_size_t)buf.st_size < end)
+			return false;
+		void *map = mmap(NULL, (size_t)buf.st_size, PROT_READ, MAP_PRIVATE, fileno(storage_file_), 0);
+		if (map == MAP_FAILED)
+			return false;
+		map_ = map;
+		map_size_ = buf.st_size;
+	}
+
+	data = (const char*)map_ + offset;
+	size = (size_t)file_->second.size;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void FileContainerZip::unmap()
+{
+#ifdef HAVE_MMAP
+	if (map_) munmap(map_, (size_t)map_size_);
+#endif
+	map_ = NULL;
+	map_size_ = 0;
+}
+
 size_t FileContainerZip::file_write(const void *buffer, size_t size)
 {
 	if (!file_is_opened_for_write()) return 0;
@@ -86,6 +86,10 @@ namespace synfig
 		typedef std::map< std::string, FileInfo > FileMap;
 
 		FILE *storage_file_;
+		std::string storage_filename_;
+		//! The storage mapped in memory, to read the files from it
+		void *map_;
+		file_size_t map_size_;
 		FileMap files_;
 		file_size_t prev_storage_size_;
 		bool file_reading_whole_container_;
@@ -95,10 +99,20 @@ namespace synfig
 		file_size_t file_processed_size_;
 		bool changed_;
 
+		//! The file being written replaces this one
+		bool file_replacing_;
+		FileInfo file_replaced_;
+		bool file_replaced_changed_;
+
 		static unsigned int crc32(unsigned int previous_crc, const void *buffer, size_t size);
 		static std::string encode_history(const HistoryRecord &history_record);
 		static HistoryRecord decode_history(const std::string &comment);
 		static void read_history(std::list<HistoryRecord> &list, FILE *f, file_size_t size);
+		static bool write_directory(FILE *f, FileMap &files, file_size_t prev_storage_size);
+
+		bool write_changes();
+		file_size_t get_live_size() const;
+		void unmap();
 
 	public:
 		FileContainerZip();
@@ -110,6 +124,8 @@ namespace synfig
 		virtual void close();
 		virtual bool is_opened();
 		bool save();
+		//! Rewrites the storage with the current files only, dropping the history
+		bool compact();
 
 		static std::list<HistoryRecord> read_history(const std::string &container_filename);
 
@@ -133,6 +149,7 @@ namespace synfig
 
 		virtual size_t file_read(void *buffer, size_t size);
 		virtual size_t file_write(const void *buffer, size_t size);
+		virtual bool file_map(const char *&data, size_t &size);
 	};
 
 }
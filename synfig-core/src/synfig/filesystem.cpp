@@ -31,6 +31,9 @@
 
 #include "filesystem.h"
 
+#include <algorithm>
+#include <cstring>
+
 #endif
 
 /* === U S I N G =========================================================== */
@@ -57,7 +60,10 @@ FileSystem::Stream::~Stream() { }
 
 FileSystem::ReadStream::ReadStream(Handle file_system):
 Stream(file_system),
-std::istream((std::streambuf*)this)
+std::istream((std::streambuf*)this),
+in_memory_(false),
+data_(NULL),
+data_size_(0)
 {
 	setg(&buffer_ + 1, &buffer_ + 1, &buffer_ + 1);
 }
@@ -65,11 +71,37 @@ std::istream((std::streambuf*)this)
 int FileSystem::ReadStream::underflow()
 {
 	if (gptr() < egptr()) return std::streambuf::traits_type::to_int_type(*gptr());
+	if (in_memory_) return EOF;
 	if (sizeof(buffer_) != internal_read(&buffer_, sizeof(buffer_))) return EOF;
 	setg(&buffer_, &buffer_, &buffer_ + 1);
 	return std::streambuf::traits_type::to_int_type(*gptr());
 }
 
+std::streamsize FileSystem::ReadStream::xsgetn(char *s, std::streamsize n)
+{
+	if (n <= 0) return 0;
+
+	// what is buffered first, then whole blocks straight from the file
+	std::streamsize count = std::min(n, (std::streamsize)(egptr() - gptr()));
+	if (count > 0)
+	{
+		memcpy(s, gptr(), count);
+		setg(eback(), gptr() + count, egptr());
+	}
+	if (count < n && !in_memory_)
+		count += (std::streamsize)internal_read(s + count, n - count);
+	return count;
+}
+
+void FileSystem::ReadStream::set_data(const char *data, size_t size, bool owned)
+{
+	in_memory_ = true;
+	data_ = owned ? data : NULL;
+	data_size_ = owned ? size : 0;
+	char *begin = const_cast<char*>(data);
+	setg(begin, begin, begin + size);
+}
+
 // WriteStream
 
 FileSystem::WriteStream::WriteStream(Handle file_system):
@@ -84,6 +116,13 @@ FileSystem::WriteStream::overflow(int character)
 	return character != EOF && sizeof(c) == internal_write(&c, sizeof(c)) ? character : EOF;
 }
 
+std::streamsize
+FileSystem::WriteStream::xsputn(const char *s, std::streamsize n)
+{
+	// Whole blocks go straight through, not one character at a time
+	return n > 0 ? (std::streamsize)internal_write(s, n) : 0;
+}
+
 // Identifier
 
 FileSystem::ReadStreamHandle FileSystem::Identifier::get_read_stream() const
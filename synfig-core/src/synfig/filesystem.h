@@ -65,12 +65,26 @@ namespace synfig
 		{
 		protected:
 			char buffer_;
+			bool in_memory_;
+			const char *data_;
+			size_t data_size_;
 
 			ReadStream(Handle file_system);
 			virtual int underflow();
+			virtual std::streamsize xsgetn(char *s, std::streamsize n);
 			virtual size_t internal_read(void *buffer, size_t size) = 0;
 
+			//! Reads the stream from \a data instead of internal_read()
+			/*!	When \a owned, \a data lives as long as the stream alone,
+			**	and is given by data() */
+			void set_data(const char *data, size_t size, bool owned);
+
 		public:
+			//! The whole contents, when the stream keeps them in memory, or NULL
+			/*!	Valid while the stream lives, and may be used by any thread */
+			const char* data() const { return data_; }
+			size_t data_size() const { return data_size_; }
+
 			size_t read_block(void *buffer, size_t size)
 				{ return read((char*)buffer, size).gcount(); }
 			bool read_whole_block(void *buffer, size_t size)
@@ -89,6 +103,7 @@ namespace synfig
 		protected:
 			WriteStream(Handle file_system);
 	        virtual int overflow(int ch);
+			virtual std::streamsize xsputn(const char *s, std::streamsize n);
 			virtual size_t internal_write(const void *buffer, size_t size) = 0;
 
 		public:
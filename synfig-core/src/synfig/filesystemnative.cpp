@@ -34,6 +34,11 @@
 #include "general.h"
 #include "guid.h"
 #include <sys/stat.h>
+#include <cstdlib>
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 #endif
 
@@ -45,6 +50,9 @@ using namespace synfig;
 
 /* === M A C R O S ========================================================= */
 
+//! Smaller files are read, mapping them costs more than copying them
+#define MMAP_MIN_SIZE	(64*1024)
+
 /* === G L O B A L S ======================================================= */
 
 /* === P R O C E D U R E S ================================================= */
@@ -56,10 +64,32 @@ const etl::handle< FileSystemNative > FileSystemNative::instance__(new FileSyste
 // ReadStream
 
 FileSystemNative::ReadStream::ReadStream(Handle file_system, FILE *file):
-	FileSystem::ReadStream(file_system), file_(file) { }
+	FileSystem::ReadStream(file_system), file_(file), map_(NULL), map_size_(0)
+{
+#ifdef HAVE_MMAP
+	// Map the large files, so their contents are read without copies
+	struct stat buf;
+	if (getenv("SYNFIG_DISABLE_MMAP")
+	 || fstat(fileno(file_), &buf) != 0
+	 || !S_ISREG(buf.st_mode)
+	 || buf.st_size < MMAP_MIN_SIZE)
+		return;
+
+	void *map = mmap(NULL, (size_t)buf.st_size, PROT_READ, MAP_PRIVATE, fileno(file_), 0);
+	if (map == MAP_FAILED) return;
+	map_ = map;
+	map_size_ = (size_t)buf.st_size;
+	set_data((const char*)map_, map_size_, true);
+#endif
+}
 
 FileSystemNative::ReadStream::~ReadStream()
-	{ fclose(file_); }
+{
+#ifdef HAVE_MMAP
+	if (map_) munmap(map_, map_size_);
+#endif
+	fclose(file_);
+}
 
 size_t FileSystemNative::ReadStream::internal_read(void *buffer, size_t size)
 	{ return fread(buffer, 1, size, file_); }
@@ -46,6 +46,8 @@ namespace synfig
 		protected:
 			friend class FileSystemNative;
 			FILE *file_;
+			void *map_;
+			size_t map_size_;
 			ReadStream(Handle file_system, FILE *file);
 			virtual size_t internal_read(void *buffer, size_t size);
 		public:
@@ -33,17 +33,28 @@
 #include "canvas.h"
 #include "importer.h"
 #include "surface.h"
+#include "mutex.h"
+#include "loadstats.h"
 #include <algorithm>
 #include "string.h"
 #include <map>
+#include <deque>
+#include <vector>
 #include <ctype.h>
 #include <functional>
+#include <cstdlib>
 #include <glibmm.h>
 
 #endif
 
 /* === M A C R O S ========================================================= */
 
+//! Default number of images decoded at the same time in background
+#define DEFAULT_DECODE_THREADS	4
+
+//! Largest reduction of the resolution of static frames
+#define MAX_REDUCTION			8
+
 /* === G L O B A L S ======================================================= */
 
 using namespace etl;
@@ -51,18 +62,127 @@ using namespace std;
 using namespace synfig;
 
 Importer::Book* synfig::Importer::book_;
+Importer::DecodePool* synfig::Importer::decode_pool_;
+
+//! Open importers, by file and reduction
+typedef map<pair<FileSystem::Identifier,int>,Importer::LooseHandle> OpenImporters;
+OpenImporters *__open_importers;
+//! Guards __open_importers: layers may open importers while rendering
+RecMutex __open_importers_mutex;
+
+/* === C L A S S E S ======================================================= */
+
+struct Importer::DecodeState
+{
+	mutable Glib::Mutex mutex;
+	mutable Glib::Cond cond;
+	int rows;
+	int rows_decoded;
+	bool running;
+	bool failed;
+	bool cancelled;
+
+	DecodeState(int rows):
+		rows(rows),
+		rows_decoded(0),
+		running(true),
+		failed(false),
+		cancelled(false)
+	{ }
+};
 
-map<FileSystem::Identifier,Importer::LooseHandle> *__open_importers;
+//! Runs the decoding of the queued importers on a fixed number of threads
+class Importer::DecodePool
+{
+	Glib::Mutex mutex;
+	Glib::Cond cond;
+	std::deque<Importer*> queue;
+	std::vector<Glib::Thread*> threads;
+	int thread_count;
+	bool stopping;
+
+	void run()
+	{
+		while(true)
+		{
+			Importer *importer;
+			{
+				Glib::Mutex::Lock lock(mutex);
+				while(queue.empty() && !stopping)
+					cond.wait(mutex);
+				if (queue.empty())
+					return;
+				importer=queue.front();
+				queue.pop_front();
+			}
+			importer->decode_thread();
+		}
+	}
+
+public:
+	DecodePool(int thread_count): thread_count(thread_count), stopping(false) { }
+
+	~DecodePool()
+	{
+		{
+			Glib::Mutex::Lock lock(mutex);
+			stopping=true;
+			cond.broadcast();
+		}
+		for(std::vector<Glib::Thread*>::iterator i=threads.begin();i!=threads.end();++i)
+			(*i)->join();
+	}
+
+	void push(Importer *importer)
+	{
+		Glib::Mutex::Lock lock(mutex);
+		// The threads are started on first use
+		while((int)threads.size()<thread_count)
+			threads.push_back(Glib::Thread::create(sigc::mem_fun(*this, &DecodePool::run), true));
+		queue.push_back(importer);
+		cond.signal();
+	}
+
+	//! Removes \a importer if no thread took it yet
+	bool remove(Importer *importer)
+	{
+		Glib::Mutex::Lock lock(mutex);
+		std::deque<Importer*>::iterator i=std::find(queue.begin(), queue.end(), importer);
+		if (i==queue.end())
+			return false;
+		queue.erase(i);
+		return true;
+	}
+};
 
 /* === P R O C E D U R E S ================================================= */
 
+//! Returns the largest reduction keeping a \a width x \a height frame
+//! at least \a max_width x \a max_height
+static int
+choose_reduction(int width, int height, int max_width, int max_height)
+{
+	int reduction=1;
+	if (max_width > 0 && max_height > 0)
+		while(reduction < MAX_REDUCTION
+		   && width/(reduction*2) >= max_width
+		   && height/(reduction*2) >= max_height)
+			reduction*=2;
+	return reduction;
+}
+
 /* === M E T H O D S ======================================================= */
 
 bool
 Importer::subsys_init()
 {
 	book_=new Book();
-	__open_importers=new map<FileSystem::Identifier,Importer::LooseHandle>();
+	__open_importers=new OpenImporters();
+
+	int threads = DEFAULT_DECODE_THREADS;
+	if (getenv("SYNFIG_IMPORTER_THREADS"))
+		threads = std::max(1, atoi(getenv("SYNFIG_IMPORTER_THREADS")));
+	decode_pool_=new DecodePool(threads);
 	return true;
 }
 
@@ -71,6 +191,7 @@ Importer::subsys_stop()
 {
 	delete book_;
 	delete __open_importers;
+	delete decode_pool_;
 	return true;
 }
 
@@ -81,7 +202,7 @@ Importer::book()
 }
 
 Importer::Handle
-Importer::open(const FileSystem::Identifier &identifier)
+Importer::open(const FileSystem::Identifier &identifier, int max_width, int max_height)
 {
 	if(identifier.filename.empty())
 	{
@@ -89,12 +210,22 @@ Importer::open(const FileSystem::Identifier &identifier)
 		return 0;
 	}
 
+	LoadStats::Timer timer(LoadStats::PHASE_IMPORTERS);
+	RecMutex::Lock lock(__open_importers_mutex);
+
 	// If we already have an importer open under that filename,
-	// then use it instead.
-	if(__open_importers->count(identifier))
+	// at the resolution we need, then use it instead.
+	OpenImporters::iterator iter=__open_importers->lower_bound(make_pair(identifier, 0));
+	if(iter!=__open_importers->end() && !(identifier < iter->first.first))
 	{
-		//synfig::info("Found importer already open, using it...");
-		return (*__open_importers)[identifier];
+		int width, height, reduction=1;
+		if (iter->second->get_frame_size(width, height))
+			reduction=choose_reduction(width, height, max_width, max_height);
+		if(__open_importers->count(make_pair(identifier, reduction)))
+		{
+			//synfig::info("Found importer already open, using it...");
+			return (*__open_importers)[make_pair(identifier, reduction)];
+		}
 	}
 
 	if(filename_extension(identifier.filename) == "")
@@ -117,7 +248,14 @@ Importer::open(const FileSystem::Identifier &identifier)
 	try {
 		Importer::Handle importer;
 		importer=Importer::book()[ext].factory(identifier);
-		(*__open_importers)[identifier]=importer;
+		LoadStats::count(_("Imported files"), ext);
+
+		int width, height;
+		if (importer->get_frame_size(width, height))
+			importer->reduction_=choose_reduction(width, height, max_width, max_height);
+		importer->begin_decoding();
+
+		(*__open_importers)[make_pair(identifier, importer->reduction_)]=importer;
 		return importer;
 	}
 	catch (String str)
@@ -129,6 +267,8 @@ Importer::open(const FileSystem::Identifier &identifier)
 
 Importer::Importer(const FileSystem::Identifier &identifier):
 	gamma_(2.2),
+	reduction_(1),
+	decode_state_(NULL),
 	identifier(identifier)
 {
 }
@@ -136,11 +276,112 @@ Importer::Importer(const FileSystem::Identifier &identifier):
 
 Importer::~Importer()
 {
+	// Normally already done by the derived importer, whose decode() is gone by now
+	stop_decoding();
+
 	// Remove ourselves from the open importer list
-	map<FileSystem::Identifier,Importer::LooseHandle>::iterator iter;
+	RecMutex::Lock lock(__open_importers_mutex);
+	OpenImporters::iterator iter;
 	for(iter=__open_importers->begin();iter!=__open_importers->end();++iter)
 		if(iter->second==this)
 		{
 			__open_importers->erase(iter);
+			break;
+		}
+}
+
+void
+Importer::start_decoding(int rows)
+{
+	assert(!decode_state_);
+	decode_state_=new DecodeState(rows);
+	decode_pool_->push(this);
+}
+
+void
+Importer::decode_thread()
+{
+	bool success=false;
+
+	try
+	{
+		bool cancelled;
+		{
+			Glib::Mutex::Lock lock(decode_state_->mutex);
+			cancelled=decode_state_->cancelled;
 		}
+		if (!cancelled)
+			success=decode();
+	}
+	catch(String str)
+	{
+		synfig::error(str);
+	}
+	catch(...)
+	{
+		synfig::error(_("Importer: unknown exception while decoding \"%s\""), identifier.filename.c_str());
+	}
+	Glib::Mutex::Lock lock(decode_state_->mutex);
+	if (success)
+		decode_state_->rows_decoded=decode_state_->rows;
+	decode_state_->failed=!success;
+	decode_state_->running=false;
+	decode_state_->cond.broadcast();
+}
+
+bool
+Importer::set_rows_decoded(int rows)
+{
+	Glib::Mutex::Lock lock(decode_state_->mutex);
+	decode_state_->rows_decoded=rows;
+	decode_state_->cond.broadcast();
+	return !decode_state_->cancelled;
+}
+
+void
+Importer::stop_decoding()
+{
+	if (!decode_state_)
+		return;
+
+	// Not started yet, or wait for its thread to finish with it
+	if (!decode_pool_->remove(this))
+	{
+		Glib::Mutex::Lock lock(decode_state_->mutex);
+		decode_state_->cancelled=true;
+		while(decode_state_->running)
+			decode_state_->cond.wait(decode_state_->mutex);
+	}
+
+	delete decode_state_;
+	decode_state_=NULL;
+}
+
+bool
+Importer::is_decoding()const
+{
+	if (!decode_state_)
+		return false;
+	Glib::Mutex::Lock lock(decode_state_->mutex);
+	return decode_state_->running;
+}
+
+void
+Importer::release_decoding()
+{
+	if (decode_state_ && !is_decoding())
+		end_decoding();
+}
+
+bool
+Importer::wait_rows(int rows)const
+{
+	if (!decode_state_)
+		return true;
+
+	Glib::Mutex::Lock lock(decode_state_->mutex);
+	rows=std::min(rows, decode_state_->rows);
+	while(decode_state_->running && decode_state_->rows_decoded < rows)
+		decode_state_->cond.wait(decode_state_->mutex);
+	return decode_state_->rows_decoded >= rows;
 }
@@ -146,10 +146,51 @@ private:
 	//! \todo Do not hardcode the gamma to 2.2
 	Gamma gamma_;
 
+	//! The static frame is decoded at 1/reduction_ of its resolution
+	int reduction_;
+
+	struct DecodeState;
+	//! State of the background decoding, NULL if the importer decodes synchronously
+	DecodeState *decode_state_;
+
+	class DecodePool;
+	//! Threads decoding the static frames, SYNFIG_IMPORTER_THREADS at once
+	static DecodePool *decode_pool_;
+
+	void decode_thread();
+
 protected:
 
 	Importer(const FileSystem::Identifier &identifier);
 
+	//! Gets the size of the static frame in the file, when it is known before decoding.
+	//! Only importers which can decode reduced frames (see get_reduction()) need it.
+	virtual bool get_frame_size(int &width __attribute__ ((unused)), int &height __attribute__ ((unused)))const
+		{ return false; }
+
+	//! Prepares the decoding of the static frame, at 1/get_reduction() of its resolution.
+	//! Called by open() right after the importer is constructed.
+	virtual void begin_decoding() { }
+
+	//! Decodes the static frame into get_frame_buffer(), band by band.
+	/*!	It is run on a decoding thread after start_decoding() and must call
+	**	set_rows_decoded() each time a band of rows is complete.
+	**	\return \c true on success, \c false on error
+	*/
+	virtual bool decode() { return true; }
+
+	//! Runs decode() in background for a frame of \a rows rows
+	void start_decoding(int rows);
+	//! Publishes that the first \a rows rows of the frame are decoded
+	//! \return \c false if the decoding has been cancelled and decode() should stop
+	bool set_rows_decoded(int rows);
+	//! Cancels the background decoding and waits for decode() to end.
+	//! Importers using start_decoding() must call it from their destructor.
+	void stop_decoding();
+	//! Releases what only decode() needed, such as the file it reads.
+	//! Called by release_decoding(), on the thread owning the importer.
+	virtual void end_decoding() { }
+
 public:
 	const FileSystem::Identifier identifier;
 
@@ -181,8 +222,32 @@ public:
 	//! Returns \c true if the importer pays attention to the \a time parameter of get_frame()
 	virtual bool is_animated() { return false; }
 
+	//! Returns the buffer the static frame is decoded into, or NULL if the
+	//! importer does not decode progressively. Rows of the buffer are only
+	//! valid once wait_rows() returned for them.
+	virtual Surface* get_frame_buffer() { return NULL; }
+
+	//! Returns the factor the resolution of the static frame is reduced by (1, 2, 4 or 8)
+	int get_reduction()const { return reduction_; }
+
+	//! Returns \c true while the static frame is still being decoded in background
+	bool is_decoding()const;
+
+	//! Blocks until at least the first \a rows rows of the static frame are decoded
+	//! \return \c false if the decoding failed before reaching \a rows
+	bool wait_rows(int rows)const;
+
+	//! Releases what only the decoding needed, if it has finished.
+	//! To be called by the owner of the importer: handles can't be
+	//! dropped on the decoding thread.
+	void release_decoding();
+
 	//! Attempts to open \a filename, and returns a handle to the associated Importer
-	static Handle open(const FileSystem::Identifier &identifier);
+	/*!	\param max_width, max_height Size actually needed for the static frame.
+	**		When the importer supports it, the frame is decoded at the lowest
+	**		resolution still at least that large. 0 means the full resolution.
+	*/
+	static Handle open(const FileSystem::Identifier &identifier, int max_width=0, int max_height=0);
 };
 
 }; // END of namespace synfig
@@ -502,6 +502,15 @@ Layer::get_param(const String & param)const
 	return ValueBase();
 }
 
+ValueBase
+Layer::get_param_at(const String &param, Time time)const
+{
+	DynamicParamList::const_iterator iter(dynamic_param_list().find(param));
+	if(iter!=dynamic_param_list().end())
+		return (*iter->second)(time);
+	return get_param(param);
+}
+
 String
 Layer::get_version()const
 {
@@ -520,6 +529,19 @@ Layer::reset_version()
 }
 
 
+bool
+Layer::is_static_between(Time a, Time b)const
+{
+	if(has_time_influence())
+		return false;
+
+	DynamicParamList::const_iterator iter;
+	for(iter=dynamic_param_list().begin();iter!=dynamic_param_list().end();iter++)
+		if((*iter->second)(a)!=(*iter->second)(b))
+			return false;
+	return true;
+}
+
 void
 Layer::set_time(IndependentContext context, Time time)const
 {
@@ -484,6 +484,12 @@ public:
   //!Most layers don't. But few have (like TimeLoop)
   virtual bool has_time_influence()const { return false; };
 
+	//! Returns true if the layer renders the same at the times \a a and \a b
+	/*!	The default implementation compares the values of the animated
+	**	parameters. Layers which also depend on the time itself must
+	**	override it. \see IndependentContext::is_static_between() */
+	virtual bool is_static_between(Time a, Time b)const;
+
 	//! Returns a string containing the name of the Layer
 	virtual String get_name()const;
 
@@ -530,6 +536,9 @@ public:
 	*/
 	virtual ValueBase get_param(const String &param)const;
 
+	//! Gets the value of \a param at \a time, when it is animated
+	ValueBase get_param_at(const String &param, Time time)const;
+
 	//! Get a list of all of the parameters and their values
 	virtual ParamList get_param_list()const;
 
@@ -82,6 +82,12 @@ public:
 	virtual bool accelerated_cairorender(Context context, cairo_t *cr, int quality, const RendDesc &renddesc, ProgressCallback *cb)const;
 
 	virtual synfig::Layer::Handle hit_check(synfig::Context context, const synfig::Point &point)const;
+
+	//! Waits for all the pixels of the surface, when they are decoded in background.
+	//! Call it before using the surface out of a render: the renders may get
+	//! the image at a lower resolution, this gives the full one
+	//! \return \c false if they could not be decoded
+	virtual bool wait_surface()const { return true; }
 	
 	virtual void set_render_method(Context context, RenderMethod x);
 	void set_method(RenderMethod x) { method=x;}
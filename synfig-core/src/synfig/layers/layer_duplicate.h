@@ -56,6 +56,8 @@ public:
 	virtual Color get_color(Context context, const Point &pos)const;
 	virtual void set_time(IndependentContext context, Time time)const;
 	virtual void set_time(IndependentContext context, Time time, const Point &point)const;
+	//! The context is rendered for each index, which the animated parameters depend on
+	virtual bool is_static_between(Time /*a*/, Time /*b*/)const { return false; }
 	virtual ValueNode_Duplicate::Handle get_duplicate_param()const;
 	virtual bool accelerated_render(Context context,Surface *surface,int quality, const RendDesc &renddesc, ProgressCallback *cb)const;
 	virtual bool accelerated_cairorender(Context context, cairo_t *cr, int quality, const RendDesc &renddesc, ProgressCallback *cb)const;
@@ -312,6 +312,19 @@ Layer_PasteCanvas::set_time(IndependentContext context, Time time)const
 		canvas->set_time(time+time_offset);
 }
 
+bool
+Layer_PasteCanvas::is_static_between(Time a, Time b)const
+{
+	if(!Layer_Composite::is_static_between(a,b))
+		return false;
+	if(!canvas)
+		return true;
+
+	if(depth==MAX_DEPTH)return false;depth_counter counter(depth);
+	const Time time_offset(get_param_at("time_offset",a).get(Time()));
+	return canvas->get_independent_context().is_static_between(a+time_offset,b+time_offset);
+}
+
 void
 Layer_PasteCanvas::apply_z_range_to_params(ContextParams &/*cp*/)const
 {
@@ -419,8 +432,10 @@ Layer_PasteCanvas::accelerated_render(Context context,Surface *surface,int quali
 		intermediate_desc.set_transformation_matrix(transformation.get_matrix());
 		return canvasContext.accelerated_render(surface,quality,intermediate_desc,&stagetwo);
 	}
-	else
-	if (!context.accelerated_render(surface,quality,renddesc,&stageone))
+
+	// With half floats the context is rendered after the canvas, see below
+	const bool context_last = renddesc.get_half_float();
+	if (!context_last && !context.accelerated_render(surface,quality,renddesc,&stageone))
 		return false;
 
 	Real grow_value(get_parent_canvas_grow_value());
@@ -440,7 +455,7 @@ Layer_PasteCanvas::accelerated_render(Context context,Surface *surface,int quali
 	Rect outer_bounds(transformation.transform_bounds(inner_bounds));
 	outer_bounds &= renddesc.get_rect();
 	if (!outer_bounds.is_valid())
-		return true;
+		return !context_last || context.accelerated_render(surface,quality,renddesc,&stageone);
 	
 	Rect next_bounds( Transformation::transform_bounds(renddesc.get_transformation_matrix(), context.get_full_bounding_rect()) );
 
@@ -459,7 +474,7 @@ Layer_PasteCanvas::accelerated_render(Context context,Surface *surface,int quali
 	if (!inner_bounds.is_valid())
 	{
 		warning("%s:%d bounding box shrank while rendering?", __FILE__, __LINE__);
-		return true;
+		return !context_last || context.accelerated_render(surface,quality,renddesc,&stageone);
 	}
 
 	bool blend_using_straight = false; // use 'straight' just for the central blit
@@ -469,7 +484,7 @@ Layer_PasteCanvas::accelerated_render(Context context,Surface *surface,int quali
 		// if there's no intersection between the context and our
 		// surface, and we're rendering 'onto', then we're done
 		if (Color::is_onto(blend_method) && !Color::is_straight(blend_method))
-			return true;
+			return !context_last || context.accelerated_render(surface,quality,renddesc,&stageone);
 
 		/* 'straight' is faster than 'composite' and has the same
 		 * effect if the affected area of the lower layer is
@@ -525,11 +540,30 @@ Layer_PasteCanvas::accelerated_render(Context context,Surface *surface,int quali
 		Surface intermediate_surface;
 		if(!canvasContext.accelerated_render(&intermediate_surface,quality,intermediate_desc,&stagetwo))
 			return false;
+
+		// Hold the canvas in half floats while the context is rendered,
+		// nested groups would keep a full surface each otherwise.
+		// Only the blit source is packed, the context stays in floats
+		HalfSurface packed_surface;
+		if (context_last)
+		{
+			packed_surface.pack(intermediate_surface);
+			intermediate_surface.set_wh(0,0);
+			if (!context.accelerated_render(surface,quality,renddesc,&stageone))
+				return false;
+		}
+
 		Surface::alpha_pen apen(surface->get_pen(x0, y0));
 		apen.set_alpha(get_amount());
 		apen.set_blend_method(blend_using_straight ? Color::BLEND_STRAIGHT : blend_method);
-		intermediate_surface.blit_to(apen);
+		if (context_last)
+			packed_surface.blit_to(apen);
+		else
+			intermediate_surface.blit_to(apen);
 	}
+	else
+	if (context_last && !context.accelerated_render(surface,quality,renddesc,&stageone))
+		return false;
 
 	if(cb && !cb->amount_complete(10000,10000)) return false;
 	return true;
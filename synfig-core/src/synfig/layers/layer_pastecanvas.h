@@ -170,6 +170,8 @@ public:
 	virtual Color get_color(Context context, const Point &pos)const;
 	//! Sets the time of the Paste Canvas Layer and those under it
 	virtual void set_time(IndependentContext context, Time time)const;
+	//! Also compares the pasted canvas, at its own times
+	virtual bool is_static_between(Time a, Time b)const;
 	//! Renders the Canvas to the given Surface in an accelerated manner
 	//! See Layer::accelerated_render
 	virtual bool accelerated_render(Context context,Surface *surface,int quality, const RendDesc &renddesc, ProgressCallback *cb)const;
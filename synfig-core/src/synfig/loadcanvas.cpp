@@ -34,17 +34,22 @@
 #	include <config.h>
 #endif
 
+#include <cctype>
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
 #include <ETL/stringf>
 #include <libxml++/libxml++.h>
+#include <libxml/xmlreader.h>
 #include <vector>
 #include <stdexcept>
 #include <iostream>
 
 #include <synfig/layers/layer_group.h>
 #include "loadcanvas.h"
+#include "canvasbinary.h"
+#include "canvasprefetch.h"
+#include "loadstats.h"
 #include "valuenode.h"
 #include "boneweightpair.h"
 #include "valuenodes/valuenode_animated.h"
@@ -140,6 +145,111 @@ static void _canvas_file_name_changed(Canvas *x)
 
 }
 
+//! Converts the number at the start of \a str, as string_to_real() does in the "C" locale
+/*!	Numbers of up to 15 significant digits with a small exponent are
+**	converted exactly from their integer mantissa, the others by strtod() */
+static Real
+string_to_real(const char *str)
+{
+	static const double powers_of_ten[]={
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	const char *p(str);
+	while(isspace((unsigned char)*p))
+		p++;
+	const bool negative(*p=='-');
+	if(*p=='-' || *p=='+')
+		p++;
+
+	unsigned long long mantissa(0);
+	int digits(0), exponent(0);
+	bool valid(false);
+	for(;*p>='0' && *p<='9';p++,valid=true)
+		if((mantissa=mantissa*10+(*p-'0')))
+			digits++;
+	if(*p=='.')
+		for(p++;*p>='0' && *p<='9';p++,valid=true,exponent--)
+			if((mantissa=mantissa*10+(*p-'0')))
+				digits++;
+	if(!valid)
+		return strtod(str,NULL);
+
+	if((*p=='e' || *p=='E') && (isdigit((unsigned char)p[1]) ||
+		((p[1]=='-' || p[1]=='+') && isdigit((unsigned char)p[2]))))
+	{
+		const bool negative_exponent(*++p=='-');
+		if(*p=='-' || *p=='+')
+			p++;
+		int e(0);
+		for(;*p>='0' && *p<='9';p++)
+			if(e<10000)
+				e=e*10+(*p-'0');
+		exponent+=negative_exponent?-e:e;
+	}
+
+	if(digits>15 || exponent<-22 || exponent>22)
+		return strtod(str,NULL);
+
+	double value((double)mantissa);
+	if(exponent<0)
+		value/=powers_of_ten[-exponent];
+	else
+		value*=powers_of_ten[exponent];
+	return negative?-value:value;
+}
+
+//! Feeds the XML reader from a stream
+static int
+read_stream(void *context, char *buffer, int len)
+{
+	LoadStats::Timer timer(LoadStats::PHASE_READ);
+	std::istream &stream(*(std::istream*)context);
+	stream.read(buffer,len);
+	return stream.bad()?-1:(int)stream.gcount();
+}
+
+static int
+close_stream(void */*context*/)
+{
+	return 0;
+}
+
+//! The XML reader calls, accounted as parsing
+static int
+reader_read(xmlTextReaderPtr reader)
+{
+	LoadStats::Timer timer(LoadStats::PHASE_PARSE);
+	return xmlTextReaderRead(reader);
+}
+
+static int
+reader_next(xmlTextReaderPtr reader)
+{
+	LoadStats::Timer timer(LoadStats::PHASE_PARSE);
+	return xmlTextReaderNext(reader);
+}
+
+static xmlNodePtr
+reader_expand(xmlTextReaderPtr reader)
+{
+	LoadStats::Timer timer(LoadStats::PHASE_PARSE);
+	return xmlTextReaderExpand(reader);
+}
+
+namespace {
+
+//! Frees the XML reader when leaving the scope
+class TextReaderGuard
+{
+	xmlTextReaderPtr reader;
+public:
+	TextReaderGuard(xmlTextReaderPtr reader):reader(reader) { }
+	~TextReaderGuard() { if(reader) xmlFreeTextReader(reader); }
+};
+
+}
+
 Canvas::Handle
 synfig::open_canvas_as(const FileSystem::Identifier &identifier,const String &as,String &errors,String &warnings)
 {
@@ -157,6 +267,10 @@ synfig::open_canvas_as(const FileSystem::Identifier &identifier,const String &as
 		return canvas;
 	}
 
+	LoadStats::Timer timer(CanvasParser::loading_.empty() ? LoadStats::PHASE_OTHER : LoadStats::PHASE_EXTERNALS);
+	if (!CanvasParser::loading_.empty())
+		LoadStats::count(_("External canvases"), basename(identifier.filename));
+
 	Canvas::Handle canvas;
 	CanvasParser parser;
 	parser.set_allow_errors(true);
@@ -169,10 +283,15 @@ synfig::open_canvas_as(const FileSystem::Identifier &identifier,const String &as
 	catch (...)
 	{
 		CanvasParser::loading_.erase(identifier);
+		if (CanvasParser::loading_.empty())
+			CanvasPrefetch::end_load();
 		throw;
 	}
 	CanvasParser::loading_.erase(identifier);
 
+	if (CanvasParser::loading_.empty())
+		CanvasPrefetch::end_load();
+
 	warnings = parser.get_warnings_text();
 
 	if(parser.error_count())
@@ -280,7 +399,7 @@ CanvasParser::parse_real(xmlpp::Element *element)
 
 	string val=element->get_attribute("value")->get_value();
 
-	return atof(val.c_str());
+	return string_to_real(val.c_str());
 }
 
 Time
@@ -376,7 +495,7 @@ CanvasParser::parse_vector(xmlpp::Element *element)
 				error(element, "Undefined value in <x>");
 				return Vector();
 			}
-			vect[0]=atof(child->get_child_text()->get_content().c_str());
+			vect[0]=string_to_real(child->get_child_text()->get_content().c_str());
 		}
 		else
 		if(child->get_name()=="y")
@@ -386,7 +505,7 @@ CanvasParser::parse_vector(xmlpp::Element *element)
 				error(element, "Undefined value in <y>");
 				return Vector();
 			}
-			vect[1]=atof(child->get_child_text()->get_content().c_str());
+			vect[1]=string_to_real(child->get_child_text()->get_content().c_str());
 		}
 		else
 		{
@@ -429,7 +548,7 @@ CanvasParser::parse_color(xmlpp::Element *element)
 				error(element, "Undefined value in <r>");
 				return Color();
 			}
-			color.set_r(atof(child->get_child_text()->get_content().c_str()));
+			color.set_r(string_to_real(child->get_child_text()->get_content().c_str()));
 		}
 		else
 		if(child->get_name()=="g")
@@ -439,7 +558,7 @@ CanvasParser::parse_color(xmlpp::Element *element)
 				error(element, "Undefined value in <g>");
 				return Color();
 			}
-			color.set_g(atof(child->get_child_text()->get_content().c_str()));
+			color.set_g(string_to_real(child->get_child_text()->get_content().c_str()));
 		}
 		else
 		if(child->get_name()=="b")
@@ -449,7 +568,7 @@ CanvasParser::parse_color(xmlpp::Element *element)
 				error(element, "Undefined value in <b>");
 				return Color();
 			}
-			color.set_b(atof(child->get_child_text()->get_content().c_str()));
+			color.set_b(string_to_real(child->get_child_text()->get_content().c_str()));
 		}
 		else
 		if(child->get_name()=="a")
@@ -459,7 +578,7 @@ CanvasParser::parse_color(xmlpp::Element *element)
 				error(element, "Undefined value in <a>");
 				return Color();
 			}
-			color.set_a(atof(child->get_child_text()->get_content().c_str()));
+			color.set_a(string_to_real(child->get_child_text()->get_content().c_str()));
 		}
 		else
 		{
@@ -540,7 +659,7 @@ CanvasParser::parse_gradient(xmlpp::Element *node)
 				return Gradient();
 			}
 
-			cpoint.pos=atof(child->get_attribute("pos")->get_value().c_str());
+			cpoint.pos=string_to_real(child->get_attribute("pos")->get_value().c_str());
 
 			ret.push_back(cpoint);
 		}
@@ -1286,7 +1405,7 @@ CanvasParser::parse_angle(xmlpp::Element *element)
 
 	string val=element->get_attribute("value")->get_value();
 
-	return Angle::deg(atof(val.c_str()));
+	return Angle::deg(string_to_real(val.c_str()));
 }
 
 ValueBase
@@ -1788,22 +1907,22 @@ CanvasParser::parse_animated(xmlpp::Element *element,Canvas::Handle canvas)
 			if(child->get_attribute("tension"))
 			{
 				synfig::String str(child->get_attribute("tension")->get_value());
-				waypoint->set_tension(atof(str.c_str()));
+				waypoint->set_tension(string_to_real(str.c_str()));
 			}
 			if(child->get_attribute("temporal-tension"))
 			{
 				synfig::String str(child->get_attribute("temporal-tension")->get_value());
-				waypoint->set_temporal_tension(atof(str.c_str()));
+				waypoint->set_temporal_tension(string_to_real(str.c_str()));
 			}
 			if(child->get_attribute("continuity"))
 			{
 				synfig::String str(child->get_attribute("continuity")->get_value());
-				waypoint->set_continuity(atof(str.c_str()));
+				waypoint->set_continuity(string_to_real(str.c_str()));
 			}
 			if(child->get_attribute("bias"))
 			{
 				synfig::String str(child->get_attribute("bias")->get_value());
-				waypoint->set_bias(atof(str.c_str()));
+				waypoint->set_bias(string_to_real(str.c_str()));
 			}
 
 			if(child->get_attribute("before"))
@@ -1867,6 +1986,8 @@ CanvasParser::parse_animated(xmlpp::Element *element,Canvas::Handle canvas)
 		}
 	}
 
+	LoadStats::count(_("Waypoints"), type.description.name, value_node->waypoint_list().size());
+
 	value_node->changed();
 	return value_node;
 }
@@ -2572,8 +2693,10 @@ handle<ValueNode>
 CanvasParser::parse_value_node(xmlpp::Element *element,Canvas::Handle canvas)
 {
 	if (getenv("SYNFIG_DEBUG_LOAD_CANVAS")) printf("%s:%d parse_value_node\n", __FILE__, __LINE__);
+	LoadStats::Timer timer(LoadStats::PHASE_VALUE_NODES);
 	handle<ValueNode> value_node;
 	assert(element);
+	LoadStats::count(_("Value nodes"), element->get_name());
 
 	GUID guid;
 
@@ -2765,6 +2888,7 @@ CanvasParser::parse_layer(xmlpp::Element *element,Canvas::Handle canvas)
 {
 
 	assert(element->get_name()=="layer");
+	LoadStats::Timer timer(LoadStats::PHASE_LAYERS);
 	Layer::Handle layer;
 
 	if(!element->get_attribute("type"))
@@ -2772,6 +2896,7 @@ CanvasParser::parse_layer(xmlpp::Element *element,Canvas::Handle canvas)
 		error(element,_("Missing \"type\" attribute to \"layer\" element"));
 		return Layer::Handle();
 	}
+	LoadStats::count(_("Layers"), element->get_attribute("type")->get_value());
 
 	layer=Layer::create(element->get_attribute("type")->get_value());
 	layer->set_canvas(canvas);
@@ -3086,7 +3211,30 @@ CanvasParser::parse_layer(xmlpp::Element *element,Canvas::Handle canvas)
 Canvas::Handle
 CanvasParser::parse_canvas(xmlpp::Element *element,Canvas::Handle parent,bool inline_,const FileSystem::Identifier &identifier,String filename)
 {
+	bool found(false);
+	Canvas::Handle canvas(parse_canvas_header(element,parent,inline_,identifier,filename,found));
+	if(!canvas || found)
+		return canvas;
 
+	xmlpp::Element::NodeList list = element->get_children();
+	for(xmlpp::Element::NodeList::iterator iter = list.begin(); iter != list.end(); ++iter)
+	{
+		xmlpp::Element *child(dynamic_cast<xmlpp::Element*>(*iter));
+		if(child)
+			parse_canvas_child(child,canvas);
+//		else
+//		if((child->get_name()=="text"||child->get_name()=="comment") && child->has_child_text())
+//			continue;
+	}
+
+	parse_canvas_footer(element,canvas);
+	return canvas;
+}
+
+Canvas::Handle
+CanvasParser::parse_canvas_header(xmlpp::Element *element,Canvas::Handle parent,bool inline_,const FileSystem::Identifier &identifier,String filename,bool &found)
+{
+	found=false;
 	if(element->get_name()!="canvas")
 	{
 		error_unexpected_element(element,element->get_name(),"canvas");
@@ -3132,7 +3280,10 @@ CanvasParser::parse_canvas(xmlpp::Element *element,Canvas::Handle parent,bool in
 	{
 		GUID guid(element->get_attribute("guid")->get_value());
 		if(guid_cast<Canvas>(guid))
+		{
+			found=true;
 			return guid_cast<Canvas>(guid);
+		}
 		else
 			canvas->set_guid(guid);
 	}
@@ -3159,14 +3310,14 @@ CanvasParser::parse_canvas(xmlpp::Element *element,Canvas::Handle parent,bool in
 	}
 
 	if(element->get_attribute("xres"))
-		canvas->rend_desc().set_x_res(atof(element->get_attribute("xres")->get_value().c_str()));
+		canvas->rend_desc().set_x_res(string_to_real(element->get_attribute("xres")->get_value().c_str()));
 
 	if(element->get_attribute("yres"))
-		canvas->rend_desc().set_y_res(atof(element->get_attribute("yres")->get_value().c_str()));
+		canvas->rend_desc().set_y_res(string_to_real(element->get_attribute("yres")->get_value().c_str()));
 
 
 	if(element->get_attribute("fps"))
-		canvas->rend_desc().set_frame_rate(atof(element->get_attribute("fps")->get_value().c_str()));
+		canvas->rend_desc().set_frame_rate(string_to_real(element->get_attribute("fps")->get_value().c_str()));
 
 	if(element->get_attribute("start-time"))
 		canvas->rend_desc().set_time_start(Time(element->get_attribute("start-time")->get_value(),canvas->rend_desc().get_frame_rate()));
@@ -3186,13 +3337,13 @@ CanvasParser::parse_canvas(xmlpp::Element *element,Canvas::Handle parent,bool in
 		Vector
 			tl,
 			br;
-		tl[0]=atof(string(values.data(),values.find(' ')).c_str());
+		tl[0]=string_to_real(string(values.data(),values.find(' ')).c_str());
 		values=string(values.begin()+values.find(' ')+1,values.end());
-		tl[1]=atof(string(values.data(),values.find(' ')).c_str());
+		tl[1]=string_to_real(string(values.data(),values.find(' ')).c_str());
 		values=string(values.begin()+values.find(' ')+1,values.end());
-		br[0]=atof(string(values.data(),values.find(' ')).c_str());
+		br[0]=string_to_real(string(values.data(),values.find(' ')).c_str());
 		values=string(values.begin()+values.find(' ')+1,values.end());
-		br[1]=atof(values.c_str());
+		br[1]=string_to_real(values.c_str());
 
 		canvas->rend_desc().set_tl(tl);
 		canvas->rend_desc().set_br(br);
@@ -3203,16 +3354,16 @@ CanvasParser::parse_canvas(xmlpp::Element *element,Canvas::Handle parent,bool in
 		string values=element->get_attribute("bgcolor")->get_value();
 		Color bg;
 
-		bg.set_r(atof(string(values.data(),values.find(' ')).c_str()));
+		bg.set_r(string_to_real(string(values.data(),values.find(' ')).c_str()));
 		values=string(values.begin()+values.find(' ')+1,values.end());
 
-		bg.set_g(atof(string(values.data(),values.find(' ')).c_str()));
+		bg.set_g(string_to_real(string(values.data(),values.find(' ')).c_str()));
 		values=string(values.begin()+values.find(' ')+1,values.end());
 
-		bg.set_b(atof(string(values.data(),values.find(' ')).c_str()));
+		bg.set_b(string_to_real(string(values.data(),values.find(' ')).c_str()));
 		values=string(values.begin()+values.find(' ')+1,values.end());
 
-		bg.set_a(atof(values.c_str()));
+		bg.set_a(string_to_real(values.c_str()));
 
 		canvas->rend_desc().set_bg_color(bg);
 	}
@@ -3222,160 +3373,157 @@ CanvasParser::parse_canvas(xmlpp::Element *element,Canvas::Handle parent,bool in
 		string values=element->get_attribute("focus")->get_value();
 		Vector focus;
 
-		focus[0]=atof(string(values.data(),values.find(' ')).c_str());
+		focus[0]=string_to_real(string(values.data(),values.find(' ')).c_str());
 		values=string(values.begin()+values.find(' ')+1,values.end());
-		focus[1]=atof(values.c_str());
+		focus[1]=string_to_real(values.c_str());
 
 		canvas->rend_desc().set_focus(focus);
 	}
 
 	canvas->rend_desc().set_flags(RendDesc::PX_ASPECT|RendDesc::IM_SPAN);
+	return canvas;
+}
 
-	list<ValueNode::Handle> bone_list;
-	xmlpp::Element::NodeList list = element->get_children();
-	for(xmlpp::Element::NodeList::iterator iter = list.begin(); iter != list.end(); ++iter)
+void
+CanvasParser::parse_canvas_child(xmlpp::Element *child,Canvas::Handle canvas)
+{
+	if(child->get_name()=="defs")
 	{
-		xmlpp::Element *child(dynamic_cast<xmlpp::Element*>(*iter));
-		if(child)
+		if(canvas->is_inline())
+			error(child,_("Group canvases cannot have a <defs> section"));
+		parse_canvas_defs(child, canvas);
+	}
+	else
+	if(child->get_name()=="bones")
+	{
+		if(canvas->is_inline())
+			error(child,_("Inline canvas cannot have a <bones> section"));
+		parse_canvas_bones(child, canvas);
+	}
+	else
+	if(child->get_name()=="keyframe")
+	{
+		if(canvas->is_inline())
 		{
-			if(child->get_name()=="defs")
-			{
-				if(canvas->is_inline())
-					error(child,_("Group canvases cannot have a <defs> section"));
-				parse_canvas_defs(child, canvas);
-			}
-			else
-			if(child->get_name()=="bones")
-			{
-				if(canvas->is_inline())
-					error(child,_("Inline canvas cannot have a <bones> section"));
-				bone_list = parse_canvas_bones(child, canvas);
-			}
-			else
-			if(child->get_name()=="keyframe")
-			{
-				if(canvas->is_inline())
-				{
-					warning(child,_("Group canvases cannot have keyframes"));
-					continue;
-				}
+			warning(child,_("Group canvases cannot have keyframes"));
+			return;
+		}
 
-				canvas->keyframe_list().add(parse_keyframe(child,canvas));
-				canvas->keyframe_list().sync();
-			}
-			else
-			if(child->get_name()=="meta")
-			{
-				if(canvas->is_inline())
-				{
-					warning(child,_("Group canvases cannot have metadata"));
-					continue;
-				}
+		canvas->keyframe_list().add(parse_keyframe(child,canvas));
+		canvas->keyframe_list().sync();
+	}
+	else
+	if(child->get_name()=="meta")
+	{
+		if(canvas->is_inline())
+		{
+			warning(child,_("Group canvases cannot have metadata"));
+			return;
+		}
 
-				if(!child->get_attribute("name"))
-				{
-					warning(child,_("<meta> must have a name"));
-					continue;
-				}
+		if(!child->get_attribute("name"))
+		{
+			warning(child,_("<meta> must have a name"));
+			return;
+		}
 
-				if(!child->get_attribute("content"))
-				{
-					warning(child,_("<meta> must have content"));
-					continue;
-				}
-				
-				// In Synfig prior to version 1.0 we have messed decimal separator:
-				// some files use ".", but other ones use ","/
-				// Let's try to put a workaround for that.
-				std::vector<String> replacelist;
-				replacelist.push_back("background_first_color");
-				replacelist.push_back("background_second_color");
-				replacelist.push_back("background_size");
-				replacelist.push_back("grid_color");
-				replacelist.push_back("grid_size");
-				replacelist.push_back("jack_offset");
-				String content;
-				content=child->get_attribute("content")->get_value();
-				if(std::find(replacelist.begin(), replacelist.end(), child->get_attribute("name")->get_value()) != replacelist.end()) 
-				{
-					size_t index = 0;
-					while (true) {
-					     /* Locate the substring to replace. */
-					     index = content.find(",", index);
-					     if (index == string::npos) break;
+		if(!child->get_attribute("content"))
+		{
+			warning(child,_("<meta> must have content"));
+			return;
+		}
+		
+		// In Synfig prior to version 1.0 we have messed decimal separator:
+		// some files use ".", but other ones use ","/
+		// Let's try to put a workaround for that.
+		std::vector<String> replacelist;
+		replacelist.push_back("background_first_color");
+		replacelist.push_back("background_second_color");
+		replacelist.push_back("background_size");
+		replacelist.push_back("grid_color");
+		replacelist.push_back("grid_size");
+		replacelist.push_back("jack_offset");
+		String content;
+		content=child->get_attribute("content")->get_value();
+		if(std::find(replacelist.begin(), replacelist.end(), child->get_attribute("name")->get_value()) != replacelist.end()) 
+		{
+			size_t index = 0;
+			while (true) {
+			     /* Locate the substring to replace. */
+			     index = content.find(",", index);
+			     if (index == string::npos) break;
 
-					     /* Make the replacement. */
-					     content.replace(index, 1, ".");
+			     /* Make the replacement. */
+			     content.replace(index, 1, ".");
 
-					     /* Advance index forward so the next iteration doesn't pick it up as well. */
-					     index += 1;
-					}
-					
-				}
-				canvas->set_meta_data(child->get_attribute("name")->get_value(),content);
+			     /* Advance index forward so the next iteration doesn't pick it up as well. */
+			     index += 1;
 			}
-			else if(child->get_name()=="name")
-			{
-				xmlpp::Element::NodeList list = child->get_children();
+			
+		}
+		canvas->set_meta_data(child->get_attribute("name")->get_value(),content);
+	}
+	else if(child->get_name()=="name")
+	{
+		xmlpp::Element::NodeList list = child->get_children();
 
-				// If we don't have any name, warn
-				if(list.empty())
-					warning(child,_("blank \"name\" entity"));
+		// If we don't have any name, warn
+		if(list.empty())
+			warning(child,_("blank \"name\" entity"));
 
-				string tmp;
-				for(xmlpp::Element::NodeList::iterator iter = list.begin(); iter != list.end(); ++iter)
-					if(dynamic_cast<xmlpp::TextNode*>(*iter))tmp+=dynamic_cast<xmlpp::TextNode*>(*iter)->get_content();
-				canvas->set_name(tmp);
-			}
-			else
-			if(child->get_name()=="desc")
-			{
+		string tmp;
+		for(xmlpp::Element::NodeList::iterator iter = list.begin(); iter != list.end(); ++iter)
+			if(dynamic_cast<xmlpp::TextNode*>(*iter))tmp+=dynamic_cast<xmlpp::TextNode*>(*iter)->get_content();
+		canvas->set_name(tmp);
+	}
+	else
+	if(child->get_name()=="desc")
+	{
 
-				xmlpp::Element::NodeList list = child->get_children();
+		xmlpp::Element::NodeList list = child->get_children();
 
-				// If we don't have any description, warn
-				if(list.empty())
-					warning(child,_("blank \"desc\" entity"));
+		// If we don't have any description, warn
+		if(list.empty())
+			warning(child,_("blank \"desc\" entity"));
 
-				string tmp;
-				for(xmlpp::Element::NodeList::iterator iter = list.begin(); iter != list.end(); ++iter)
-					if(dynamic_cast<xmlpp::TextNode*>(*iter))tmp+=dynamic_cast<xmlpp::TextNode*>(*iter)->get_content();
-				canvas->set_description(tmp);
-			}
-			else
-			if(child->get_name()=="author")
-			{
+		string tmp;
+		for(xmlpp::Element::NodeList::iterator iter = list.begin(); iter != list.end(); ++iter)
+			if(dynamic_cast<xmlpp::TextNode*>(*iter))tmp+=dynamic_cast<xmlpp::TextNode*>(*iter)->get_content();
+		canvas->set_description(tmp);
+	}
+	else
+	if(child->get_name()=="author")
+	{
 
-				xmlpp::Element::NodeList list = child->get_children();
+		xmlpp::Element::NodeList list = child->get_children();
 
-				// If we don't have any description, warn
-				if(list.empty())
-					warning(child,_("blank \"author\" entity"));
+		// If we don't have any description, warn
+		if(list.empty())
+			warning(child,_("blank \"author\" entity"));
 
-				string tmp;
-				for(xmlpp::Element::NodeList::iterator iter = list.begin(); iter != list.end(); ++iter)
-					if(dynamic_cast<xmlpp::TextNode*>(*iter))tmp+=dynamic_cast<xmlpp::TextNode*>(*iter)->get_content();
-				canvas->set_author(tmp);
-			}
-			else
-			if(child->get_name()=="layer")
-			{
-				//if(canvas->is_inline())
-				//	canvas->push_front(parse_layer(child,canvas->parent()));
-				//else
-					canvas->push_front(parse_layer(child,canvas));
-			}
-			else
-			{
-				printf("%s:%d\n", __FILE__, __LINE__);
-				error_unexpected_element(child,child->get_name());
-			}
-		}
-//		else
-//		if((child->get_name()=="text"||child->get_name()=="comment") && child->has_child_text())
-//			continue;
+		string tmp;
+		for(xmlpp::Element::NodeList::iterator iter = list.begin(); iter != list.end(); ++iter)
+			if(dynamic_cast<xmlpp::TextNode*>(*iter))tmp+=dynamic_cast<xmlpp::TextNode*>(*iter)->get_content();
+		canvas->set_author(tmp);
 	}
+	else
+	if(child->get_name()=="layer")
+	{
+		//if(canvas->is_inline())
+		//	canvas->push_front(parse_layer(child,canvas->parent()));
+		//else
+			canvas->push_front(parse_layer(child,canvas));
+	}
+	else
+	{
+		printf("%s:%d\n", __FILE__, __LINE__);
+		error_unexpected_element(child,child->get_name());
+	}
+}
 
+void
+CanvasParser::parse_canvas_footer(xmlpp::Element *element,Canvas::Handle canvas)
+{
 	if(canvas->value_node_list().placeholder_count())
 	{
 		String nodes;
@@ -3392,6 +3540,89 @@ CanvasParser::parse_canvas(xmlpp::Element *element,Canvas::Handle parent,bool in
 	}
 
 	canvas->set_version(CURRENT_CANVAS_VERSION);
+}
+
+Canvas::Handle
+CanvasParser::parse_canvas_stream(std::istream &stream,const FileSystem::Identifier &identifier,const String &as)
+{
+	xmlTextReaderPtr reader(xmlReaderForIO(read_stream,close_stream,&stream,as.c_str(),NULL,0));
+	if(!reader)
+		throw runtime_error(String("  * ") + _("Can't open file") + " \"" + identifier.filename + "\"");
+	TextReaderGuard guard(reader);
+
+	// The root canvas only keeps its attributes, each of its children is
+	// copied and parsed on its own, then dropped by the reader
+	xmlpp::Document root_document;
+	xmlpp::Element *root(NULL);
+	Canvas::Handle canvas;
+
+	int ret(reader_read(reader));
+	while(ret==1)
+	{
+		if(xmlTextReaderNodeType(reader)==XML_READER_TYPE_ELEMENT)
+		{
+			if(xmlTextReaderDepth(reader)==0)
+			{
+				xmlNodePtr node(xmlDocCopyNode(xmlTextReaderCurrentNode(reader),root_document.cobj(),2));
+				xmlDocSetRootElement(root_document.cobj(),node);
+				root=root_document.get_root_node();
+
+				bool found(false);
+				canvas=parse_canvas_header(root,0,false,identifier,as,found);
+				if(!canvas || found)
+					return canvas;
+			}
+			else
+			if(xmlTextReaderDepth(reader)==1 && canvas)
+			{
+				xmlNodePtr node(reader_expand(reader));
+				if(!node)
+				{
+					ret=-1;
+					break;
+				}
+
+				xmlpp::Document document;
+				xmlDocSetRootElement(document.cobj(),xmlDocCopyNode(node,document.cobj(),1));
+				parse_canvas_child(document.get_root_node(),canvas);
+
+				ret=reader_next(reader);
+				continue;
+			}
+		}
+		ret=reader_read(reader);
+	}
+
+	if(ret<0)
+	{
+		xmlErrorPtr xml_error(xmlGetLastError());
+		throw runtime_error(String("  * ") + _("Unable to parse") + " \"" + identifier.filename + "\"" +
+			(xml_error && xml_error->message ? String(": ") + xml_error->message : String()));
+	}
+
+	if(canvas)
+		parse_canvas_footer(root,canvas);
+	return canvas;
+}
+
+Canvas::Handle
+CanvasParser::parse_canvas_document(xmlpp::Element *root,const FileSystem::Identifier &identifier,const String &as)
+{
+	bool found(false);
+	Canvas::Handle canvas(parse_canvas_header(root,0,false,identifier,as,found));
+	if(!canvas || found)
+		return canvas;
+
+	xmlpp::Element::NodeList list = root->get_children();
+	for(xmlpp::Element::NodeList::iterator iter = list.begin(); iter != list.end(); ++iter)
+	{
+		xmlpp::Element *child(dynamic_cast<xmlpp::Element*>(*iter));
+		if(child)
+			parse_canvas_child(child,canvas);
+		root->remove_child(*iter);
+	}
+
+	parse_canvas_footer(root,canvas);
 	return canvas;
 }
 
@@ -3435,40 +3666,57 @@ CanvasParser::parse_from_file_as(const FileSystem::Identifier &identifier,const
 		total_warnings_=0;
 		
 		synfig::info(String("Loading file: ") + filename);
-		FileSystem::ReadStreamHandle stream = identifier.get_read_stream();
-		if (stream)
-		{
-			if (filename_extension(identifier.filename) == ".sifz")
-				stream = FileSystem::ReadStreamHandle(new ZReadStream(stream));
 
-			xmlpp::DomParser parser;
-			parser.parse_stream(*stream);
-			stream.reset();
-			if(parser)
-			{
-				Canvas::Handle canvas(parse_canvas(parser.get_document()->get_root_node(),0,false,identifier,as));
-				if (!canvas) return canvas;
-				register_canvas_in_map(canvas, as);
+		// The external canvases may have been read while loading the file
+		// which references them, or else are read while loading this one
+		const bool native(identifier.file_system.get() == FileSystemNative::instance().get());
+		Canvas::Handle canvas;
+		xmlpp::Document document;
+		if (native && CanvasPrefetch::take(identifier.filename, document))
+			canvas=parse_canvas_document(document.get_root_node(),identifier,as);
+		else
+		{
+			if (native)
+				CanvasPrefetch::scan(identifier.filename);
 
-				const ValueNodeList& value_node_list(canvas->value_node_list());
+			FileSystem::ReadStreamHandle stream = identifier.get_read_stream();
+			if (!stream)
+				throw runtime_error(String("  * ") + _("Can't find linked file") + " \"" + identifier.filename + "\"");
 
-				again:
-				ValueNodeList::const_iterator iter;
-				for(iter=value_node_list.begin();iter!=value_node_list.end();++iter)
+			if (filename_extension(identifier.filename) == ".sifb")
+			{
 				{
-					ValueNode::Handle value_node(*iter);
-					if(value_node->is_exported() && value_node->get_id().find("Unnamed")==0)
-					{
-						canvas->remove_value_node(value_node, true);
-						goto again;
-					}
+					LoadStats::Timer timer(LoadStats::PHASE_PARSE);
+					read_binary_canvas(*stream,document);
 				}
+				canvas=parse_canvas_document(document.get_root_node(),identifier,as);
+			}
+			else
+			{
+				if (filename_extension(identifier.filename) == ".sifz")
+					stream = FileSystem::ReadStreamHandle(new ZReadStream(stream));
 
-				return canvas;
+				canvas=parse_canvas_stream(*stream,identifier,as);
+			}
+		}
+		if (!canvas) return canvas;
+		register_canvas_in_map(canvas, as);
+
+		const ValueNodeList& value_node_list(canvas->value_node_list());
+
+		again:
+		ValueNodeList::const_iterator iter;
+		for(iter=value_node_list.begin();iter!=value_node_list.end();++iter)
+		{
+			ValueNode::Handle value_node(*iter);
+			if(value_node->is_exported() && value_node->get_id().find("Unnamed")==0)
+			{
+				canvas->remove_value_node(value_node, true);
+				goto again;
 			}
-		} else {
-			throw runtime_error(String("  * ") + _("Can't find linked file") + " \"" + identifier.filename + "\"");
 		}
+
+		return canvas;
 	}
 	catch(Exception::BadLinkName) { synfig::error("BadLinkName Thrown"); }
 	catch(Exception::BadType) { synfig::error("BadType Thrown"); }
@@ -163,6 +163,17 @@ private:
 
 	//! Canvas Parsing Function
 	Canvas::Handle parse_canvas(xmlpp::Element *node,Canvas::Handle parent=0,bool inline_=false,const FileSystem::Identifier &identifier = FileSystemNative::instance()->get_identifier(std::string()),String path=".");
+	//! Creates the canvas from the attributes of its element
+	/*! \param found Set when the canvas was already loaded, its children must not be parsed */
+	Canvas::Handle parse_canvas_header(xmlpp::Element *node,Canvas::Handle parent,bool inline_,const FileSystem::Identifier &identifier,String path,bool &found);
+	//! Parses a child element of a canvas (layer, defs, keyframe, meta...)
+	void parse_canvas_child(xmlpp::Element *node,Canvas::Handle canvas);
+	//! Checks the parsed canvas
+	void parse_canvas_footer(xmlpp::Element *node,Canvas::Handle canvas);
+	//! Parses the document in \a stream, one child of the root canvas at a time
+	Canvas::Handle parse_canvas_stream(std::istream &stream,const FileSystem::Identifier &identifier,const String &as);
+	//! Parses a document already read, freeing each child of \a root once parsed like parse_canvas_stream()
+	Canvas::Handle parse_canvas_document(xmlpp::Element *root,const FileSystem::Identifier &identifier,const String &as);
 	//! Canvas definitions Parsing Function (exported value nodes and exported canvases)
 	void parse_canvas_defs(xmlpp::Element *node,Canvas::Handle canvas);
 
@@ -0,0 +1,237 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file loadstats.cpp
+**	\brief Time, memory and objects spent loading canvases
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "loadstats.h"
+#include "general.h"
+#include "mutex.h"
+
+#include <ETL/clock>
+#include <ETL/stringf>
+
+#include <map>
+#include <vector>
+
+#if defined(HAVE_MALLINFO2) || defined(HAVE_MALLINFO)
+#include <malloc.h>
+#endif
+
+#endif
+
+/* === U S I N G =========================================================== */
+
+using namespace std;
+using namespace etl;
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+/* === G L O B A L S ======================================================= */
+
+namespace {
+
+struct Stats
+{
+	bool enabled;
+
+	//! Phases being timed, innermost last
+	vector<LoadStats::Phase> phases;
+	etl::clock_realtime clock;
+	long heap;
+
+	double time[LoadStats::PHASE_END];
+	long memory[LoadStats::PHASE_END];
+	//! Number of objects by category and type
+	map<String, map<String, size_t> > counts;
+
+	//! Guards the background figures, charged by other threads
+	Mutex background_mutex;
+	double background_time;
+	size_t background_files;
+
+	Stats(): enabled(false), heap(0) { reset(); }
+
+	void reset()
+	{
+		for(int i=0;i<LoadStats::PHASE_END;i++)
+			time[i]=0, memory[i]=0;
+		counts.clear();
+
+		Mutex::Lock lock(background_mutex);
+		background_time=0;
+		background_files=0;
+	}
+
+	//! Gets the memory in use: the heap, and the large blocks malloc maps apart.
+	//! mallinfo() only covers the main arena, where the loading thread allocates.
+	static long get_heap()
+	{
+#if defined(HAVE_MALLINFO2)
+		const struct mallinfo2 info(mallinfo2());
+		return (long)(info.uordblks+info.hblkhd);
+#elif defined(HAVE_MALLINFO)
+		// mallinfo() is deprecated, and its int fields wrap past 2GB
+		const struct mallinfo info(mallinfo());
+		return (long)(unsigned int)info.uordblks+(long)(unsigned int)info.hblkhd;
+#else
+		return 0;
+#endif
+	}
+
+	//! Charges what was spent since the last call to the innermost phase
+	void charge()
+	{
+		const double elapsed(clock.pop_time());
+		const long current(get_heap());
+		if(!phases.empty())
+		{
+			time[phases.back()]+=elapsed;
+			memory[phases.back()]+=current-heap;
+		}
+		heap=current;
+	}
+};
+
+Stats stats;
+
+const char *phase_names[LoadStats::PHASE_END] =
+{
+	N_("Other"),
+	N_("Reading and uncompressing"),
+	N_("Parsing"),
+	N_("Layers"),
+	N_("Value nodes"),
+	N_("External canvases"),
+	N_("Importers")
+};
+
+}; // END of anonymous namespace
+
+/* === M E T H O D S ======================================================= */
+
+LoadStats::Timer::Timer(Phase phase):
+	active(false)
+{
+	if(!stats.enabled)
+		return;
+	// Only the loads are accounted, and the external canvases as a whole
+	if(stats.phases.empty() ? phase!=PHASE_OTHER : stats.phases.back()==PHASE_EXTERNALS)
+		return;
+	stats.charge();
+	stats.phases.push_back(phase);
+	active=true;
+}
+
+LoadStats::Timer::~Timer()
+{
+	if(!active)
+		return;
+	stats.charge();
+	stats.phases.pop_back();
+}
+
+void
+LoadStats::set_enabled(bool x)
+{
+	stats.enabled=x;
+}
+
+bool
+LoadStats::is_enabled()
+{
+	return stats.enabled;
+}
+
+void
+LoadStats::count(const String &category, const String &type, size_t amount)
+{
+	if(stats.enabled)
+		stats.counts[category][type]+=amount;
+}
+
+void
+LoadStats::charge_background(double seconds, size_t files)
+{
+	if(!stats.enabled)
+		return;
+	Mutex::Lock lock(stats.background_mutex);
+	stats.background_time+=seconds;
+	stats.background_files+=files;
+}
+
+void
+LoadStats::reset()
+{
+	stats.reset();
+}
+
+void
+LoadStats::print(std::ostream &stream)
+{
+	double total_time(0);
+	long total_memory(0);
+	for(int i=0;i<PHASE_END;i++)
+		total_time+=stats.time[i], total_memory+=stats.memory[i];
+
+	stream << strprintf("%-28s %12s %12s", _("Phase"), _("Time (ms)"), _("Memory (KB)")) << endl;
+	for(int i=0;i<PHASE_END;i++)
+		stream << strprintf("  %-26s %12.1f %12ld",
+			_(phase_names[i]), stats.time[i]*1000.0, stats.memory[i]/1024) << endl;
+	stream << strprintf("  %-26s %12.1f %12ld", _("Total"), total_time*1000.0, total_memory/1024) << endl;
+#if !defined(HAVE_MALLINFO2) && !defined(HAVE_MALLINFO)
+	stream << _("(the memory is not measured on this platform)") << endl;
+#else
+	stream << _("(the memory is that of the main heap arena, used by the loading thread)") << endl;
+#endif
+
+	double background_time;
+	size_t background_files;
+	{
+		Mutex::Lock lock(stats.background_mutex);
+		background_time=stats.background_time;
+		background_files=stats.background_files;
+	}
+	if(background_files)
+	{
+		stream << endl << strprintf("%-28s %12s %12s", _("Prefetch threads"), _("Time (ms)"), _("Files")) << endl;
+		stream << strprintf("  %-26s %12.1f %12lu",
+			_("Reading ahead"), background_time*1000.0, (unsigned long)background_files) << endl;
+		stream << _("(not part of the total above, the loading thread may not have waited for it)") << endl;
+	}
+
+	for(map<String, map<String, size_t> >::const_iterator i=stats.counts.begin();i!=stats.counts.end();++i)
+	{
+		size_t total(0);
+		for(map<String, size_t>::const_iterator j=i->second.begin();j!=i->second.end();++j)
+			total+=j->second;
+
+		stream << endl << strprintf("%-28s %12lu", i->first.c_str(), (unsigned long)total) << endl;
+		for(map<String, size_t>::const_iterator j=i->second.begin();j!=i->second.end();++j)
+			stream << strprintf("  %-26s %12lu", j->first.c_str(), (unsigned long)j->second) << endl;
+	}
+}
@@ -0,0 +1,100 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file loadstats.h
+**	\brief Time, memory and objects spent loading canvases
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_LOADSTATS_H
+#define __SYNFIG_LOADSTATS_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <ostream>
+#include <cstddef>
+#include "string.h"
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace synfig {
+
+/*!	\class LoadStats
+**	\brief Accounts the loading of canvases, when enabled
+**
+**	The time and heap memory are charged to the innermost phase being
+**	timed, so that the phases add up to the whole load. Everything done
+**	while loading an external canvas is charged to PHASE_EXTERNALS.
+**	The objects are counted by category and type.
+**
+**	Only what is done within open_canvas_as() is timed. It is meant for
+**	the command line: only the loading thread is accounted in the phases.
+**	The files read ahead by the prefetch threads are reported apart, by
+**	time only: their memory is allocated outside the main heap arena,
+**	which is all the memory figures cover.
+*/
+class LoadStats
+{
+public:
+	enum Phase
+	{
+		PHASE_OTHER,		//!< Canvas headers, definitions, keyframes...
+		PHASE_READ,			//!< Reading and uncompressing the files
+		PHASE_PARSE,		//!< Tokenizing the XML, or decoding binary files
+		PHASE_LAYERS,		//!< Creating the layers and setting their parameters
+		PHASE_VALUE_NODES,	//!< Creating and linking the value nodes
+		PHASE_EXTERNALS,	//!< Loading the external canvases
+		PHASE_IMPORTERS,	//!< Opening the imported files
+
+		PHASE_END
+	};
+
+	//! Times a phase while in scope
+	class Timer
+	{
+		bool active;
+	public:
+		explicit Timer(Phase phase);
+		~Timer();
+	};
+
+	static void set_enabled(bool x);
+	static bool is_enabled();
+
+	//! Adds \a amount objects of the given category and type
+	static void count(const String &category, const String &type, size_t amount = 1);
+
+	//! Adds \a seconds spent by a background thread reading ahead \a files files.
+	//! Unlike the rest, it may be called from any thread.
+	static void charge_background(double seconds, size_t files = 1);
+
+	//! Forgets everything accounted until now
+	static void reset();
+
+	//! Prints a report of everything accounted until now
+	static void print(std::ostream &stream);
+};
+
+}; // END of namespace synfig
+
+/* === E N D =============================================================== */
+
+#endif
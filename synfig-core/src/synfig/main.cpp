@@ -209,6 +209,10 @@ synfig::Main::Main(const synfig::String& basepath,ProgressCallback *cb):
 
 	//_config_search_path=new vector"string.h"();
 
+	// Importers decode in background threads
+	if (!Glib::thread_supported())
+		Glib::thread_init();
+
 	// Init the subsystems
 	if(cb)cb->amount_complete(0, 100);
 
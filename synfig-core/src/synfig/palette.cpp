@@ -35,6 +35,9 @@
 #include "surface.h"
 #include "general.h"
 #include "gamma.h"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -73,6 +76,149 @@ bool luma_less_than(const PaletteItem& lhs,const float& rhs)
 
 /* === P R O C E D U R E S ================================================= */
 
+//! Number of levels of the color channels in the cache of PaletteLookup
+#define LOOKUP_LEVELS		32
+//! Number of levels of the alpha channel in the cache of PaletteLookup
+#define LOOKUP_ALPHA_LEVELS	4
+
+namespace {
+
+/*!	\class Octree
+**	\brief Color quantizer
+**
+**	Colors are sorted in a tree, one level per bit of their 8 bits
+**	channels. When there are too many leaves, the children of the
+**	deepest node are merged into it.
+*/
+class Octree
+{
+	enum { DEPTH=6 };
+
+	struct Node
+	{
+		Node *kids[8];
+		//! Next node of the same level which may be reduced
+		Node *next;
+		bool leaf;
+		int count;
+		double r, g, b, a;
+
+		Node(): next(0), leaf(false), count(0), r(0), g(0), b(0), a(0)
+			{ memset(kids, 0, sizeof(kids)); }
+	};
+
+	int max_leaves;
+	int leaves;
+	Node *root;
+	Node *reducible[DEPTH];
+	std::vector<Node*> nodes;
+
+	Node *new_node(int level)
+	{
+		Node *node(new Node());
+		nodes.push_back(node);
+		if(level==DEPTH)
+		{
+			node->leaf=true;
+			leaves++;
+		}
+		else
+		{
+			node->next=reducible[level];
+			reducible[level]=node;
+		}
+		return node;
+	}
+
+	//! Merges the children of the deepest reducible node
+	void reduce()
+	{
+		int level(DEPTH-1);
+		while(level>0 && !reducible[level])
+			level--;
+		Node *node(reducible[level]);
+		reducible[level]=node->next;
+
+		for(int i=0;i<8;i++)
+			if(Node *kid=node->kids[i])
+			{
+				node->count+=kid->count;
+				node->r+=kid->r;
+				node->g+=kid->g;
+				node->b+=kid->b;
+				node->a+=kid->a;
+				node->kids[i]=0;
+				leaves--;
+			}
+		node->leaf=true;
+		leaves++;
+	}
+
+	void collect(const Node *node, Palette &palette)const
+	{
+		if(node->leaf)
+		{
+			if(node->count)
+				palette.push_back(PaletteItem(Color(
+					node->r/node->count,
+					node->g/node->count,
+					node->b/node->count,
+					node->a/node->count), node->count));
+			return;
+		}
+		for(int i=0;i<8;i++)
+			if(node->kids[i])
+				collect(node->kids[i],palette);
+	}
+
+public:
+	Octree(int max_leaves): max_leaves(max<int>(max_leaves,1)), leaves(0)
+	{
+		for(int i=0;i<DEPTH;i++)
+			reducible[i]=0;
+		root=new_node(0);
+	}
+
+	~Octree()
+	{
+		for(std::vector<Node*>::iterator i=nodes.begin();i!=nodes.end();++i)
+			delete *i;
+	}
+
+	//! Adds a color, which must be clamped
+	void add(const Color &color)
+	{
+		const int r(int(color.get_r()*255.0f+0.5f));
+		const int g(int(color.get_g()*255.0f+0.5f));
+		const int b(int(color.get_b()*255.0f+0.5f));
+
+		Node *node(root);
+		for(int level=0;!node->leaf;level++)
+		{
+			const int shift(7-level);
+			const int i((((r>>shift)&1)<<2)|(((g>>shift)&1)<<1)|((b>>shift)&1));
+			if(!node->kids[i])
+				node->kids[i]=new_node(level+1);
+			node=node->kids[i];
+		}
+
+		node->count++;
+		node->r+=color.get_r();
+		node->g+=color.get_g();
+		node->b+=color.get_b();
+		node->a+=color.get_a();
+
+		while(leaves>max_leaves)
+			reduce();
+	}
+
+	//! Appends the average color of each leaf to \a palette
+	void get_colors(Palette &palette)const
+		{ collect(root,palette); }
+};
+
+}
+
 /* === M E T H O D S ======================================================= */
 
 Palette::Palette():
@@ -96,93 +242,23 @@ Palette::Palette(const Surface& surface, int max_colors):
 	name_(_("Surface Palette"))
 {
 	max_colors-=2;
-	for(int i=0;(signed)size()<(max_colors-1) && i<max_colors*16;++i) {
-        int x=rand()%surface.get_w();
-        int y=rand()%surface.get_h();
-
-			float dist;
-			Color color(surface[y][x]);
-
-			if(empty())
-			{
-				push_back(color);
-				continue;
-			}
-
-			if(color.get_a()==0)
-			{
-				if(front().color.get_a()!=0)
-					insert(begin(),Color(1,0,1,0));
-				front().weight+=400;
-				continue;
-			}
-
-			iterator iter(find_closest(color,&dist));
-			if(sqrt(dist)<0.005)
-			{
-				iter->add(color);
-				continue;
-			}
-
-			/*if(size()>=max_colors)
-			{
-				iterator iterlight(find_light());
-				PaletteItem light(*iterlight);
-				erase(iterlight);
-				find_closest(light.color)->add(light.color,light.weight);
-			}
-			*/
 
-			push_back(color);
-			continue;
-    }
-
-/*
-
-	max_colors-=2;
+	Octree octree(max_colors-1);
+	int transparent(0);
 	for(int y=0;y<surface.get_h();y++)
 		for(int x=0;x<surface.get_w();x++)
 		{
-			float dist;
-			Color color(surface[y][x]);
-
-			if(empty())
-			{
-				push_back(color);
-				continue;
-			}
-
+			const Color &color(surface[y][x]);
 			if(color.get_a()==0)
-			{
-				if(front().color.get_a()!=0)
-					insert(begin(),Color(1,0,1,0));
-				front().weight+=400;
-				continue;
-			}
-
-			iterator iter(find_closest(color,&dist));
-			if(sqrt(dist)<0.005)
-			{
-				iter->add(color);
-				continue;
-			}
-
-
-			push_back(color);
-			continue;
+				transparent++;
+			else
+				octree.add(color.clamped());
 		}
-	sort(rbegin(),rend());
 
-	iterator iter;
+	if(transparent)
+		push_back(PaletteItem(Color(1,0,1,0),transparent));
+	octree.get_colors(*this);
 
-	iterator best_match(begin());
-	while((signed)size()>max_colors)
-	{
-		PaletteItem item(back());
-		pop_back();
-		find_closest(item.color)->add(item.color,item.weight);
-	}
-*/
 	push_back(Color::black());
 	push_back(Color::white());
 
@@ -277,6 +353,40 @@ Palette::find_light()
 	return best_match;
 }
 
+PaletteLookup::PaletteLookup():
+	palette_(0)
+{
+}
+
+void
+PaletteLookup::reset(const Palette &palette)
+{
+	palette_=&palette;
+	cache_.assign(LOOKUP_LEVELS*LOOKUP_LEVELS*LOOKUP_LEVELS*LOOKUP_ALPHA_LEVELS,-1);
+}
+
+int
+PaletteLookup::find_closest(const Color& color)
+{
+	const Color c(color.clamped());
+
+	// The grid is finer in the dark colors
+	const int r(int(sqrtf(c.get_r())*(LOOKUP_LEVELS-1)+0.5f));
+	const int g(int(sqrtf(c.get_g())*(LOOKUP_LEVELS-1)+0.5f));
+	const int b(int(sqrtf(c.get_b())*(LOOKUP_LEVELS-1)+0.5f));
+	const int a(int(c.get_a()*(LOOKUP_ALPHA_LEVELS-1)+0.5f));
+
+	int &index(cache_[((a*LOOKUP_LEVELS+r)*LOOKUP_LEVELS+g)*LOOKUP_LEVELS+b]);
+	if(index<0)
+	{
+		const float rf(float(r)/(LOOKUP_LEVELS-1));
+		const float gf(float(g)/(LOOKUP_LEVELS-1));
+		const float bf(float(b)/(LOOKUP_LEVELS-1));
+		index=palette_->find_closest(Color(rf*rf,gf*gf,bf*bf,float(a)/(LOOKUP_ALPHA_LEVELS-1)))-palette_->begin();
+	}
+	return index;
+}
+
 Palette
 Palette::grayscale(int steps)
 {
@@ -69,7 +69,7 @@ public:
 	Palette(const String& name_);
 
 	/*! Generates a palette for the given
-	**	surface
+	**	surface, quantizing its colors with an octree
 	*/
 	Palette(const Surface& surface, int size=256);
 
@@ -87,6 +87,28 @@ public:
 	static Palette load_from_file(const synfig::String& filename);
 }; // END of class Palette
 
+/*!	\class PaletteLookup
+**	\brief Caches the closest colors of a palette
+**
+**	Colors are rounded to a grid of 32 levels per color channel and 4
+**	levels of alpha. The palette is searched once per cell of the grid,
+**	which is then answered from the cache.
+*/
+class PaletteLookup
+{
+	const Palette *palette_;
+	std::vector<int> cache_;
+
+public:
+	PaletteLookup();
+
+	//! Uses \a palette and forgets the cached colors
+	void reset(const Palette &palette);
+
+	//! Returns the index of the closest color of the palette
+	int find_closest(const Color& color);
+}; // END of class PaletteLookup
+
 }; // END of namespace synfig
 
 /* === E N D =============================================================== */
@@ -426,6 +426,16 @@ RendDesc &
 RendDesc::set_render_excluded_contexts(bool x)
 { render_excluded_contexts=x; return *this; }
 
+//! Return the status of the half_float flag
+const bool &
+RendDesc::get_half_float()const
+{ return half_float; }
+
+//! Set the half_float flag
+RendDesc &
+RendDesc::set_half_float(bool x)
+{ half_float=x; return *this; }
+
 //! Set constraint flags
 RendDesc &
 RendDesc::set_flags(const int &x)
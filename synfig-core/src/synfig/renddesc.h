@@ -107,6 +107,8 @@ private:
 	bool clamp;
 	//! When \c true layers with exclude_from_rendering flag should be rendered
 	bool render_excluded_contexts;
+	//! When \c true intermediate surfaces are held in half floats
+	bool half_float;
 	//! Frame rate of the composition to be rendered
 	float frame_rate;
 	//! Begin time and end time of the Composition to render
@@ -140,6 +142,7 @@ public:
 		interlaced	(false),
 		clamp		(false),
 		render_excluded_contexts(false),
+		half_float	(false),
 		frame_rate	(24),
 		time_begin	(0),
 		time_end	(0),
@@ -262,6 +265,12 @@ public:
 	//! Set the render_excluded_contexts flag
 	RendDesc &set_render_excluded_contexts(bool x);
 
+	//! Return the status of the half_float flag
+	const bool &get_half_float()const;
+
+	//! Set the half_float flag
+	RendDesc &set_half_float(bool x);
+
 	//! Set constraint flags
 	RendDesc &set_flags(const int &x);
 
@@ -36,6 +36,7 @@
 #endif
 
 #include "savecanvas.h"
+#include "canvasbinary.h"
 #include "general.h"
 #include "valuenode.h"
 #include "valuenodes/valuenode_animated.h"
@@ -66,6 +67,8 @@
 #include <ETL/stringf>
 #include "gradient.h"
 #include <errno.h>
+#include <cmath>
+#include <memory>
 
 extern "C" {
 #include <libxml/tree.h>
@@ -81,8 +84,8 @@ using namespace synfig;
 
 /* === M A C R O S ========================================================= */
 
-#define COLOR_VALUE_TYPE_FORMAT		"%f"
-#define	VECTOR_VALUE_TYPE_FORMAT	"%0.10f"
+#define COLOR_VALUE_TYPE_DIGITS		6
+#define	VECTOR_VALUE_TYPE_DIGITS	10
 #define	TIME_TYPE_FORMAT			"%0.3f"
 #define	VIEW_BOX_FORMAT				"%f %f %f %f"
 
@@ -95,6 +98,40 @@ void *save_canvas_external_file_user_data = NULL;
 
 /* === P R O C E D U R E S ================================================= */
 
+//! Same as strprintf("%.*f",digits,x), without printf for the usual values
+static String
+real_to_string(Real x, int digits)
+{
+	static const double powers_of_ten[]={
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10 };
+
+	if(digits<0 || digits>10)
+		return strprintf("%.*f",digits,x);
+
+	// Below 2^45 the scaled value is within 2^-8 of the exact one, so it
+	// rounds the same way as printf unless it is close to a tie
+	const double scaled(fabs(x)*powers_of_ten[digits]);
+	if(!(scaled<35184372088832.0) || fabs(scaled-floor(scaled)-0.5)<1.0/64)
+		return strprintf("%.*f",digits,x);
+
+	const unsigned long long scale((unsigned long long)powers_of_ten[digits]);
+	const unsigned long long n((unsigned long long)(scaled+0.5));
+	unsigned long long integer(n/scale), fraction(n%scale);
+
+	char buffer[32];
+	char *p(buffer+sizeof(buffer));
+	for(int i=0;i<digits;i++,fraction/=10)
+		*--p='0'+(char)(fraction%10);
+	if(digits>0)
+		*--p='.';
+	do
+		*--p='0'+(char)(integer%10);
+	while(integer/=10);
+	if(x<0 || (x==0 && 1.0/x<0))
+		*--p='-';
+	return String(p,buffer+sizeof(buffer));
+}
+
 xmlpp::Element* encode_canvas(xmlpp::Element* root,Canvas::ConstHandle canvas);
 xmlpp::Element* encode_value_node(xmlpp::Element* root,ValueNode::ConstHandle value_node,Canvas::ConstHandle canvas);
 xmlpp::Element* encode_value_node_bone(xmlpp::Element* root,ValueNode::ConstHandle value_node,Canvas::ConstHandle canvas);
@@ -152,7 +189,7 @@ xmlpp::Element* encode_static(xmlpp::Element* root,bool s)
 xmlpp::Element* encode_real(xmlpp::Element* root,Real v)
 {
 	root->set_name("real");
-	root->set_attribute("value",strprintf(VECTOR_VALUE_TYPE_FORMAT,v));
+	root->set_attribute("value",real_to_string(v,VECTOR_VALUE_TYPE_DIGITS));
 	return root;
 }
 
@@ -187,25 +224,25 @@ xmlpp::Element* encode_string(xmlpp::Element* root,const String &str)
 xmlpp::Element* encode_vector(xmlpp::Element* root,Vector vect)
 {
 	root->set_name("vector");
-	root->add_child("x")->set_child_text(strprintf(VECTOR_VALUE_TYPE_FORMAT,(float)vect[0]));
-	root->add_child("y")->set_child_text(strprintf(VECTOR_VALUE_TYPE_FORMAT,(float)vect[1]));
+	root->add_child("x")->set_child_text(real_to_string((float)vect[0],VECTOR_VALUE_TYPE_DIGITS));
+	root->add_child("y")->set_child_text(real_to_string((float)vect[1],VECTOR_VALUE_TYPE_DIGITS));
 	return root;
 }
 
 xmlpp::Element* encode_color(xmlpp::Element* root,Color color)
 {
 	root->set_name("color");
-	root->add_child("r")->set_child_text(strprintf(COLOR_VALUE_TYPE_FORMAT,(float)color.get_r()));
-	root->add_child("g")->set_child_text(strprintf(COLOR_VALUE_TYPE_FORMAT,(float)color.get_g()));
-	root->add_child("b")->set_child_text(strprintf(COLOR_VALUE_TYPE_FORMAT,(float)color.get_b()));
-	root->add_child("a")->set_child_text(strprintf(COLOR_VALUE_TYPE_FORMAT,(float)color.get_a()));
+	root->add_child("r")->set_child_text(real_to_string((float)color.get_r(),COLOR_VALUE_TYPE_DIGITS));
+	root->add_child("g")->set_child_text(real_to_string((float)color.get_g(),COLOR_VALUE_TYPE_DIGITS));
+	root->add_child("b")->set_child_text(real_to_string((float)color.get_b(),COLOR_VALUE_TYPE_DIGITS));
+	root->add_child("a")->set_child_text(real_to_string((float)color.get_a(),COLOR_VALUE_TYPE_DIGITS));
 	return root;
 }
 
 xmlpp::Element* encode_angle(xmlpp::Element* root,Angle theta)
 {
 	root->set_name("angle");
-	root->set_attribute("value",strprintf("%f",(float)Angle::deg(theta).get()));
+	root->set_attribute("value",real_to_string((float)Angle::deg(theta).get(),6));
 	return root;
 }
 
@@ -262,7 +299,7 @@ xmlpp::Element* encode_gradient(xmlpp::Element* root,Gradient x)
 	for(iter=x.begin();iter!=x.end();iter++)
 	{
 		xmlpp::Element *cpoint(encode_color(root->add_child("color"),iter->color));
-		cpoint->set_attribute("pos",strprintf("%f",iter->pos));
+		cpoint->set_attribute("pos",real_to_string(iter->pos,6));
 	}
 	return root;
 }
@@ -485,13 +522,13 @@ xmlpp::Element* encode_animated(xmlpp::Element* root,ValueNode_Animated::ConstHa
 			error("Unknown waypoint type for \"after\" attribute");
 
 		if(iter->get_tension()!=0.0)
-			waypoint_node->set_attribute("tension",strprintf("%f",iter->get_tension()));
+			waypoint_node->set_attribute("tension",real_to_string(iter->get_tension(),6));
 		if(iter->get_temporal_tension()!=0.0)
-			waypoint_node->set_attribute("temporal-tension",strprintf("%f",iter->get_temporal_tension()));
+			waypoint_node->set_attribute("temporal-tension",real_to_string(iter->get_temporal_tension(),6));
 		if(iter->get_continuity()!=0.0)
-			waypoint_node->set_attribute("continuity",strprintf("%f",iter->get_continuity()));
+			waypoint_node->set_attribute("continuity",real_to_string(iter->get_continuity(),6));
 		if(iter->get_bias()!=0.0)
-			waypoint_node->set_attribute("bias",strprintf("%f",iter->get_bias()));
+			waypoint_node->set_attribute("bias",real_to_string(iter->get_bias(),6));
 
 	}
 
@@ -517,7 +554,7 @@ xmlpp::Element* encode_subtract(xmlpp::Element* root,ValueNode_Subtract::ConstHa
 		warning("LHS is equal to RHS, this <subtract> will always be zero!");
 
 	//if(value_node->get_scalar()!=1)
-	//	root->set_attribute("scalar",strprintf(VECTOR_VALUE_TYPE_FORMAT,value_node->get_scalar()));
+	//	root->set_attribute("scalar",real_to_string(value_node->get_scalar(),VECTOR_VALUE_TYPE_DIGITS));
 
 	if(!scalar->get_id().empty())
 		root->set_attribute("scalar",scalar->get_relative_id(canvas));
@@ -927,7 +964,68 @@ xmlpp::Element* encode_layer(xmlpp::Element* root,Layer::ConstHandle layer)
 	return root;
 }
 
+namespace {
+
+//! Where encode_canvas_children() puts the children of a canvas
+class CanvasChildren
+{
+public:
+	virtual ~CanvasChildren() { }
+	//! Returns a new child element named \a name
+	virtual xmlpp::Element* add(const String &name)=0;
+	//! The last added child is complete
+	virtual void done() { }
+};
+
+//! Adds the children to the canvas element
+class ElementChildren : public CanvasChildren
+{
+	xmlpp::Element *root;
+public:
+	explicit ElementChildren(xmlpp::Element *root): root(root) { }
+	virtual xmlpp::Element* add(const String &name) { return root->add_child(name); }
+};
+
+//! Writes each child to a stream as soon as it is complete
+class StreamChildren : public CanvasChildren
+{
+	std::ostream &stream;
+	std::auto_ptr<xmlpp::Document> document;
+public:
+	explicit StreamChildren(std::ostream &stream): stream(stream) { }
+
+	virtual xmlpp::Element* add(const String &name)
+	{
+		document.reset(new xmlpp::Document());
+		return document->create_root_node(name);
+	}
+
+	virtual void done()
+	{
+		xmlBufferPtr buffer(xmlBufferCreate());
+		xmlNodeDump(buffer,document->cobj(),xmlDocGetRootElement(document->cobj()),1,1);
+		stream << "  ";
+		stream.write((const char*)xmlBufferContent(buffer),xmlBufferLength(buffer));
+		stream << "\n";
+		xmlBufferFree(buffer);
+		document.reset();
+	}
+};
+
+}; // END of anonymous namespace
+
+xmlpp::Element* encode_canvas_header(xmlpp::Element* root,Canvas::ConstHandle canvas);
+void encode_canvas_children(CanvasChildren &children,Canvas::ConstHandle canvas);
+
 xmlpp::Element* encode_canvas(xmlpp::Element* root,Canvas::ConstHandle canvas)
+{
+	ElementChildren children(encode_canvas_header(root,canvas));
+	encode_canvas_children(children,canvas);
+	return root;
+}
+
+//! Sets the name and the attributes of the canvas element
+xmlpp::Element* encode_canvas_header(xmlpp::Element* root,Canvas::ConstHandle canvas)
 {
 	assert(canvas);
 	const RendDesc &rend_desc=canvas->rend_desc();
@@ -975,7 +1073,6 @@ xmlpp::Element* encode_canvas(xmlpp::Element* root,Canvas::ConstHandle canvas)
 		root->set_attribute("end-time",rend_desc.get_time_end().get_string(rend_desc.get_frame_rate()));
 
 	if(!canvas->is_inline())
-	{
 		root->set_attribute("bgcolor",strprintf(VIEW_BOX_FORMAT,
 			rend_desc.get_bg_color().get_r(),
 			rend_desc.get_bg_color().get_g(),
@@ -983,29 +1080,50 @@ xmlpp::Element* encode_canvas(xmlpp::Element* root,Canvas::ConstHandle canvas)
 			rend_desc.get_bg_color().get_a())
 		);
 
+	return root;
+}
+
+//! Encodes the contents of the canvas into \a children, one child at a time
+void encode_canvas_children(CanvasChildren &children,Canvas::ConstHandle canvas)
+{
+	if(!canvas->is_inline())
+	{
 		if(!canvas->get_name().empty())
-			root->add_child("name")->set_child_text(canvas->get_name());
+		{
+			children.add("name")->set_child_text(canvas->get_name());
+			children.done();
+		}
 		if(!canvas->get_description().empty())
-			root->add_child("desc")->set_child_text(canvas->get_description());
+		{
+			children.add("desc")->set_child_text(canvas->get_description());
+			children.done();
+		}
 		if(!canvas->get_author().empty())
-			root->add_child("author")->set_child_text(canvas->get_description());
+		{
+			children.add("author")->set_child_text(canvas->get_description());
+			children.done();
+		}
 
 		std::list<String> meta_keys(canvas->get_meta_data_keys());
 		while(!meta_keys.empty())
 		{
-			xmlpp::Element* meta_element(root->add_child("meta"));
+			xmlpp::Element* meta_element(children.add("meta"));
 			meta_element->set_attribute("name",meta_keys.front());
 			meta_element->set_attribute("content",canvas->get_meta_data(meta_keys.front()));
+			children.done();
 			meta_keys.pop_front();
 		}
 		for(KeyframeList::const_iterator iter=canvas->keyframe_list().begin();iter!=canvas->keyframe_list().end();++iter)
-			encode_keyframe(root->add_child("keyframe"),*iter,canvas->rend_desc().get_frame_rate());
+		{
+			encode_keyframe(children.add("keyframe"),*iter,canvas->rend_desc().get_frame_rate());
+			children.done();
+		}
 	}
 
 	// Output the <bones> section
 	if((!canvas->is_inline() && !ValueNode_Bone::get_bone_map(canvas).empty()))
 	{
-		xmlpp::Element *node=root->add_child("bones");
+		xmlpp::Element *node=children.add("bones");
 
 		encode_value_node_bone(node->add_child("value_node"),ValueNode_Bone::get_root_bone(),canvas);
 
@@ -1015,6 +1133,7 @@ xmlpp::Element* encode_canvas(xmlpp::Element* root,Canvas::ConstHandle canvas)
 			ValueNode_Bone::Handle bone(*iter);
 			encode_value_node_bone(node->add_child("value_node"),bone,canvas);
 		}
+		children.done();
 	}
 
 	// Output the <defs> section
@@ -1030,7 +1149,7 @@ xmlpp::Element* encode_canvas(xmlpp::Element* root,Canvas::ConstHandle canvas)
 
 	if((!canvas->is_inline() && !canvas->value_node_list().empty()) || !canvas->children().empty())
 	{
-		xmlpp::Element *node=root->add_child("defs");
+		xmlpp::Element *node=children.add("defs");
 		const ValueNodeList &value_node_list(canvas->value_node_list());
 
 		for(ValueNodeList::const_iterator iter=value_node_list.begin();iter!=value_node_list.end();++iter)
@@ -1050,14 +1169,16 @@ xmlpp::Element* encode_canvas(xmlpp::Element* root,Canvas::ConstHandle canvas)
 		{
 			encode_canvas(node->add_child("canvas"),*iter);
 		}
+		children.done();
 	}
 
 	Canvas::const_reverse_iterator iter;
 
 	for(iter=canvas->rbegin();iter!=canvas->rend();++iter)
-		encode_layer(root->add_child("layer"),*iter);
-
-	return root;
+	{
+		encode_layer(children.add("layer"),*iter);
+		children.done();
+	}
 }
 
 xmlpp::Element* encode_canvas_toplevel(xmlpp::Element* root,Canvas::ConstHandle canvas)
@@ -1072,6 +1193,29 @@ xmlpp::Element* encode_canvas_toplevel(xmlpp::Element* root,Canvas::ConstHandle
 	return ret;
 }
 
+//! Writes the canvas as XML, without building the whole document
+void write_canvas_toplevel(std::ostream &stream,Canvas::ConstHandle canvas)
+{
+	valuenode_too_new_count = 0;
+
+	// The start tag is cut from the dump of the childless canvas element
+	xmlpp::Document document;
+	xmlpp::Element* root(encode_canvas_header(document.create_root_node("canvas"),canvas));
+	xmlBufferPtr buffer(xmlBufferCreate());
+	xmlNodeDump(buffer,document.cobj(),root->cobj(),0,1);
+	const String start_tag((const char*)xmlBufferContent(buffer),xmlBufferLength(buffer));
+	xmlBufferFree(buffer);
+
+	stream << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+	stream << start_tag.substr(0,start_tag.size()-2) << ">\n";
+	StreamChildren children(stream);
+	encode_canvas_children(children,canvas);
+	stream << "</canvas>\n";
+
+	if (valuenode_too_new_count)
+		warning("saved %d valuenodes as constant values in old file format\n", valuenode_too_new_count);
+}
+
 bool
 synfig::save_canvas(const FileSystem::Identifier &identifier, Canvas::ConstHandle canvas, bool safe)
 {
@@ -1082,9 +1226,6 @@ synfig::save_canvas(const FileSystem::Identifier &identifier, Canvas::ConstHandl
 	try
 	{
 		assert(canvas);
-		xmlpp::Document document;
-
-		encode_canvas_toplevel(document.create_root_node("canvas"),canvas);
 
 		FileSystem::WriteStreamHandle stream = identifier.file_system->get_write_stream(tmp_filename);
 		if (!stream)
@@ -1093,10 +1234,29 @@ synfig::save_canvas(const FileSystem::Identifier &identifier, Canvas::ConstHandl
 			return false;
 		}
 
-		if (filename_extension(identifier.filename) == ".sifz")
-			stream = FileSystem::WriteStreamHandle(new ZWriteStream(stream));
+		if (filename_extension(identifier.filename) == ".sifb")
+		{
+			// The string table needs the whole document
+			xmlpp::Document document;
+			encode_canvas_toplevel(document.create_root_node("canvas"),canvas);
+			if (!write_binary_canvas(*stream, document))
+			{
+				synfig::error("synfig::save_canvas(): Unable to write binary canvas");
+				return false;
+			}
+		}
+		else
+		{
+			if (filename_extension(identifier.filename) == ".sifz")
+				stream = FileSystem::WriteStreamHandle(new ZWriteStream(stream));
 
-		document.write_to_stream_formatted(*stream, "UTF-8");
+			write_canvas_toplevel(*stream, canvas);
+			if (!stream->good())
+			{
+				synfig::error("synfig::save_canvas(): Unable to write to file");
+				return false;
+			}
+		}
 
 		// close stream
 		stream.reset();
@@ -34,10 +34,15 @@
 
 #include "canvas.h"
 #include "surface.h"
+#include "surfacepool.h"
 #include "target_scanline.h"
 #include "target_cairo.h"
 #include "general.h"
 
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
 #ifdef HAS_VIMAGE
 #include <Accelerate/Accelerate.h>
 #endif
@@ -184,6 +189,80 @@ synfig::Surface::clear()
 #endif
 }
 
+void
+synfig::Surface::release_buffer()
+{
+	SurfacePool::release(pool_buffer_, pool_size_);
+	pool_buffer_=NULL;
+	pool_size_=0;
+}
+
+void
+synfig::Surface::set_wh(size_type::value_type w, size_type::value_type h, const size_type::value_type &pitch)
+{
+	if(!pitch && w && h && pool_buffer_ && w==get_w() && h==get_h() && is_valid() && (void*)(*this)[0]==pool_buffer_)
+		return;
+
+	void *old_buffer(pool_buffer_);
+	size_t old_size(pool_size_);
+
+	const size_type::value_type new_pitch(pitch?pitch:sizeof(Color)*w);
+	size_t size(abs(new_pitch)*h);
+	pool_buffer_=SurfacePool::acquire(size);
+	pool_size_=size;
+	base_type::set_wh(w,h,(unsigned char*)pool_buffer_,new_pitch);
+
+	SurfacePool::release(old_buffer, old_size);
+}
+
+synfig::Surface &
+synfig::Surface::operator=(const Surface &rhs)
+{
+	if(this==&rhs)
+		return *this;
+
+	set_wh(rhs.get_w(),rhs.get_h());
+	if(rhs.is_valid())
+		for(int y=0;y<get_h();y++)
+			memcpy((*this)[y],rhs[y],sizeof(Color)*get_w());
+	return *this;
+}
+
+void
+synfig::HalfSurface::pack(const Surface &x)
+{
+	set_wh(x.get_w(),x.get_h());
+	for(int y=0;y<x.get_h();y++)
+		HalfColor::pack((*this)[y],x[y],x.get_w());
+}
+
+void
+synfig::HalfSurface::unpack(Surface &x)const
+{
+	x.set_wh(get_w(),get_h());
+	for(int y=0;y<get_h();y++)
+		HalfColor::unpack(x[y],(*this)[y],get_w());
+}
+
+void
+synfig::HalfSurface::blit_to(Surface::alpha_pen &pen)const
+{
+	const int w(min((long)get_w(),(long)(pen.end_x()-pen.x())));
+	const int h(min((long)get_h(),(long)(pen.end_y()-pen.y())));
+	if(w<=0 || h<=0)
+		return;
+
+	std::vector<Color> row(w);
+	for(int y=0;y<h;y++,pen.inc_y())
+	{
+		HalfColor::unpack(&row[0],(*this)[y],w);
+		for(int x=0;x<w;x++,pen.inc_x())
+			pen.put_value(row[x]);
+		pen.dec_x(w);
+	}
+	pen.dec_y(h);
+}
+
 void
 synfig::Surface::blit_to(alpha_pen& pen, int x, int y, int w, int h)
 {
@@ -29,6 +29,7 @@
 /* === H E A D E R S ======================================================= */
 
 #include "color.h"
+#include "color/halfcolor.h"
 #include "renddesc.h"
 #include <ETL/pen>
 #include <ETL/surface>
@@ -91,21 +92,38 @@ public:
 */
 class Surface : public etl::surface<Color, ColorAccumulator, ColorPrep>
 {
+	//! The buffer taken from the SurfacePool for the pixels, if any
+	void *pool_buffer_;
+	//! The size of pool_buffer_, in bytes
+	size_t pool_size_;
+
+	//! Gives the pool buffer back, the pixels must not be used anymore
+	void release_buffer();
+
 public:
 	typedef Color value_type;
+	typedef etl::surface<Color, ColorAccumulator, ColorPrep> base_type;
 	class alpha_pen;
 
-	Surface() { }
+	Surface(): pool_buffer_(NULL), pool_size_(0) { }
 
 	Surface(const size_type::value_type &w, const size_type::value_type &h):
-		etl::surface<Color, ColorAccumulator,ColorPrep>(w,h) { }
+		pool_buffer_(NULL), pool_size_(0) { set_wh(w,h); }
 
 	Surface(const size_type &s):
-		etl::surface<Color, ColorAccumulator,ColorPrep>(s) { }
+		pool_buffer_(NULL), pool_size_(0) { set_wh(s.x,s.y); }
 
 	template <typename _pen>
 	Surface(const _pen &_begin, const _pen &_end):
-		etl::surface<Color, ColorAccumulator,ColorPrep>(_begin,_end) { }
+		base_type(_begin,_end), pool_buffer_(NULL), pool_size_(0) { }
+
+	Surface(const Surface &x):
+		base_type(), pool_buffer_(NULL), pool_size_(0) { *this=x; }
+
+	~Surface() { release_buffer(); }
+
+	//! Copies the pixels of \a rhs
+	Surface &operator=(const Surface &rhs);
 
 	template <class _pen> void blit_to(_pen &pen)
 	{ return blit_to(pen,0,0, get_w(),get_h()); }
@@ -119,9 +137,39 @@ public:
 	void clear();
 
 	void blit_to(alpha_pen& DEST_PEN, int x, int y, int w, int h);
+
+	//! Reallocates the surface, its contents are undefined
+	/*!	The pixels are taken from the SurfacePool. Nothing is reallocated
+	**	if the surface already has its own pixels of that size. */
+	void set_wh(size_type::value_type w, size_type::value_type h, const size_type::value_type &pitch=0);
+	//! Uses \a newdata for the pixels, the surface doesn't own them
+	void set_wh(size_type::value_type w, size_type::value_type h, unsigned char* newdata, const size_type::value_type &pitch)
+		{ base_type::set_wh(w, h, newdata, pitch); release_buffer(); }
+
+	//! Shares the pixels of \a rhs, without copying them
+	const Surface &mirror(const Surface &rhs)
+		{ base_type::mirror(rhs); release_buffer(); return *this; }
 };	// END of class Surface
 
 
+/*!	\class HalfSurface
+**	\brief Keeps the pixels of a Surface in half floats
+**
+**	It takes half the memory of a Surface. Used to hold the source of
+**	a blit while the destination is rendered, see RendDesc::get_half_float()
+*/
+class HalfSurface : public etl::surface<HalfColor>
+{
+public:
+	//! Stores the pixels of \a x
+	void pack(const Surface &x);
+	//! Restores the stored pixels into \a x
+	void unpack(Surface &x)const;
+	//! Blends the stored pixels with \a pen, converting a row at a time
+	void blit_to(Surface::alpha_pen &pen)const;
+};	// END of class HalfSurface
+
+
 /*!	\class CairoSurface
  **	\brief Generic Cairo backed surface. It allows to create a image surface
  ** equivalent to the current backend for custom modifications purposes.
@@ -0,0 +1,180 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file surfacepool.cpp
+**	\brief Pool of pixel buffers for surfaces
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include "surfacepool.h"
+#include "mutex.h"
+
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#endif
+
+/* === U S I N G =========================================================== */
+
+using namespace std;
+using namespace synfig;
+
+/* === M A C R O S ========================================================= */
+
+//! Smaller buffers are left to the system allocator
+#define MIN_POOLED_SIZE		(256*1024)
+
+//! Default limit of the memory kept in the pool, in megabytes
+#define DEFAULT_POOL_SIZE	256
+
+/* === G L O B A L S ======================================================= */
+
+namespace {
+
+struct Pool
+{
+	Mutex mutex;
+	//! Unused buffers, by size class
+	map<size_t, vector<void*> > buffers;
+	size_t limit;
+	SurfacePool::Stats stats;
+
+	Pool()
+	{
+		limit = DEFAULT_POOL_SIZE;
+		if (getenv("SYNFIG_SURFACE_POOL_SIZE"))
+			limit = atoi(getenv("SYNFIG_SURFACE_POOL_SIZE"));
+		limit *= 1024*1024;
+
+		stats.in_use = 0;
+		stats.peak = 0;
+		stats.pooled = 0;
+		stats.reused = 0;
+		stats.allocated = 0;
+	}
+};
+
+//! The pool is never destroyed, surfaces may outlive static objects
+Pool& get_pool()
+{
+	static Pool *pool = new Pool();
+	return *pool;
+}
+
+//! Rounds \a size up to its size class, there are eight classes per power of two
+size_t size_class(size_t size)
+{
+	if (size < MIN_POOLED_SIZE)
+		return size;
+	int bits = 0;
+	while ((size >> bits) > 1)
+		bits++;
+	const size_t step = size_t(1) << (bits - 3);
+	return (size + step - 1) & ~(step - 1);
+}
+
+}
+
+/* === M E T H O D S ======================================================= */
+
+void *
+SurfacePool::acquire(size_t &size)
+{
+	size = size_class(size);
+	Pool &pool = get_pool();
+
+	if (size >= MIN_POOLED_SIZE)
+	{
+		Mutex::Lock lock(pool.mutex);
+		pool.stats.in_use += size;
+		if (pool.stats.in_use > pool.stats.peak)
+			pool.stats.peak = pool.stats.in_use;
+
+		map<size_t, vector<void*> >::iterator i = pool.buffers.find(size);
+		if (i != pool.buffers.end() && !i->second.empty())
+		{
+			void *buffer = i->second.back();
+			i->second.pop_back();
+			pool.stats.pooled -= size;
+			pool.stats.reused++;
+			return buffer;
+		}
+		pool.stats.allocated++;
+	}
+
+	return new char[size];
+}
+
+void
+SurfacePool::release(void *buffer, size_t size)
+{
+	if (!buffer)
+		return;
+
+	if (size >= MIN_POOLED_SIZE)
+	{
+		Pool &pool = get_pool();
+		Mutex::Lock lock(pool.mutex);
+		pool.stats.in_use -= size;
+		if (pool.stats.pooled + size <= pool.limit)
+		{
+			pool.buffers[size].push_back(buffer);
+			pool.stats.pooled += size;
+			return;
+		}
+	}
+
+	delete [] (char*)buffer;
+}
+
+void
+SurfacePool::trim()
+{
+	Pool &pool = get_pool();
+	Mutex::Lock lock(pool.mutex);
+	for (map<size_t, vector<void*> >::iterator i = pool.buffers.begin(); i != pool.buffers.end(); ++i)
+		for (vector<void*>::iterator j = i->second.begin(); j != i->second.end(); ++j)
+			delete [] (char*)*j;
+	pool.buffers.clear();
+	pool.stats.pooled = 0;
+}
+
+SurfacePool::Stats
+SurfacePool::get_stats()
+{
+	Pool &pool = get_pool();
+	Mutex::Lock lock(pool.mutex);
+	return pool.stats;
+}
+
+void
+SurfacePool::reset_stats()
+{
+	Pool &pool = get_pool();
+	Mutex::Lock lock(pool.mutex);
+	pool.stats.peak = pool.stats.in_use;
+	pool.stats.reused = 0;
+	pool.stats.allocated = 0;
+}
@@ -0,0 +1,88 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file surfacepool.h
+**	\brief Pool of pixel buffers for surfaces
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === S T A R T =========================================================== */
+
+#ifndef __SYNFIG_SURFACEPOOL_H
+#define __SYNFIG_SURFACEPOOL_H
+
+/* === H E A D E R S ======================================================= */
+
+#include <cstddef>
+
+/* === M A C R O S ========================================================= */
+
+/* === T Y P E D E F S ===================================================== */
+
+/* === C L A S S E S & S T R U C T S ======================================= */
+
+namespace synfig {
+
+/*!	\class SurfacePool
+**	\brief Recycles the pixel buffers of surfaces
+**
+**	Layers create frame sized temporary surfaces on every render call.
+**	Instead of returning their buffers to the system, released buffers
+**	are kept by size class and handed to the next surface of a similar
+**	size, whatever the layer, tile or frame.
+**
+**	Small buffers are not pooled. The memory kept unused is limited by
+**	the SYNFIG_SURFACE_POOL_SIZE environment variable, in megabytes.
+*/
+class SurfacePool
+{
+public:
+	//! Usage of the buffers, in bytes
+	struct Stats
+	{
+		//! Held by surfaces
+		size_t in_use;
+		//! The most ever held by surfaces at once
+		size_t peak;
+		//! Kept in the pool, ready to be reused
+		size_t pooled;
+		//! Number of buffers taken from the pool instead of being allocated
+		size_t reused;
+		//! Number of buffers allocated
+		size_t allocated;
+	};
+
+	//! Returns a buffer of at least \a size bytes
+	/*!	\param size The requested size, replaced by the size of the buffer
+	**		which must be given back to release() */
+	static void *acquire(size_t &size);
+
+	//! Gives back a buffer returned by acquire()
+	static void release(void *buffer, size_t size);
+
+	//! Frees all the buffers kept in the pool
+	static void trim();
+
+	static Stats get_stats();
+
+	//! Starts counting the peak and the buffers again, from the buffers in use
+	static void reset_stats();
+}; // END of class SurfacePool
+
+}; // END of namespace synfig
+
+/* === E N D =============================================================== */
+
+#endif
@@ -30,9 +30,11 @@
 #include "target.h"
 #include "string.h"
 #include "canvas.h"
+#include "context.h"
 #include "target_null.h"
 #include "target_null_tile.h"
 #include "targetparam.h"
+#include <cstdlib>
 
 using namespace synfig;
 using namespace etl;
@@ -110,6 +112,13 @@ synfig::Target::set_canvas(etl::handle<Canvas> c)
 	set_rend_desc(&desc);
 }
 
+bool
+synfig::Target::is_static_between(Time a, Time b)const
+{
+	if(!canvas || getenv("SYNFIG_DISABLE_STATIC_FRAMES"))
+		return false;
+	return canvas->get_independent_context().is_static_between(a,b);
+}
 
 Target::Handle
 Target::create(const String &name, const String &filename,
@@ -242,6 +242,12 @@ public:
 	 **	\sa curr_frame_
 	*/
 	virtual int	next_frame(Time& time);
+
+	//! Returns true if the canvas renders the same at the times \a a and \a b
+	/*!	Used to repeat the previous frame instead of rendering it again.
+	**	Always false when SYNFIG_DISABLE_STATIC_FRAMES is set.
+	*/
+	bool is_static_between(Time a, Time b)const;
 }; // END of class Target
 
 }; // END of namespace synfig
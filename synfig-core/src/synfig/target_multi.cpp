@@ -1,6 +1,6 @@
 /* === S Y N F I G ========================================================= */
 /*!	\file target_multi.cpp
-**	\brief Template File
+**	\brief Target writing the frames to several targets
 **
 **	$Id$
 **
@@ -30,11 +30,17 @@
 #endif
 
 #include "target_multi.h"
+#include "target_tile.h"
+#include "general.h"
 #include "string.h"
 #include "surface.h"
 #include "canvas.h"
 #include "context.h"
 
+#include <glibmm.h>
+#include <cassert>
+#include <new>
+
 #endif
 
 /* === U S I N G =========================================================== */
@@ -49,73 +55,276 @@ using namespace synfig;
 
 /* === P R O C E D U R E S ================================================= */
 
+//! Puts \a surface onto \a target, sets \a error on failure
+/*!	\param repeat \a surface is the same as the previous frame, which the target may repeat
+**	Plain pointers are used, the handles can't be copied from several threads.
+*/
+static void
+put_frame(Target *target, const Surface *surface, bool repeat, String *error)
+{
+	// The targets would read or write past the frame
+	if(target->rend_desc().get_w()!=surface->get_w() || target->rend_desc().get_h()!=surface->get_h())
+	{
+		*error=_("The frame size doesn't match the target");
+		return;
+	}
+
+	try
+	{
+		if(Target_Scanline *scanline=dynamic_cast<Target_Scanline*>(target))
+		{
+			if(repeat && scanline->repeat_frame())
+				;
+			else
+			if(!scanline->add_frame(surface))
+				*error=_("Unable to put surface on target");
+		}
+		else
+		if(Target_Tile *tile=dynamic_cast<Target_Tile*>(target))
+		{
+			if(repeat && tile->repeat_frame())
+				;
+			else
+			if(!tile->start_frame())
+				*error=_("Target panic on start_frame()");
+			else
+			{
+				if(!tile->add_tile(*surface,0,0))
+					*error=_("Unable to put surface on target");
+				tile->end_frame();
+			}
+		}
+	}
+	catch(String str)
+	{
+		*error=str;
+	}
+	catch(std::bad_alloc)
+	{
+		*error=_("Ran out of memory (Probably a bug)");
+	}
+	catch(...)
+	{
+		*error=_("Caught unknown error");
+	}
+}
+
+/* === C L A S S E S ======================================================= */
+
+//! Puts the frames onto one target, from a thread kept for the whole render
+class synfig::Target_Multi::Writer
+{
+	Target *target;
+	const Surface *surface;
+	bool repeat;
+	//! A frame is being put onto the target
+	bool busy;
+	bool quit;
+	String error;
+	Glib::Mutex mutex;
+	Glib::Cond cond;
+	Glib::Thread *thread;
+
+	void run()
+	{
+		Glib::Mutex::Lock lock(mutex);
+		while(true)
+		{
+			while(!busy && !quit)
+				cond.wait(mutex);
+			if(!busy)
+				return;
+
+			String frame_error;
+			lock.release();
+			put_frame(target,surface,repeat,&frame_error);
+			lock.acquire();
+
+			error=frame_error;
+			busy=false;
+			cond.broadcast();
+		}
+	}
+
+public:
+	explicit Writer(Target *target):
+		target(target),
+		surface(NULL),
+		repeat(false),
+		busy(false),
+		quit(false)
+	{
+		thread=Glib::Thread::create(sigc::mem_fun(*this, &Writer::run), true);
+	}
+
+	~Writer()
+	{
+		{
+			Glib::Mutex::Lock lock(mutex);
+			quit=true;
+			cond.broadcast();
+		}
+		thread->join();
+	}
+
+	//! Starts putting \a x onto the target
+	void start(const Surface *x, bool repeat_x)
+	{
+		Glib::Mutex::Lock lock(mutex);
+		surface=x;
+		repeat=repeat_x;
+		busy=true;
+		cond.broadcast();
+	}
+
+	//! Waits until the frame is put onto the target, returns the error if any
+	String wait()
+	{
+		Glib::Mutex::Lock lock(mutex);
+		while(busy)
+			cond.wait(mutex);
+		return error;
+	}
+};
+
 /* === M E T H O D S ======================================================= */
 
-Target_Multi::Target_Multi(Target_Scanline::Handle a,Target_Scanline::Handle b):
-	a(a),
-	b(b),
-	buffer_a(),
-	buffer_b()
+Target_Multi::Target_Multi()
+{
+}
+
+Target_Multi::Target_Multi(Target_Scanline::Handle a,Target_Scanline::Handle b)
 {
+	add_target(a);
+	add_target(b);
 }
 
 Target_Multi::~Target_Multi()
 {
+	stop_writers();
+}
+
+void
+Target_Multi::stop_writers()
+{
+	for(vector<Writer*>::iterator i=writers_.begin();i!=writers_.end();++i)
+		delete *i;
+	writers_.clear();
+}
+
+void
+Target_Multi::add_target(Target::Handle target)
+{
+	assert(Target_Scanline::Handle::cast_dynamic(target) || Target_Tile::Handle::cast_dynamic(target));
+	stop_writers();
+	targets_.push_back(target);
 }
 
 void
 Target_Multi::set_canvas(etl::handle<Canvas> c)
 {
-	canvas=c;
-	RendDesc desc=canvas->rend_desc();
-	a->set_canvas(c);
-	b->set_canvas(c);
-	set_rend_desc(&desc);
+	for(vector<Target::Handle>::iterator i=targets_.begin();i!=targets_.end();++i)
+		(*i)->set_canvas(c);
+	// Then make the targets agree on the render description
+	Target::set_canvas(c);
 }
 
 bool
 Target_Multi::set_rend_desc(RendDesc *d)
 {
+	// The frame is rendered once for all the targets, so they must agree
+	// on its size: pass the description through them until none changes it
+	bool ret(true);
+	for(size_t pass=0;pass<=targets_.size();pass++)
+	{
+		const int w(d->get_w()), h(d->get_h());
+		ret=true;
+		for(vector<Target::Handle>::iterator i=targets_.begin();i!=targets_.end();++i)
+			ret=(*i)->set_rend_desc(d) && ret;
+		if(d->get_w()==w && d->get_h()==h)
+			break;
+	}
 	desc=*d;
-	return a->set_rend_desc(d) && b->set_rend_desc(d);
+
+	for(vector<Target::Handle>::iterator i=targets_.begin();i!=targets_.end();++i)
+		if((*i)->rend_desc().get_w()!=desc.get_w() || (*i)->rend_desc().get_h()!=desc.get_h())
+		{
+			synfig::error("Target_Multi: The targets need different frame sizes, %dx%d and %dx%d",
+				(*i)->rend_desc().get_w(), (*i)->rend_desc().get_h(), desc.get_w(), desc.get_h());
+			return false;
+		}
+	return ret;
 }
 
 bool
-Target_Multi::init()
+Target_Multi::init(ProgressCallback *cb)
 {
-	return a->init() && b->init();
+	error_.clear();
+	for(vector<Target::Handle>::iterator i=targets_.begin();i!=targets_.end();++i)
+		if(!(*i)->init(cb))
+			return false;
+	return true;
 }
 
 bool
-Target_Multi::add_frame(const synfig::Surface *surface)
+Target_Multi::start_frame(ProgressCallback */*cb*/)
 {
-	return a->add_frame(surface) && b->add_frame(surface);
+	if(!error_.empty())
+		return false;
+	frame_.set_wh(desc.get_w(),desc.get_h());
+	return true;
+}
+
+void
+Target_Multi::end_frame()
+{
+	put_frames(false);
 }
 
 bool
-Target_Multi::start_frame(ProgressCallback *cb)
+Target_Multi::repeat_frame()
 {
-	return a->start_frame(cb) && b->start_frame(cb);
+	// frame_ still holds the previous frame, for the targets which can't repeat it
+	if(!error_.empty())
+		return false;
+	put_frames(true);
+	return true;
 }
 
 void
-Target_Multi::end_frame()
+Target_Multi::put_frames(bool repeat)
 {
-	a->end_frame();
-	b->end_frame();
+	if(targets_.empty())
+		return;
+
+	// The first target is written on this thread, the others on their own
+	if(writers_.empty())
+		for(size_t i=1;i<targets_.size();i++)
+			writers_.push_back(new Writer(targets_[i].get()));
+
+	vector<String> errors(targets_.size());
+	for(size_t i=1;i<targets_.size();i++)
+		writers_[i-1]->start(&frame_,repeat);
+	put_frame(targets_[0].get(),&frame_,repeat,&errors[0]);
+	for(size_t i=1;i<targets_.size();i++)
+		errors[i]=writers_[i-1]->wait();
+
+	for(vector<String>::iterator i=errors.begin();i!=errors.end();++i)
+		if(!i->empty())
+		{
+			error_=*i;
+			throw error_;
+		}
 }
 
 Color *
 Target_Multi::start_scanline(int scanline)
 {
-	buffer_a=a->start_scanline(scanline);
-	buffer_b=b->start_scanline(scanline);
-	return buffer_a;
+	return frame_[scanline];
 }
 
 bool
 Target_Multi::end_scanline()
 {
-	memcpy(buffer_b,buffer_a,sizeof(Color)*desc.get_w());
-	return a->end_scanline() && b->end_scanline();
+	return true;
 }
@@ -1,6 +1,6 @@
 /* === S Y N F I G ========================================================= */
 /*!	\file target_multi.h
-**	\brief Template Header
+**	\brief Target writing the frames to several targets
 **
 **	$Id$
 **
@@ -28,6 +28,8 @@
 /* === H E A D E R S ======================================================= */
 
 #include "target_scanline.h"
+#include "surface.h"
+#include <vector>
 
 /* === M A C R O S ========================================================= */
 
@@ -38,27 +40,52 @@
 namespace synfig {
 
 /*!	\class Target_Multi
-**	\brief Render-target
-**	\todo writeme
+**	\brief Renders once to several targets
+**
+**	Each frame is rendered once, then put onto all the targets at the
+**	same time, each one on its own thread. The targets may be scanline
+**	or tile targets, and convert the colors to their own pixel format
+**	and gamma. They must all accept the same frame size.
 */
 class Target_Multi : public Target_Scanline
 {
-	Target_Scanline::Handle a,b;
-	Color *buffer_a;
-	Color *buffer_b;
-public:
+	class Writer;
+
+	std::vector<Target::Handle> targets_;
+	//! Threads putting the frames onto the targets after the first one
+	std::vector<Writer*> writers_;
+	//! The frame being rendered
+	Surface frame_;
+	//! Set when a target failed to write a frame
+	String error_;
+
+	//! Puts frame_ onto all the targets, throws a String on error
+	void put_frames(bool repeat);
+	//! Stops the writer threads
+	void stop_writers();
 
+public:
+	Target_Multi();
 	Target_Multi(Target_Scanline::Handle a,Target_Scanline::Handle b);
 	virtual ~Target_Multi();
-	virtual bool add_frame(const synfig::Surface *surface);
+
+	//! Adds a target, which must be a Target_Scanline or a Target_Tile
+	void add_target(Target::Handle target);
+	//! Gets the targets
+	const std::vector<Target::Handle> &get_targets()const { return targets_; }
+
 	virtual bool start_frame(ProgressCallback *cb=NULL);
+	//! Puts the frame onto all the targets, throws a String on error
 	virtual void end_frame();
+	//! Lets the targets repeat the previous frame, or puts it again
+	virtual bool repeat_frame();
 	virtual Color * start_scanline(int scanline);
 	virtual bool end_scanline();
 
 	virtual void set_canvas(etl::handle<Canvas> c);
+	//! Lets every target adjust \a d, until they all agree on it
 	virtual bool set_rend_desc(RendDesc *d);
-	virtual bool init();
+	virtual bool init(ProgressCallback *cb=NULL);
 }; // END of class Target_Multi
 
 }; // END of namespace synfig
@@ -38,6 +38,19 @@
 #include "canvas.h"
 #include "context.h"
 
+#include <ETL/stringf>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <set>
+#include <glibmm.h>
+#include <stdint.h>
+
 #endif
 
 /* === U S I N G =========================================================== */
@@ -64,10 +77,320 @@ using namespace synfig;
 
 /* === P R O C E D U R E S ================================================= */
 
+namespace {
+
+const uint64_t PRIME64_1=11400714785074694791ULL;
+const uint64_t PRIME64_2=14029467366897019727ULL;
+const uint64_t PRIME64_3=1609587929392839161ULL;
+const uint64_t PRIME64_4=9650029242287828579ULL;
+const uint64_t PRIME64_5=2870177450012600261ULL;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x<<r)|(x>>(64-r)); }
+
+inline uint64_t read64(const unsigned char *p) { uint64_t x; memcpy(&x,p,sizeof(x)); return x; }
+
+inline uint64_t hash_round(uint64_t acc, uint64_t input)
+	{ return rotl(acc+input*PRIME64_2,31)*PRIME64_1; }
+
+inline uint64_t hash_merge(uint64_t h, uint64_t v)
+	{ return (h^hash_round(0,v))*PRIME64_1+PRIME64_4; }
+
+//! Hashes \a size bytes, the way XXH64 does
+uint64_t
+hash_bytes(uint64_t seed, const unsigned char *p, size_t size)
+{
+	const unsigned char *const end(p+size);
+	uint64_t h;
+
+	if(size>=32)
+	{
+		uint64_t v1(seed+PRIME64_1+PRIME64_2), v2(seed+PRIME64_2), v3(seed), v4(seed-PRIME64_1);
+		for(;p+32<=end;p+=32)
+		{
+			v1=hash_round(v1,read64(p));
+			v2=hash_round(v2,read64(p+8));
+			v3=hash_round(v3,read64(p+16));
+			v4=hash_round(v4,read64(p+24));
+		}
+		h=rotl(v1,1)+rotl(v2,7)+rotl(v3,12)+rotl(v4,18);
+		h=hash_merge(h,v1);
+		h=hash_merge(h,v2);
+		h=hash_merge(h,v3);
+		h=hash_merge(h,v4);
+	}
+	else
+		h=seed+PRIME64_5;
+
+	h+=size;
+	for(;p+8<=end;p+=8)
+		h=rotl(h^hash_round(0,read64(p)),27)*PRIME64_1+PRIME64_4;
+	for(;p<end;p++)
+		h=rotl(h^(*p*PRIME64_5),11)*PRIME64_1;
+
+	h^=h>>33;
+	h*=PRIME64_2;
+	h^=h>>29;
+	h*=PRIME64_3;
+	h^=h>>32;
+	return h;
+}
+
+//! Tells if \a surface has the same pixels as the previous frame
+/*!	\param last_hash The hash of the previous frame, replaced by the one of \a surface */
+bool
+is_duplicate(const Surface &surface, uint64_t &last_hash, bool &has_last)
+{
+	uint64_t hash(surface.get_w()*PRIME64_1+surface.get_h());
+	for(int y=0;y<surface.get_h();y++)
+		hash=hash_bytes(hash,(const unsigned char*)surface[y],surface.get_w()*sizeof(Color));
+
+	const bool duplicate(has_last && hash==last_hash);
+	last_hash=hash;
+	has_last=true;
+	return duplicate;
+}
+
+}
+
+/* === C L A S S E S ======================================================= */
+
+//! Puts the rendered frames onto the target from separate threads
+class synfig::Target_Scanline::FrameWriter
+{
+	//! Pixels shared by the frames with the same ones, see push()
+	struct Pixels
+	{
+		Surface *surface;
+		//! The frames using them, plus one while they are the last pushed
+		int users;
+	};
+
+	struct Frame
+	{
+		Pixels *pixels;
+		//! Number of the frame in the sequence
+		int number;
+		//! Writes the frame when they are written in parallel
+		Target_Scanline::Handle target;
+		//! Has the same pixels as the previous frame
+		bool duplicate;
+	};
+
+	Target_Scanline &target;
+	//! The most frames waiting to be written, including the ones being written
+	const size_t max_frames;
+	//! Each frame is written by its own target, several at once
+	bool parallel;
+	std::deque<Frame> frames;
+	//! The pixels of the last frame pushed
+	Pixels *last_pixels;
+	//! Number of frames being written
+	size_t writing;
+	//! The frames before it are all written, once a frame was pushed
+	int first_unwritten;
+	bool has_first;
+	//! Frames written after first_unwritten
+	std::set<int> written;
+	Glib::Mutex mutex;
+	Glib::Cond cond;
+	std::vector<Glib::Thread*> threads;
+	bool finished;
+	bool cancelled;
+	bool failed;
+	String error;
+
+	void run()
+	{
+		while(true)
+		{
+			Frame frame;
+			{
+				Glib::Mutex::Lock lock(mutex);
+				while(frames.empty() && !finished && !cancelled && !failed)
+					cond.wait(mutex);
+				if(frames.empty() || cancelled || failed)
+					return;
+				frame=frames.front();
+				frames.pop_front();
+				writing++;
+			}
+
+			String frame_error;
+			try
+			{
+				if(frame.duplicate && !parallel && target.repeat_frame())
+					;
+				else
+				if(parallel)
+				{
+					// The file of the previous frame can only be repeated once written
+					if(frame.target && frame.duplicate && wait_written(frame.number-1) && frame.target->repeat_frame())
+						;
+					else
+					if(!frame.target || !frame.target->add_frame(frame.pixels->surface))
+						frame_error=_("Unable to put surface on target");
+				}
+				else
+				if(!target.add_frame(frame.pixels->surface))
+					frame_error=_("Unable to put surface on target");
+			}
+			catch(String str)
+			{
+				frame_error=_("Caught string :")+str;
+			}
+			catch(std::bad_alloc)
+			{
+				frame_error=_("Ran out of memory (Probably a bug)");
+			}
+			catch(...)
+			{
+				frame_error=_("Caught unknown error");
+			}
+
+			Glib::Mutex::Lock lock(mutex);
+			release(frame.pixels);
+			frame.target.reset();
+			writing--;
+			written.insert(frame.number);
+			while(written.erase(first_unwritten))
+				first_unwritten++;
+			if(!frame_error.empty())
+			{
+				failed=true;
+				error=frame_error;
+			}
+			cond.broadcast();
+			if(failed)
+				return;
+		}
+	}
+
+	//! Drops a user of \a pixels, needs the mutex
+	static void release(Pixels *pixels)
+	{
+		if(pixels && !--pixels->users)
+		{
+			delete pixels->surface;
+			delete pixels;
+		}
+	}
+
+	//! Waits until the frame \a number is written
+	/*! \return \c false if it never will be */
+	bool wait_written(int number)
+	{
+		Glib::Mutex::Lock lock(mutex);
+		while(first_unwritten<=number && !cancelled && !failed)
+			cond.wait(mutex);
+		return first_unwritten>number;
+	}
+
+	void join()
+	{
+		for(std::vector<Glib::Thread*>::iterator i=threads.begin(); i!=threads.end(); ++i)
+			(*i)->join();
+		threads.clear();
+	}
+
+public:
+	//! \param encoders Number of threads writing frames at once, when the target supports it
+	FrameWriter(Target_Scanline &target, int max_frames, int encoders):
+		target(target),
+		max_frames(std::max(max_frames, encoders)),
+		parallel(encoders>1 && target.has_frame_targets()),
+		last_pixels(NULL),
+		writing(0),
+		first_unwritten(0),
+		has_first(false),
+		finished(false),
+		cancelled(false),
+		failed(false)
+	{
+		for(int i=0; i<(parallel?encoders:1); i++)
+			threads.push_back(Glib::Thread::create(sigc::mem_fun(*this, &FrameWriter::run), true));
+	}
+
+	//! Drops the frames not written yet, unless finish() was called
+	~FrameWriter()
+	{
+		{
+			Glib::Mutex::Lock lock(mutex);
+			cancelled=true;
+			cond.broadcast();
+		}
+		join();
+		for(std::deque<Frame>::iterator i=frames.begin(); i!=frames.end(); ++i)
+			release(i->pixels);
+		release(last_pixels);
+	}
+
+	//! Queues \a surface to be written as the frame \a number, waiting while the queue is full.
+	//! A NULL \a surface repeats the pixels of the previous frame, without copying them.
+	/*! \return \c false if a frame could not be written */
+	bool push(Surface *surface, int number, bool duplicate)
+	{
+		// Frame targets are made here, the writer threads can't use the canvas
+		Target_Scanline::Handle frame_target;
+		if(parallel)
+			frame_target=target.create_frame_target(number);
+
+		Glib::Mutex::Lock lock(mutex);
+		while(!failed && frames.size()+writing>=max_frames)
+			cond.wait(mutex);
+		if(failed)
+		{
+			delete surface;
+			return false;
+		}
+		if(surface)
+		{
+			release(last_pixels);
+			last_pixels=new Pixels;
+			last_pixels->surface=surface;
+			last_pixels->users=1;
+		}
+		assert(last_pixels);
+		last_pixels->users++;
+		if(!has_first)
+		{
+			first_unwritten=number;
+			has_first=true;
+		}
+		Frame frame;
+		frame.pixels=last_pixels;
+		frame.number=number;
+		frame.duplicate=duplicate;
+		frame.target=frame_target;
+		frame_target.reset();
+		frames.push_back(frame);
+		cond.broadcast();
+		return true;
+	}
+
+	//! Waits until all the queued frames are written
+	/*! \return \c false if a frame could not be written */
+	bool finish()
+	{
+		{
+			Glib::Mutex::Lock lock(mutex);
+			finished=true;
+			cond.broadcast();
+		}
+		join();
+		return !failed;
+	}
+
+	const String &get_error()const { return error; }
+};
+
+/* === P R O C E D U R E S ================================================= */
+
 /* === M E T H O D S ======================================================= */
 
 Target_Scanline::Target_Scanline():
-	threads_(2)
+	threads_(2),
+	queue_size_(0),
+	encoders_(1)
 {
 	curr_frame_=0;
 }
@@ -108,6 +431,22 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 	total_frames=frame_end-frame_start+1;
 	if(total_frames<=0)total_frames=1;
 
+	// Frames with the same pixels as the previous one are repeated
+	const bool find_duplicates(!getenv("SYNFIG_DISABLE_DUPLICATE_FRAMES"));
+	uint64_t last_hash(0);
+	bool has_last(false);
+
+	// The last rendered frame, repeated while nothing animated changes.
+	// The writer thread keeps its pixels itself.
+	std::auto_ptr<Surface> last_frame;
+	Time last_time;
+	bool has_last_frame(false);
+
+	// Frames are written by a separate thread while the next ones render
+	std::auto_ptr<FrameWriter> writer;
+	if(queue_size_>0 && quality!=0)
+		writer.reset(new FrameWriter(*this,queue_size_,encoders_));
+
 	try {
 
 	//synfig::info("1time_set_to %s",t.get_string().c_str());
@@ -123,6 +462,27 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 			if(cb && !cb->amount_complete(total_frames-frames,total_frames))
 				return false;
 
+			// Nothing animated changed since the last frame, don't render it again
+			if(has_last_frame && is_static_between(last_time,t))
+			{
+				if(writer.get())
+				{
+					if(!writer->push(NULL,frame_start+total_frames-frames-1,true))
+					{
+						if(cb)cb->error(writer->get_error());
+						return false;
+					}
+				}
+				else
+				if(!repeat_frame() && !add_frame(last_frame.get()))
+				{
+					if(cb)cb->error(_("Unable to put surface on target"));
+					return false;
+				}
+				last_time=t;
+				continue;
+			}
+
 			Context context;
 			// pass the Render Method to the context
 			context=canvas->get_context(context_params);
@@ -178,8 +538,13 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 					synfig::info("Render broken up into %d block%s %d pixels tall, and a final block %d pixels tall",
 								 rows-1, rows==2?"":"s", rowheight, lastrowheight);
 
+					// the blocks are gathered in a frame for the writer thread,
+					// or to compare it with the next ones
+					std::auto_ptr<Surface> frame;
+					if(writer.get() || total_frames>1)
+						frame.reset(new Surface(desc.get_w(),desc.get_h()));
 					// loop through all the full rows
-					if(!start_frame())
+					else if(!start_frame())
 					{
 						throw(string("add_frame(): target panic on start_frame()"));
 						return false;
@@ -204,6 +569,10 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 						{
 							if(cb)cb->error(_("Accelerated Renderer Failure"));
 							return false;
+						}else if(frame.get())
+						{
+							for(int y = 0; y < blockrd.get_h(); y++)
+								memcpy((*frame)[y + i*rowheight],surface[y],sizeof(Color)*surface.get_w());
 						}else
 						{
 							int y;
@@ -252,34 +621,95 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 						}
 					}
 
-					end_frame();
+					if(!frame.get())
+						end_frame();
+					else
+					{
+						const bool duplicate(find_duplicates && is_duplicate(*frame,last_hash,has_last));
+						if(writer.get())
+						{
+							if(!writer->push(frame.release(),frame_start+total_frames-frames-1,duplicate))
+							{
+								if(cb)cb->error(writer->get_error());
+								return false;
+							}
+						}
+						else
+						{
+							if(duplicate && repeat_frame())
+								;
+							else
+							if(!add_frame(frame.get()))
+							{
+								if(cb)cb->error(_("Unable to put surface on target"));
+								return false;
+							}
+							last_frame=frame;
+						}
+						last_time=t;
+						has_last_frame=true;
+					}
 
 				}else //use normal rendering...
 				{
 				#endif
-					Surface surface;
-
-					if(!context.accelerated_render(&surface,quality,desc,0))
+					if(writer.get())
 					{
-						// For some reason, the accelerated renderer failed.
-						if(cb)cb->error(_("Accelerated Renderer Failure"));
-						return false;
+						std::auto_ptr<Surface> frame(new Surface());
+						if(!context.accelerated_render(frame.get(),quality,desc,0))
+						{
+							if(cb)cb->error(_("Accelerated Renderer Failure"));
+							return false;
+						}
+						const bool duplicate(find_duplicates && is_duplicate(*frame,last_hash,has_last));
+						last_time=t;
+						has_last_frame=true;
+						if(!writer->push(frame.release(),frame_start+total_frames-frames-1,duplicate))
+						{
+							if(cb)cb->error(writer->get_error());
+							return false;
+						}
 					}
 					else
 					{
-						// Put the surface we renderer
-						// onto the target.
-						if(!add_frame(&surface))
+						std::auto_ptr<Surface> surface(new Surface());
+
+						if(!context.accelerated_render(surface.get(),quality,desc,0))
 						{
-							if(cb)cb->error(_("Unable to put surface on target"));
+							// For some reason, the accelerated renderer failed.
+							if(cb)cb->error(_("Accelerated Renderer Failure"));
 							return false;
 						}
+						else
+						{
+							// Put the surface we renderer
+							// onto the target, or repeat the previous one
+							if(find_duplicates && is_duplicate(*surface,last_hash,has_last) && repeat_frame())
+								;
+							else
+							if(!add_frame(surface.get()))
+							{
+								if(cb)cb->error(_("Unable to put surface on target"));
+								return false;
+							}
+							// kept as is, the next frame renders in a new surface
+							last_frame=surface;
+							last_time=t;
+							has_last_frame=true;
+						}
 					}
 				#if USE_PIXELRENDERING_LIMIT
 				}
 				#endif
 			}
 		}while(frames);
+
+		// Wait for the last frames to be written
+		if(writer.get() && !writer->finish())
+		{
+			if(cb)cb->error(writer->get_error());
+			return false;
+		}
 	}
     else
     {
@@ -461,6 +891,17 @@ synfig::Target_Scanline::render(ProgressCallback *cb)
 	return true;
 }
 
+void
+Target_Scanline::init_frame_target(Target_Scanline &target)const
+{
+	// the render description was already adjusted by set_rend_desc()
+	target.desc=desc;
+	target.set_quality(get_quality());
+	target.gamma()=gamma();
+	target.set_alpha_mode(get_alpha_mode());
+	target.set_avoid_time_sync(get_avoid_time_sync());
+}
+
 bool
 Target_Scanline::add_frame(const Surface *surface)
 {
@@ -519,3 +960,46 @@ Target_Scanline::add_frame(const Surface *surface)
 
 	return true;
 }
+
+bool
+Target_Scanline::repeat_file(const String &previous, const String &filename)
+{
+	// Not a hard link: targets open the files of a sequence for writing
+	// without removing them first, which would change the linked frames too
+	remove(filename.c_str());
+	std::ifstream in(previous.c_str(),std::ios::binary);
+	std::ofstream out(filename.c_str(),std::ios::binary);
+	if(!in || !out)
+		return false;
+	out<<in.rdbuf();
+	return out.good();
+}
+
+void
+Target_Scanline::init_sequence_target(Target_Scanline &target, bool &multi_image, int &imagecount, int frame)const
+{
+	init_frame_target(target);
+	multi_image=true;
+	imagecount=frame;
+}
+
+bool
+Target_Scanline::repeat_sequence_frame(const String &filename, const String &sequence_separator, bool multi_image, int &imagecount)const
+{
+	// Link the previous image of the sequence
+	if(!is_file_sequence(filename,multi_image) || imagecount==desc.get_frame_start())
+		return false;
+
+	const String previous(filename_sans_extension(filename) +
+						  sequence_separator +
+						  etl::strprintf("%04d",imagecount-1) +
+						  filename_extension(filename));
+	const String newfilename(filename_sans_extension(filename) +
+							 sequence_separator +
+							 etl::strprintf("%04d",imagecount) +
+							 filename_extension(filename));
+	if(!repeat_file(previous,newfilename))
+		return false;
+	imagecount++;
+	return true;
+}
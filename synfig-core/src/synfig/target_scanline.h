@@ -46,6 +46,12 @@ class Target_Scanline : public Target
 {
 	//! Number of threads to use
 	int threads_;
+	//! Number of rendered frames which may wait to be written
+	int queue_size_;
+	//! Number of threads writing frames at once, see create_frame_target()
+	int encoders_;
+
+	class FrameWriter;
 
 public:
 	typedef etl::handle<Target_Scanline> Handle;
@@ -91,8 +97,64 @@ public:
 	void set_threads(int x) { threads_=x; }
 	//! Gets the number of threads
 	int get_threads()const { return threads_; }
+	//! Sets how many rendered frames may wait to be written.
+	//! When not zero, frames are put onto the target by a separate
+	//! thread while the next ones render.
+	void set_queue_size(int x) { queue_size_=x; }
+	//! Gets how many rendered frames may wait to be written
+	int get_queue_size()const { return queue_size_; }
+	//! Sets how many frames may be written at once, when the target
+	//! supports it. Only used when the queue size is not zero.
+	void set_encoders(int x) { encoders_=x; }
+	//! Gets how many frames may be written at once
+	int get_encoders()const { return encoders_; }
+
+	//! Creates a target writing the frame number \a frame of the sequence
+	//! the way this one would.
+	/*!	Targets writing each frame to its own file implement it, so that
+	**	several frames can be written at once by separate targets.
+	**	Called on the render thread, the target is then used by one writer thread.
+	**	\return An empty handle if the frames must be written in order
+	**	\see has_frame_targets(), init_frame_target(), set_encoders()
+	*/
+	virtual Handle create_frame_target(int frame) { (void)frame; return Handle(); }
+	//! Returns \c true if create_frame_target() gives targets for this render
+	virtual bool has_frame_targets()const { return false; }
 	//! Puts the rendered surface onto the target.
 	bool add_frame(const synfig::Surface *surface);
+
+	//! Writes the next frame, which has the same pixels as the previous one.
+	/*!	Called by render() instead of putting the frame onto the target,
+	**	so that targets can copy or repeat what they already wrote.
+	**	Targets from create_frame_target() are called once the previous
+	**	frame was written by another one.
+	**	\return \c false if the frame must be put onto the target as usual
+	*/
+	virtual bool repeat_frame() { return false; }
+
+protected:
+	//! Gives \a target the render description and settings of this one.
+	//! set_rend_desc() is not called, the target must set up its own members.
+	//! The canvas is not shared: its handle must not be used by the writer threads.
+	void init_frame_target(Target_Scanline &target)const;
+
+	//! Makes \a filename a copy of the file \a previous
+	static bool repeat_file(const String &previous, const String &filename);
+
+	//! \name Image sequences
+	//! Shared by the targets writing each image of a sequence to a file of its own,
+	//! named after \a filename, \a sequence_separator and the image number
+	//@{
+	//! has_frame_targets() of those targets
+	static bool is_file_sequence(const String &filename, bool multi_image)
+		{ return multi_image && filename!="-"; }
+	//! Sets up \a target, built by create_frame_target(), to write the image \a frame.
+	//! \a multi_image and \a imagecount are the fields of \a target.
+	void init_sequence_target(Target_Scanline &target, bool &multi_image, int &imagecount, int frame)const;
+	//! repeat_frame() of those targets, counts \a imagecount when the file was repeated
+	bool repeat_sequence_frame(const String &filename, const String &sequence_separator, bool multi_image, int &imagecount)const;
+	//@}
+
 private:
 }; // END of class Target_Scanline
 
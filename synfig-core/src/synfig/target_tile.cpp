@@ -421,6 +421,10 @@ synfig::Target_Tile::render(ProgressCallback *cb)
 	total_frames=frame_end-frame_start+1;
 	if(total_frames<=0)total_frames=1;
 
+	// The time of the last rendered frame
+	Time last_time;
+	bool has_last_frame(false);
+
 	try {
 
 		if(total_frames>=1)
@@ -437,6 +441,13 @@ synfig::Target_Tile::render(ProgressCallback *cb)
 				if(cb && !cb->amount_complete(total_frames-frames,total_frames))
 					return false;
 
+				// Nothing animated changed since the last frame, let the target repeat it
+				if(has_last_frame && is_static_between(last_time,t) && repeat_frame())
+				{
+					last_time=t;
+					continue;
+				}
+
 				if(!start_frame(cb))
 					return false;
 				Context context;
@@ -484,6 +495,8 @@ synfig::Target_Tile::render(ProgressCallback *cb)
 				if(!render_frame_(context,0))
 					return false;
 				end_frame();
+				last_time=t;
+				has_last_frame=true;
 			}while(frames);
 			//synfig::info("tilerenderer: i=%d, t=%s",i,t.get_string().c_str());
 		}
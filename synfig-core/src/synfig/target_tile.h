@@ -104,6 +104,12 @@ public:
 	//! Marks the end of a frame
 	/*! \see start_frame() */
 	virtual void end_frame()=0;
+
+	//! Writes the next frame again, when nothing animated changed since the previous one
+	/*!	Called by render() instead of rendering the frame.
+	**	\return \c false if the frame must be rendered as usual
+	*/
+	virtual bool repeat_frame() { return false; }
 	//!Sets the number of threads
 	void set_threads(int x) { threads_=x; }
 	//!Gets the number of threads
@@ -45,7 +45,8 @@ struct TargetParam
 	 *  its own valid default settings.
 	 */
 	TargetParam (const std::string& Video_codec = "none", int Bitrate = -1):
-		video_codec(Video_codec), bitrate(Bitrate), sequence_separator("."), offset_x(0), offset_y(0),rows(0),columns(0),append(true),dir(HR)
+		video_codec(Video_codec), bitrate(Bitrate), sequence_separator("."), offset_x(0), offset_y(0),rows(0),columns(0),append(true),dir(HR),
+		compression(), tile_size(0), float_pixels(false)
 	{ }
 
 	std::string video_codec;
@@ -58,6 +59,13 @@ struct TargetParam
 	int columns;
 	bool append;
 	Direction dir;
+
+	//! Compression of image files, empty for the target's default
+	std::string compression;
+	//! Size of the tiles of image files, zero to write scanlines
+	int tile_size;
+	//! Stores 32 bits float channels instead of half floats
+	bool float_pixels;
 };
 
 }; // END of namespace synfig
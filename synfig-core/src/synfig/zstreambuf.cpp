@@ -30,6 +30,7 @@
 #endif
 
 #include <cstring>
+#include <cstdlib>
 #include "zstreambuf.h"
 
 #endif
@@ -46,6 +47,17 @@ using namespace synfig;
 
 /* === P R O C E D U R E S ================================================= */
 
+static int read_compression_level()
+{
+	const char *env = getenv("SYNFIG_COMPRESSION_LEVEL");
+	int level = env ? atoi(env) : zstreambuf::option_compression_level;
+	if (level < 1 || level > 9) level = zstreambuf::option_compression_level;
+	return level;
+}
+
+//! Read when the library is loaded, before any stream can be written from a thread
+static const int compression_level = read_compression_level();
+
 /* === M E T H O D S ======================================================= */
 
 zstreambuf::zstreambuf(std::streambuf *buf):
@@ -62,6 +74,11 @@ zstreambuf::~zstreambuf()
 	if (deflate_initialized) deflateEnd(&deflate_stream_);
 }
 
+int zstreambuf::get_compression_level()
+{
+	return compression_level;
+}
+
 bool zstreambuf::inflate_buf()
 {
     // initialize inflate if need
@@ -73,9 +90,9 @@ bool zstreambuf::inflate_buf()
     }
 
     // read and inflate new chunk of data
-    char in_buf[option_bufsize];
-    inflate_stream_.avail_in = buf_->sgetn(in_buf, sizeof(in_buf));
-    inflate_stream_.next_in = (Bytef*)in_buf;
+    if (inflate_buffer_.size() < option_bufsize) inflate_buffer_.resize(option_bufsize);
+    inflate_stream_.avail_in = buf_->sgetn(&inflate_buffer_.front(), inflate_buffer_.size());
+    inflate_stream_.next_in = (Bytef*)&inflate_buffer_.front();
 	read_buffer_.resize(0);
 	do
 	{
@@ -107,7 +124,7 @@ bool zstreambuf::deflate_buf(bool flush)
 			memset(&deflate_stream_, 0, sizeof(deflate_stream_));
 
 			if (Z_OK != deflateInit2(&deflate_stream_,
-					option_compression_level,
+					get_compression_level(),
 					option_method,
 					option_window_bits,
 					option_mem_level,
@@ -118,17 +135,19 @@ bool zstreambuf::deflate_buf(bool flush)
 		}
 
 		// deflate and write new chunk of data
-		char out_buf[option_bufsize];
+		if (deflate_buffer_.size() < option_bufsize) deflate_buffer_.resize(option_bufsize);
+		char *out_buf = &deflate_buffer_.front();
+		uInt out_size = (uInt)deflate_buffer_.size();
 		deflate_stream_.avail_in = (uInt)(pptr() - pbase());
 		deflate_stream_.next_in = (Bytef*)pbase();
 		do
 		{
-			deflate_stream_.avail_out = sizeof(out_buf);
+			deflate_stream_.avail_out = out_size;
 			deflate_stream_.next_out = (Bytef*)out_buf;
 			if (Z_STREAM_ERROR == deflate(&deflate_stream_, flush ? Z_FINISH : Z_NO_FLUSH))
 				return false;
-			if (deflate_stream_.avail_out < sizeof(out_buf))
-				buf_->sputn(out_buf, sizeof(out_buf) - deflate_stream_.avail_out);
+			if (deflate_stream_.avail_out < out_size)
+				buf_->sputn(out_buf, out_size - deflate_stream_.avail_out);
 		} while (deflate_stream_.avail_out == 0);
 		assert(deflate_stream_.avail_in == 0);
 		setp(NULL, NULL);
@@ -46,7 +46,7 @@ namespace synfig {
 	{
 	public:
 		enum {
-			option_bufsize				= 4096,
+			option_bufsize				= 65536,
 			option_method				= Z_DEFLATED,
 			option_compression_level	= 9,
 			option_window_bits			= 16+MAX_WBITS,
@@ -59,15 +59,20 @@ namespace synfig {
 
 		bool inflate_initialized;
 		z_stream inflate_stream_;
+		std::vector<char> inflate_buffer_;
 		std::vector<char> read_buffer_;
 
 		bool deflate_initialized;
 		z_stream deflate_stream_;
+		std::vector<char> deflate_buffer_;
 		std::vector<char> write_buffer_;
 
 		bool inflate_buf();
 		bool deflate_buf(bool flush);
 
+		//! The level set by SYNFIG_COMPRESSION_LEVEL, or option_compression_level
+		static int get_compression_level();
+
 	public:
 		explicit zstreambuf(std::streambuf *buf);
 		virtual ~zstreambuf();
@@ -108,12 +113,7 @@ namespace synfig {
 
 	protected:
 		virtual size_t internal_write(const void *buffer, size_t size)
-		{
-			for(size_t i = 0; i < size; i++)
-				if (!ostream_.put(((const char*)buffer)[i]).good())
-					return i;
-			return size;
-		}
+			{ return ostream_.write((const char*)buffer, size).good() ? size : 0; }
 
 	public:
 		ZWriteStream(FileSystem::WriteStreamHandle stream):
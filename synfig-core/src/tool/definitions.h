@@ -45,6 +45,8 @@
 #endif
 
 #define DEFAULT_QUALITY		2
+//! Rendered frames which may wait for the target while the next ones render
+#define DEFAULT_QUEUE_SIZE	2
 #define VERBOSE_OUT(x) if (SynfigToolGeneralOptions::instance()->get_verbosity() >= (x)) std::cerr
 
 #define SYNFIG_LICENSE "\
@@ -25,11 +25,16 @@
 #ifndef __SYNFIG_JOB_H
 #define __SYNFIG_JOB_H
 #include "synfig/target.h"
+#include "synfig/targetparam.h"
+#include <string>
+#include <vector>
 
 struct Job
 {
 	std::string filename;
 	std::string outfilename;
+	//! Other files written from the same render
+	std::vector<std::string> extra_outfilenames;
 	std::string target_name;
 
 	synfig::RendDesc desc;
@@ -38,6 +43,7 @@ struct Job
 	synfig::Canvas::Handle root;
 	synfig::Canvas::Handle canvas;
 	synfig::Target::Handle target;
+	synfig::TargetParam target_params;
 
 	int quality;
 	bool sifout;
@@ -48,12 +48,15 @@
 #include <synfig/layer.h>
 #include <synfig/time.h>
 #include <synfig/target_scanline.h>
+#include <synfig/target_multi.h>
+#include <synfig/target_tile.h>
 #include <synfig/paramdesc.h>
 #include <synfig/module.h>
 #include <synfig/importer.h>
 #include <synfig/loadcanvas.h>
 #include <synfig/savecanvas.h>
 #include <synfig/filesystemnative.h>
+#include <synfig/surfacepool.h>
 
 #include "definitions.h"
 #include "job.h"
@@ -67,20 +70,44 @@
 using namespace synfig;
 namespace bfs=boost::filesystem;
 
-void process_job_list(std::list<Job>& job_list, const TargetParam& target_params)
+bool process_job_list(std::list<Job>& job_list, synfig::ProgressCallback* progress)
 {
 	if(!job_list.size())
 		throw (SynfigToolException(SYNFIGTOOL_BORED, _("Nothing to do!")));
 
+	bool success = true;
 	for(; job_list.size(); job_list.pop_front())
 	{
-		if (setup_job(job_list.front(), target_params))
-			process_job(job_list.front());
+		if (setup_job(job_list.front()))
+			process_job(job_list.front(), progress);
+		else
+			success = false;
 	}
+	return success;
 }
 
-bool setup_job(Job& job, const TargetParam& target_parameters)
+/// Returns the name of the target writing files with the extension of \a filename
+static std::string target_name_from_extension(const std::string& filename)
 {
+	std::string ext = bfs::path(filename).extension().string();
+	if (ext.length())
+		ext = ext.substr(1);
+
+	if(Target::ext_book().count(ext))
+		return Target::ext_book()[ext];
+
+	std::string lower_ext;
+	std::transform(ext.begin(), ext.end(), std::back_inserter(lower_ext), ::tolower);
+
+	if(Target::ext_book().count(lower_ext))
+		return Target::ext_book()[lower_ext];
+	return ext;
+}
+
+bool setup_job(Job& job)
+{
+	const TargetParam& target_parameters = job.target_params;
+
 	VERBOSE_OUT(4) << _("Attempting to determine target/outfile...") << std::endl;
 
 	// If the target type is not yet defined,
@@ -89,28 +116,9 @@ bool setup_job(Job& job, const TargetParam& target_parameters)
 	{
 		VERBOSE_OUT(3) << _("Target name undefined, attempting to figure it out")
 					   << std::endl;
-		std::string ext = bfs::path(job.outfilename).extension().string();
-		if (ext.length())
-			ext = ext.substr(1);
-
-		if(Target::ext_book().count(ext))
-		{
-			job.target_name = Target::ext_book()[ext];
+		job.target_name = target_name_from_extension(job.outfilename);
+		if(Target::book().count(job.target_name))
 			info("target name not specified - using %s", job.target_name.c_str());
-		}
-		else
-		{
-			std::string lower_ext;
-			std::transform(ext.begin(), ext.end(), std::back_inserter(lower_ext), ::tolower);
-
-			if(Target::ext_book().count(lower_ext))
-			{
-				job.target_name=Target::ext_book()[lower_ext];
-				info("target name not specified - using %s", job.target_name.c_str());
-			}
-			else
-				job.target_name=ext;
-		}
 	}
 
 	// If the target type is STILL not yet defined, then
@@ -172,6 +180,35 @@ bool setup_job(Job& job, const TargetParam& target_parameters)
 		job.sifout=false;
 	}
 
+	// Render once for all the output files
+	if(job.target && !job.extra_outfilenames.empty())
+	{
+		etl::handle<Target_Multi> multi(new Target_Multi());
+		multi->add_target(job.target);
+
+		for (std::vector<std::string>::const_iterator i = job.extra_outfilenames.begin();
+			 i != job.extra_outfilenames.end(); ++i)
+		{
+			const std::string target_name = target_name_from_extension(*i);
+			Target::Handle target = Target::create(target_name, *i, target_parameters);
+			if(!target || !(Target_Scanline::Handle::cast_dynamic(target) || Target_Tile::Handle::cast_dynamic(target)))
+			{
+				synfig::error((boost::format(_("Unknown target for \"%s\": %s"))
+							   % *i % target_name).str().c_str());
+				synfig::error(_("Throwing out job..."));
+				return false;
+			}
+			VERBOSE_OUT(4) << "Extra output = " << i->c_str()
+						   << " (" << target_name.c_str() << ")" << std::endl;
+			multi->add_target(target);
+		}
+
+		job.target = multi;
+	}
+
+	// The canvas may be shared with other jobs, with other settings
+	job.canvas->rend_desc() = job.desc;
+
 	// Set the Canvas on the Target
 	if(job.target)
 	{
@@ -188,14 +225,19 @@ bool setup_job(Job& job, const TargetParam& target_parameters)
 		}
 	}
 
-	// Set the threads for the target
+	// Set the threads for the target, frames are written on their own
+	// threads while the next ones render
 	if (job.target && Target_Scanline::Handle::cast_dynamic(job.target))
+	{
 		Target_Scanline::Handle::cast_dynamic(job.target)->set_threads(SynfigToolGeneralOptions::instance()->get_threads());
+		Target_Scanline::Handle::cast_dynamic(job.target)->set_queue_size(DEFAULT_QUEUE_SIZE);
+		Target_Scanline::Handle::cast_dynamic(job.target)->set_encoders(SynfigToolGeneralOptions::instance()->get_threads());
+	}
 
 	return true;
 }
 
-void process_job (Job& job)
+void process_job (Job& job, synfig::ProgressCallback* progress)
 {
 	VERBOSE_OUT(3) << job.filename.c_str() << " -- " << std::endl;
 	VERBOSE_OUT(3) << '\t'
@@ -218,7 +260,8 @@ void process_job (Job& job)
                                     % job.desc.get_focus()[1]
                     << std::endl;
 
-	RenderProgress p;
+	RenderProgress console_progress;
+	synfig::ProgressCallback& p = progress ? *progress : console_progress;
 	p.task(job.filename + " ==> " + job.outfilename);
 
 	if(job.sifout)
@@ -233,8 +276,15 @@ void process_job (Job& job)
 		boost::chrono::system_clock::time_point start_timepoint =
             boost::chrono::system_clock::now();
 
+		// Report the buffers of this job only
+		SurfacePool::reset_stats();
+
 		// Call the render member of the target
-		if(!job.target->render(&p))
+		bool rendered = job.target->render(&p);
+		// Don't keep the buffers of this job for the next ones, which may
+		// render at other sizes, or for a daemon waiting for its next line
+		SurfacePool::trim();
+		if(!rendered)
 			throw (SynfigToolException(SYNFIGTOOL_RENDERFAILURE, _("Render Failure.")));
 
 		if(SynfigToolGeneralOptions::instance()->should_print_benchmarks())
@@ -246,6 +296,13 @@ void process_job (Job& job)
                       << _(": Rendered in ")
                       << duration.count()
                       << _(" seconds.") << std::endl;
+
+            SurfacePool::Stats stats = SurfacePool::get_stats();
+            std::cout << job.filename.c_str()
+                      << boost::format(_(": Surfaces peaked at %.1f MB, "
+                                         "%d buffers reused, %d allocated."))
+                         % (stats.peak/1048576.0) % stats.reused % stats.allocated
+                      << std::endl;
         }
 	}
 
@@ -26,18 +26,21 @@
 #define __SYNFIG_JOBLISTPROCESSOR_H
 
 #include <list>
+#include <synfig/general.h>
 #include <synfig/targetparam.h>
 #include "job.h"
 
 /// Process a Job list setting up and processing each job
-void process_job_list(std::list<Job>& job_list,
-						const synfig::TargetParam& target_parameters);
+/// \param progress Reports the progress of the renders, printed to the console if NULL
+/// \return false if some jobs could not be set up and were thrown out
+bool process_job_list(std::list<Job>& job_list, synfig::ProgressCallback* progress = NULL);
 
 /// Prepare a job to be processed
 /// \return whether the preparation was OK or not
-bool setup_job(Job& job, const synfig::TargetParam& target_parameters);
+bool setup_job(Job& job);
 
 /// Process an individual job
-void process_job(Job& job);
+/// \param progress Reports the progress of the render, printed to the console if NULL
+void process_job(Job& job, synfig::ProgressCallback* progress = NULL);
 
 #endif // __SYNFIG_JOBLISTPROCESSOR_H
@@ -32,8 +32,10 @@
 #endif
 
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <list>
+#include <algorithm>
 
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/parsers.hpp>
@@ -55,9 +57,11 @@
 #include <synfig/string.h>
 #include <synfig/paramdesc.h>
 #include <synfig/main.h>
+#include <synfig/filesystem.h>
 #include <autorevision.h>
 #include "definitions.h"
 #include "progress.h"
+#include "renderprogress.h"
 #include "job.h"
 #include "synfigtoolexception.h"
 #include "optionsprocessor.h"
@@ -78,6 +82,218 @@ std::string _appendAlphaToFilename(std::string input_filename)
     return bfs::path(filename.parent_path() / alpha_filename).string();
 }
 
+/// Adds the jobs given by the options to the end of \a job_list
+void add_jobs(OptionsProcessor& op, std::list<Job>& job_list)
+{
+	Job job;
+	job = op.extract_job();
+	job.desc = job.canvas->rend_desc() = op.extract_renddesc(job.canvas->rend_desc());
+	job.target_params = op.extract_targetparam();
+
+	if (job.extract_alpha) {
+		job.alpha_mode = synfig::TARGET_ALPHA_MODE_EXTRACT;
+		Job alpha_job = job;
+		alpha_job.outfilename = _appendAlphaToFilename(job.outfilename);
+		alpha_job.extra_outfilenames.clear();
+		job_list.push_back(alpha_job);
+		job.alpha_mode = synfig::TARGET_ALPHA_MODE_REDUCE;
+		job_list.push_back(job);
+	} else {
+		job_list.push_back(job);
+	}
+}
+
+/// Whether \a line holds no job: blank, or a comment starting with '#'
+static bool is_blank_line(const std::string& line)
+{
+	std::string::size_type first = line.find_first_not_of(" \t");
+	return first == std::string::npos || line[first] == '#';
+}
+
+/// Keeps the general settings while in scope, and restores them after
+/// a line of options changed them for its jobs
+class LineSettings
+{
+	int verbosity;
+	size_t threads;
+	bool be_quiet, print_benchmarks;
+
+public:
+	LineSettings():
+		verbosity(SynfigToolGeneralOptions::instance()->get_verbosity()),
+		threads(SynfigToolGeneralOptions::instance()->get_threads()),
+		be_quiet(SynfigToolGeneralOptions::instance()->should_be_quiet()),
+		print_benchmarks(SynfigToolGeneralOptions::instance()->should_print_benchmarks())
+	{ }
+
+	~LineSettings()
+	{
+		SynfigToolGeneralOptions::instance()->set_verbosity(verbosity);
+		SynfigToolGeneralOptions::instance()->set_threads(threads);
+		SynfigToolGeneralOptions::instance()->set_should_be_quiet(be_quiet);
+		SynfigToolGeneralOptions::instance()->set_should_print_benchmarks(print_benchmarks);
+	}
+};
+
+/// Adds the jobs given by a line of options to the end of \a job_list
+/// The settings of the line (-T, -q, -b, -v) are applied, a LineSettings
+/// must be in scope until its jobs are processed.
+/// \return false, with the reason in \a message, if the line was thrown out
+bool add_jobs_from_line(const std::string& line,
+						const po::options_description& po_all,
+						const po::positional_options_description& po_positional,
+						const po::options_description& po_visible,
+						std::list<Job>& job_list,
+						std::string& message)
+{
+	try
+	{
+		po::variables_map vm;
+		po::store(po::command_line_parser(po::split_unix(line)).options(po_all).
+				positional(po_positional).run(), vm);
+		OptionsProcessor op(vm, po_visible);
+		op.process_settings_options();
+		add_jobs(op, job_list);
+	}
+	catch(SynfigToolException& e)
+	{
+		// Jobs only printing or saving their composition are done
+		message = e.get_message();
+		return e.get_exit_code() == SYNFIGTOOL_OK;
+	}
+	catch(std::exception& e)
+	{
+		message = e.what();
+		return false;
+	}
+	return true;
+}
+
+/// Processes the jobs of a line of options, added to \a job_list
+/// \param progress Reports the progress of the renders, printed to the console if NULL
+/// \return false, with the reason in \a message, if the jobs failed
+bool process_line_jobs(std::list<Job>& job_list,
+					   std::string& message,
+					   synfig::ProgressCallback* progress = NULL)
+{
+	// The line only printed or saved its composition
+	if (job_list.empty())
+		return true;
+
+	try
+	{
+		if (process_job_list(job_list, progress))
+			return true;
+		message = _("Unable to set up the job");
+	}
+	catch(SynfigToolException& e)
+	{
+		message = e.get_message();
+		return e.get_exit_code() == SYNFIGTOOL_OK;
+	}
+	catch(std::exception& e)
+	{
+		message = e.what();
+	}
+	return false;
+}
+
+/// Processes the jobs of a batch file, one line of options per job
+/*! Each line is processed as soon as it is read, so only its compositions
+ *  are loaded at a time, besides the few recent ones kept for the next
+ *  jobs. The jobs which can't be parsed or set up are thrown out. */
+void run_batch(const std::string& filename,
+			   const po::options_description& po_all,
+			   const po::positional_options_description& po_positional,
+			   const po::options_description& po_visible)
+{
+	std::ifstream file(filename.c_str());
+	if (!file)
+		throw SynfigToolException(SYNFIGTOOL_FILENOTFOUND,
+			(boost::format(_("Unable to open batch file '%s'.")) % filename).str());
+
+	std::string line;
+	for(int line_number = 1; synfig::FileSystem::safeGetline(file, line); line_number++)
+	{
+		if (is_blank_line(line))
+			continue;
+
+		LineSettings settings;
+		std::list<Job> job_list;
+		std::string message;
+		if (!add_jobs_from_line(line, po_all, po_positional, po_visible, job_list, message)
+		 || !process_line_jobs(job_list, message))
+			synfig::error("%s:%d: %s", filename.c_str(), line_number, message.c_str());
+	}
+}
+
+/// Whether a job of \a job_list writes to the standard output
+static bool writes_to_stdout(const std::list<Job>& job_list)
+{
+	for(std::list<Job>::const_iterator i = job_list.begin(); i != job_list.end(); ++i)
+		if (i->outfilename == "-"
+		 || std::find(i->extra_outfilenames.begin(), i->extra_outfilenames.end(), "-") != i->extra_outfilenames.end())
+			return true;
+	return false;
+}
+
+/// Returns \a message on a single line, its line breaks turned into spaces
+static std::string single_line(std::string message)
+{
+	std::replace(message.begin(), message.end(), '\n', ' ');
+	std::replace(message.begin(), message.end(), '\r', ' ');
+	return message;
+}
+
+/// Renders the jobs read from the standard input until it ends, or "quit"
+/*! Each line holds the options of a job, as for --batch. The modules stay
+ *  loaded, and the compositions too, until their files change. For each
+ *  line, "progress <number> <done>/<total>" is printed as frames are
+ *  rendered, then "done <number>" or "failed <number>: <reason>" once it
+ *  is processed, after "ready" once the daemon waits for jobs. The standard
+ *  output carries these lines only, so jobs can't write their output there,
+ *  and what they print (benchmarks, --load-stats, --canvases, --canvas-info,
+ *  --save-as...) goes to the standard error. */
+void run_daemon(const po::options_description& po_all,
+				const po::positional_options_description& po_positional,
+				const po::options_description& po_visible)
+{
+	std::ostream protocol(std::cout.rdbuf());
+	std::streambuf* cout_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+	protocol << "ready" << std::endl;
+
+	std::string line;
+	for(int job_number = 1; synfig::FileSystem::safeGetline(std::cin, line); )
+	{
+		if (is_blank_line(line))
+			continue;
+		if (line == "quit")
+			break;
+
+		LineSettings settings;
+		std::list<Job> job_list;
+		std::string message;
+		DaemonProgress progress(job_number, protocol);
+		bool done = add_jobs_from_line(line, po_all, po_positional, po_visible, job_list, message);
+		if (done && writes_to_stdout(job_list))
+		{
+			done = false;
+			message = _("The output can't be the standard output in daemon mode");
+		}
+		if (done)
+			done = process_line_jobs(job_list, message, &progress);
+
+		if (done)
+			protocol << "done " << job_number << std::endl;
+		else
+			protocol << "failed " << job_number << ": " << single_line(message) << std::endl;
+		job_number++;
+	}
+
+	std::cout.rdbuf(cout_buffer);
+}
+
 int main(int argc, char* argv[])
 {
 	setlocale(LC_ALL, "");
@@ -123,6 +339,7 @@ int main(int argc, char* argv[])
 		named_type<int>* threads_arg_desc = new named_type<int>("NUM");
 		named_type<int>* verbosity_arg_desc = new named_type<int>("NUM");
 		named_type<std::string>* canvas_arg_desc = new named_type<std::string>("canvas-id");
+		named_type<std::vector<std::string> >* extra_output_arg_desc = new named_type<std::vector<std::string> >("filename");
 		named_type<std::string>* output_file_arg_desc = new named_type<std::string>("filename");
 		named_type<std::string>* input_file_arg_desc = new named_type<std::string>("filename");
 		named_type<float>* fps_arg_desc = new named_type<float>("NUM");
@@ -139,6 +356,10 @@ int main(int argc, char* argv[])
 		named_type<std::string>* layer_info_field_arg_desc = new named_type<std::string>("layer-name");
 		named_type<std::string>* video_codec_arg_desc = new named_type<std::string>("codec");
 		named_type<int>* video_bitrate_arg_desc = new named_type<int>("bitrate");
+		named_type<std::string>* exr_compression_arg_desc = new named_type<std::string>("compression");
+		named_type<int>* exr_tile_size_arg_desc = new named_type<int>("pixels");
+		named_type<std::string>* save_as_arg_desc = new named_type<std::string>("filename");
+		named_type<std::string>* batch_arg_desc = new named_type<std::string>("filename");
 
         po::options_description po_settings(_("Settings"));
         po_settings.add_options()
@@ -149,9 +370,10 @@ int main(int argc, char* argv[])
             ("antialias,a", antialias_arg_desc, _("Set antialias amount for parametric renderer."))
             ("quality,Q", quality_arg_desc->default_value(DEFAULT_QUALITY), (boost::format(_("Specify image quality for accelerated renderer (Default: %d)")) % DEFAULT_QUALITY).str().c_str())
             ("gamma,g", gamma_arg_desc, _("Gamma"))
-            ("threads,T", threads_arg_desc, _("Enable multithreaded renderer using the specified number of threads"))
+            ("threads,T", threads_arg_desc, _("Enable multithreaded renderer and image sequence encoding using the specified number of threads"))
             ("input-file,i", input_file_arg_desc, _("Specify input filename"))
             ("output-file,o", output_file_arg_desc, _("Specify output filename"))
+            ("extra-output", extra_output_arg_desc, _("Also write the frames to <filename>, with the target given by its extension. The frames are rendered once. May be repeated"))
             ("sequence-separator", sequence_separator_arg_desc, _("Output file sequence separator string (Use double quotes if you want to use spaces)"))
             ("canvas,c", canvas_arg_desc, _("Render the canvas with the given id instead of the root."))
             ("fps", fps_arg_desc, _("Set the frame rate"))
@@ -170,6 +392,7 @@ int main(int argc, char* argv[])
             ("quiet,q", _("Quiet mode (No progress/time-remaining display)"))
             ("benchmarks,b", _("Print benchmarks"))
             ("extract-alpha,x", _("Extract alpha"))
+            ("half-float", _("Hold intermediate surfaces in half floats, using less memory"))
             ;
 
         po::options_description po_misc(_("Misc options"));
@@ -177,6 +400,10 @@ int main(int argc, char* argv[])
 			("append", append_filename_arg_desc, _("Append layers in <filename> to composition"))
             ("canvas-info", canvas_info_fields_arg_desc, _("Print out specified details of the root canvas"))
             ("canvases", _("Print out the list of exported canvases in the composition"))
+            ("load-stats", _("Print out the time, memory and objects spent loading the composition"))
+            ("batch", batch_arg_desc, _("Also process the jobs of <filename>, one line of options per job, each line once read. Recently used compositions stay loaded for the next jobs"))
+            ("daemon", _("Keep running and process the jobs read from the standard input, one line of options per job, until it ends or reads \"quit\". Each line is answered with \"progress <number> <done>/<total>\" lines while it renders, then \"done <number>\" or \"failed <number>: <reason>\". Jobs can't write to the standard output"))
+            ("save-as", save_as_arg_desc, _("Save the composition to <filename> instead of rendering it, in the format given by its extension: .sif, .sifz or .sifb (binary)"))
             ;
 
         po::options_description po_ffmpeg(_("FFMPEG target options"));
@@ -185,6 +412,13 @@ int main(int argc, char* argv[])
             ("video-bitrate", video_bitrate_arg_desc, _("Set the bitrate for the output video"))
             ;
 
+        po::options_description po_openexr(_("OpenEXR target options"));
+        po_openexr.add_options()
+			("exr-compression", exr_compression_arg_desc, _("Set the compression: none, rle, zips, zip, piz, pxr24, b44, b44a, dwaa or dwab (Default: zip)"))
+            ("exr-tile-size", exr_tile_size_arg_desc, _("Write tiles of the given size instead of scanlines"))
+            ("exr-float", _("Write 32 bits float channels instead of half floats"))
+            ;
+
         po::options_description po_info(_("Synfig info options"));
         po_info.add_options()
 			("help", _("Produce this help message"))
@@ -220,7 +454,7 @@ int main(int argc, char* argv[])
         // Declare an options description instance which will include
         // all the options
         po::options_description po_all("");
-        po_all.add(po_settings).add(po_switchopts).add(po_misc).add(po_info).add(po_ffmpeg).add(po_hidden);
+        po_all.add(po_settings).add(po_switchopts).add(po_misc).add(po_info).add(po_ffmpeg).add(po_openexr).add(po_hidden);
 
 #ifdef _DEBUG
 		po_all.add(po_debug);
@@ -229,7 +463,7 @@ int main(int argc, char* argv[])
         // Declare an options description instance which will be shown
         // to the user
         po::options_description po_visible("");
-        po_visible.add(po_settings).add(po_switchopts).add(po_misc).add(po_ffmpeg);
+        po_visible.add(po_settings).add(po_switchopts).add(po_misc).add(po_ffmpeg).add(po_openexr);
 
 #ifdef _DEBUG
 		po_visible.add(po_debug);
@@ -267,24 +501,22 @@ int main(int argc, char* argv[])
         // Info options -----------------------------------------------
         op.process_info_options();
 
-		std::list<Job> job_list;
+		if (vm.count("daemon"))
+		{
+			run_daemon(po_all, po_positional, po_visible);
+			return SYNFIGTOOL_OK;
+		}
 
 		// Processing --------------------------------------------------
-		Job job;
-		job = op.extract_job();
-		job.desc = job.canvas->rend_desc() = op.extract_renddesc(job.canvas->rend_desc());
-
-		if (job.extract_alpha) {
-			job.alpha_mode = synfig::TARGET_ALPHA_MODE_REDUCE;
-			job_list.push_front(job);
-			job.alpha_mode = synfig::TARGET_ALPHA_MODE_EXTRACT;
-			job.outfilename = _appendAlphaToFilename(job.outfilename);
-			job_list.push_front(job);
-		} else {
-			job_list.push_front(job);
+		if (vm.count("input-file") || !vm.count("batch"))
+		{
+			std::list<Job> job_list;
+			add_jobs(op, job_list);
+			process_job_list(job_list);
 		}
 
-		process_job_list(job_list, op.extract_targetparam());
+		if (vm.count("batch"))
+			run_batch(vm["batch"].as<std::string>(), po_all, po_positional, po_visible);
 
 		return SYNFIGTOOL_OK;
 
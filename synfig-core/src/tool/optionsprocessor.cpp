@@ -30,6 +30,7 @@
 #endif
 
 #include <iostream>
+#include <map>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 
@@ -43,6 +44,8 @@
 #include <synfig/main.h>
 #include <synfig/importer.h>
 #include <synfig/loadcanvas.h>
+#include <synfig/loadstats.h>
+#include <synfig/savecanvas.h>
 #include <synfig/guid.h>
 #include <synfig/filesystemgroup.h>
 #include <synfig/filesystemnative.h>
@@ -60,6 +63,41 @@ using namespace std;
 using namespace synfig;
 namespace bfs=boost::filesystem;
 
+/// Number of compositions kept loaded for the next jobs
+#define CANVAS_CACHE_SIZE	8
+
+namespace {
+
+/// A composition loaded by a previous job, shared with the next ones
+struct CachedCanvas
+{
+	std::time_t mtime;
+	/// Number of the last job using it
+	int last_use;
+	Canvas::Handle root;
+	/// Settings of the canvases as loaded, the jobs change them
+	std::map<Canvas*, RendDesc> rend_descs;
+};
+
+/// Compositions by absolute file name
+std::map<std::string, CachedCanvas> canvas_cache;
+int canvas_cache_uses = 0;
+
+/// Drops the compositions least recently used, but \a key
+void trim_canvas_cache(const std::string& key)
+{
+	while (canvas_cache.size() > CANVAS_CACHE_SIZE)
+	{
+		std::map<std::string, CachedCanvas>::iterator oldest = canvas_cache.end();
+		for(std::map<std::string, CachedCanvas>::iterator i = canvas_cache.begin(); i != canvas_cache.end(); ++i)
+			if (i->first != key && (oldest == canvas_cache.end() || i->second.last_use < oldest->second.last_use))
+				oldest = i;
+		canvas_cache.erase(oldest);
+	}
+}
+
+}
+
 OptionsProcessor::OptionsProcessor(
 	boost::program_options::variables_map& vm,
 	const boost::program_options::options_description& po_visible)
@@ -407,6 +445,12 @@ RendDesc OptionsProcessor::extract_renddesc(const RendDesc& renddesc)
 					   << desc.get_time_start().get_string(desc.get_frame_rate())
 					   << endl;
 	}
+	if (_vm.count("half-float"))
+	{
+		desc.set_half_float(true);
+		VERBOSE_OUT(1) << _("Intermediate surfaces held in half floats")
+					   << endl;
+	}
 	if (_vm.count("gamma"))
 	{
 		synfig::warning(_("Gamma argument is currently ignored"));
@@ -488,6 +532,27 @@ TargetParam OptionsProcessor::extract_targetparam()
                        << "'."
 					   << std::endl;
 	}
+	if(_vm.count("exr-compression"))
+	{
+		params.compression = _vm["exr-compression"].as<std::string>();
+		transform (params.compression.begin(),
+				   params.compression.end(),
+				   params.compression.begin(),
+				   ::tolower);
+		VERBOSE_OUT(1) << _("Image compression set to: ") << params.compression
+					   << std::endl;
+	}
+	if(_vm.count("exr-tile-size"))
+	{
+		params.tile_size = _vm["exr-tile-size"].as<int>();
+		if (params.tile_size < 0)
+			throw SynfigToolException(SYNFIGTOOL_UNKNOWNARGUMENT,
+									  _("The tile size must be positive."));
+		VERBOSE_OUT(1) << _("Image tile size set to: ") << params.tile_size
+					   << std::endl;
+	}
+	if(_vm.count("exr-float"))
+		params.float_pixels = true;
 
 	return params;
 }
@@ -495,15 +560,29 @@ TargetParam OptionsProcessor::extract_targetparam()
 Job OptionsProcessor::extract_job()
 {
 	Job job;
+	CachedCanvas *cached = NULL;
 
 	// Common input file loading
 	if (_vm.count("input-file"))
 	{
 		job.filename = _vm["input-file"].as<string>();
 
-		// Open the composition
+		// Open the composition, unless a previous job did. The appended
+		// layers would go to the other jobs, so these jobs load their own
+		const bool shared = !_vm.count("append") && bfs::exists(job.filename);
+		const std::string cache_key = shared ? bfs::absolute(job.filename).string() : std::string();
+		if (shared && canvas_cache.count(cache_key)
+		 && canvas_cache[cache_key].mtime == bfs::last_write_time(job.filename))
+		{
+			VERBOSE_OUT(2) << _("Reusing the composition loaded by a previous job") << std::endl;
+			cached = &canvas_cache[cache_key];
+			cached->last_use = ++canvas_cache_uses;
+			job.root = cached->root;
+		}
+
 		string errors, warnings;
-		try
+		LoadStats::set_enabled(_vm.count("load-stats") > 0);
+		if (!cached) try
 		{
 			// todo: literals ".sfg", "container:", "project.sifz"
 			if (bfs::path(job.filename).extension().string() == ".sfg")
@@ -538,6 +617,16 @@ Job OptionsProcessor::extract_job()
                                       (boost::format(_("Unable to load file '%s'.")) % job.filename).str());
 		}
 
+		if (shared && !cached)
+		{
+			cached = &canvas_cache[cache_key];
+			cached->mtime = bfs::last_write_time(job.filename);
+			cached->last_use = ++canvas_cache_uses;
+			cached->root = job.root;
+			cached->rend_descs.clear();
+			trim_canvas_cache(cache_key);
+		}
+
 		job.root->set_time(0);
 	}
 	else
@@ -558,6 +647,11 @@ Job OptionsProcessor::extract_job()
 		job.outfilename = _vm["output-file"].as<std::string>();
 	}
 
+	if (_vm.count("extra-output"))
+	{
+		job.extra_outfilenames = _vm["extra-output"].as<std::vector<std::string> >();
+	}
+
 	if (_vm.count("extract-alpha"))
 	{
 		job.extract_alpha = true;
@@ -602,6 +696,16 @@ Job OptionsProcessor::extract_job()
 		// Later we need to set the other parameters for the jobs
 	}
 
+	// Start from the settings of the file, not those of a previous job
+	if (cached)
+	{
+		std::map<Canvas*, RendDesc>::iterator i = cached->rend_descs.find(job.canvas.get());
+		if (i == cached->rend_descs.end())
+			cached->rend_descs[job.canvas.get()] = job.canvas->rend_desc();
+		else
+			job.canvas->rend_desc() = i->second;
+	}
+
 	// WARNING: append must be before list-canvases
 
 	if (_vm.count("append"))
@@ -676,6 +780,15 @@ Job OptionsProcessor::extract_job()
 	VERBOSE_OUT(4)<<_("Attempting to determine target/outfile...")<<endl;
 	>>>>>>> genete_bones
 	 */
+	if (_vm.count("load-stats"))
+	{
+		std::cout << job.filename << std::endl;
+		LoadStats::print(std::cout);
+		LoadStats::set_enabled(false);
+
+		throw SynfigToolException(SYNFIGTOOL_OK);
+	}
+
 	if (_vm.count("list-canvases") || _vm.count("canvases"))
 	{
 		print_child_canvases(job.filename + "#", job.root);
@@ -692,6 +805,17 @@ Job OptionsProcessor::extract_job()
 		throw SynfigToolException(SYNFIGTOOL_OK);
 	}
 
+	if (_vm.count("save-as"))
+	{
+		const string filename = _vm["save-as"].as<string>();
+		if (!save_canvas(FileSystemNative::instance()->get_identifier(filename), job.root))
+			throw SynfigToolException(SYNFIGTOOL_INVALIDOUTPUT,
+				(boost::format(_("Unable to save to '%s'")) % filename).str());
+
+		VERBOSE_OUT(1) << _("Saved ") << filename << std::endl;
+		throw SynfigToolException(SYNFIGTOOL_OK);
+	}
+
 	return job;
 }
 
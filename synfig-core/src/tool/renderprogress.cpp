@@ -167,3 +167,32 @@ std::string RenderProgress::extendLineToClearRest(std::string line,
 
     return line;
 }
+
+DaemonProgress::DaemonProgress(int job_number, std::ostream& protocol)
+    : job_number_(job_number), last_reported_frame_(-1), protocol_(protocol)
+{ }
+
+bool DaemonProgress::error(const std::string& task)
+{
+    std::cerr << _("error") << ": " << task << std::endl;
+    return true;
+}
+
+bool DaemonProgress::warning(const std::string& task)
+{
+    std::cerr << _("warning") << ": " << task << std::endl;
+    return true;
+}
+
+bool DaemonProgress::amount_complete(int current_frame, int frames_count)
+{
+    if (current_frame == last_reported_frame_)
+    {
+        return true;
+    }
+    last_reported_frame_ = current_frame;
+
+    protocol_ << "progress " << job_number_ << " "
+              << current_frame << "/" << frames_count << std::endl;
+    return true;
+}
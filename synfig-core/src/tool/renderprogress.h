@@ -67,4 +67,24 @@ private:
                                       size_t last_line_length) const;
 };
 
+//! Prints the progress of a daemon job as "progress <job> <done>/<total>"
+//! lines on \a protocol, the daemon's standard output; the messages go to
+//! the standard error
+class DaemonProgress : public RenderProgress
+{
+public:
+
+    DaemonProgress(int job_number, std::ostream& protocol);
+
+    virtual bool error(const std::string& task);
+
+    virtual bool warning(const std::string& task);
+
+    virtual bool amount_complete(int current_frame, int frames_count);
+private:
+    int job_number_;
+    int last_reported_frame_;
+    std::ostream& protocol_;
+};
+
 #endif
@@ -0,0 +1,108 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file halfcolor.cpp
+**	\brief HalfColor Test File
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+*/
+/* ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+#include "gtest/gtest.h"
+
+#ifdef USING_PCH
+#	include "pch.h"
+#else
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <cmath>
+#include <limits>
+#include <synfig/color/halfcolor.h>
+
+#endif
+
+/* === U S I N G =========================================================== */
+
+using namespace synfig;
+using namespace std;
+
+/* === M A C R O S ========================================================= */
+
+/* === G L O B A L S ======================================================= */
+
+/* === P R O C E D U R E S ================================================= */
+
+/* === T E S T S =========================================================== */
+
+// Half floats have 11 significant bits
+const float half_epsilon = 1.0f/2048;
+
+TEST(HalfColor, Encoding)
+{
+  EXPECT_EQ(0x0000, HalfColor::from_float(0.0f));
+  EXPECT_EQ(0x3c00, HalfColor::from_float(1.0f));
+  EXPECT_EQ(0x3800, HalfColor::from_float(0.5f));
+  EXPECT_EQ(0xc000, HalfColor::from_float(-2.0f));
+  EXPECT_EQ(0x7bff, HalfColor::from_float(65504.0f));
+  EXPECT_EQ(0x7c00, HalfColor::from_float(1e6f));
+  EXPECT_EQ(0x0001, HalfColor::from_float(5.9604645e-8f));
+}
+
+TEST(HalfColor, ExactValues)
+{
+  const float values[] = { 0.0f, 0.25f, 0.5f, 1.0f, -2.0f, 3.0f, 65504.0f, 5.9604645e-8f };
+  for (size_t i = 0; i < sizeof(values)/sizeof(values[0]); i++)
+    EXPECT_EQ(values[i], HalfColor::to_float(HalfColor::from_float(values[i])));
+  EXPECT_TRUE(isinf(HalfColor::to_float(HalfColor::from_float(numeric_limits<float>::infinity()))));
+  EXPECT_TRUE(isnan(HalfColor::to_float(HalfColor::from_float(numeric_limits<float>::quiet_NaN()))));
+}
+
+TEST(HalfColor, RoundTrip)
+{
+  for (float f = 1e-4f; f < 60000.0f; f *= 1.37f)
+  {
+    EXPECT_NEAR(f, HalfColor::to_float(HalfColor::from_float(f)), f*half_epsilon);
+    EXPECT_NEAR(-f, HalfColor::to_float(HalfColor::from_float(-f)), f*half_epsilon);
+  }
+}
+
+TEST(HalfColor, PackUnpack)
+{
+  // An odd count also covers the tail of the vectorized conversion
+  const int count = 7;
+  Color colors[count];
+  for (int i = 0; i < count; i++)
+    colors[i] = Color(0.1f*i, 1.0f - 0.1f*i, 0.333f*i, 0.125f*i);
+
+  HalfColor packed[count];
+  Color unpacked[count];
+  HalfColor::pack(packed, colors, count);
+  HalfColor::unpack(unpacked, packed, count);
+
+  for (int i = 0; i < count; i++)
+  {
+    const Color single(HalfColor(colors[i]));
+    EXPECT_EQ(single.get_r(), unpacked[i].get_r());
+    EXPECT_EQ(single.get_g(), unpacked[i].get_g());
+    EXPECT_EQ(single.get_b(), unpacked[i].get_b());
+    EXPECT_EQ(single.get_a(), unpacked[i].get_a());
+
+    EXPECT_NEAR(colors[i].get_r(), unpacked[i].get_r(), half_epsilon);
+    EXPECT_NEAR(colors[i].get_g(), unpacked[i].get_g(), half_epsilon);
+    EXPECT_NEAR(colors[i].get_b(), unpacked[i].get_b(), 2*half_epsilon);
+    EXPECT_NEAR(colors[i].get_a(), unpacked[i].get_a(), half_epsilon);
+  }
+}
@@ -0,0 +1,179 @@
+/* === S Y N F I G ========================================================= */
+/*!	\file zbench.cpp
+**	\brief Compressed streams benchmark
+**
+**	$Id$
+**
+**	\legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License as
+**	published by the Free Software Foundation; either version 2 of
+**	the License, or (at your option) any later version.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	\endlegal
+**
+** === N O T E S ===========================================================
+**
+**	Not part of the test suite: build it with "make zbench" and run it by
+**	hand. It times the CRC of the .sfg containers and the deflate and
+**	inflate of the .sifz streams, with the chunk sizes zstreambuf used
+**	before (4K) and now (64K), on text shaped like a canvas file.
+**
+** ========================================================================= */
+
+/* === H E A D E R S ======================================================= */
+
+#include <ETL/clock>
+#include <zlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/* === M A C R O S ========================================================= */
+
+#define BENCH_DATA_SIZE		(16*1024*1024)
+#define BENCH_ITERATIONS	4
+
+/* === P R O C E D U R E S ================================================= */
+
+//! Builds \a size bytes of layers and waypoints, as a canvas file holds
+static std::string
+make_data(size_t size)
+{
+	std::string data;
+	data.reserve(size+256);
+	char line[256];
+	for(int i=0;data.size()<size;i++)
+	{
+		snprintf(line,sizeof(line),
+			"<waypoint time=\"%.8fs\" before=\"clamped\" after=\"clamped\">"
+			"<vector><x>%.10f</x><y>%.10f</y></vector></waypoint>\n",
+			i/24.0,(rand()%200000-100000)/1000.0,(rand()%200000-100000)/1000.0);
+		data+=line;
+	}
+	data.resize(size);
+	return data;
+}
+
+static unsigned long
+crc_test(const std::string &data, size_t chunk)
+{
+	unsigned long crc=crc32(0L,Z_NULL,0);
+	for(size_t i=0;i<data.size();i+=chunk)
+		crc=crc32(crc,(const Bytef*)data.data()+i,(uInt)std::min(chunk,data.size()-i));
+	return crc;
+}
+
+//! Deflates \a data by chunks of \a chunk bytes, as zstreambuf does
+static size_t
+deflate_test(const std::string &data, size_t chunk, int level, std::vector<char> &compressed)
+{
+	z_stream stream;
+	memset(&stream,0,sizeof(stream));
+	if(deflateInit2(&stream,level,Z_DEFLATED,16+MAX_WBITS,9,Z_DEFAULT_STRATEGY)!=Z_OK)
+		return 0;
+
+	std::vector<char> out(chunk);
+	compressed.clear();
+	for(size_t i=0;i<=data.size();i+=chunk)
+	{
+		const bool last(i+chunk>data.size());
+		stream.next_in=(Bytef*)data.data()+std::min(i,data.size());
+		stream.avail_in=(uInt)(last?data.size()-std::min(i,data.size()):chunk);
+		do
+		{
+			stream.next_out=(Bytef*)&out[0];
+			stream.avail_out=(uInt)out.size();
+			deflate(&stream,last?Z_FINISH:Z_NO_FLUSH);
+			compressed.insert(compressed.end(),&out[0],&out[0]+out.size()-stream.avail_out);
+		} while(stream.avail_out==0);
+		if(last)
+			break;
+	}
+	deflateEnd(&stream);
+	return compressed.size();
+}
+
+//! Inflates \a compressed by chunks of \a chunk bytes, as zstreambuf does
+static size_t
+inflate_test(const std::vector<char> &compressed, size_t chunk)
+{
+	z_stream stream;
+	memset(&stream,0,sizeof(stream));
+	if(inflateInit2(&stream,16+MAX_WBITS)!=Z_OK)
+		return 0;
+
+	std::vector<char> out(chunk);
+	size_t size(0);
+	int ret(Z_OK);
+	for(size_t i=0;i<compressed.size() && ret==Z_OK;i+=chunk)
+	{
+		stream.next_in=(Bytef*)&compressed[i];
+		stream.avail_in=(uInt)std::min(chunk,compressed.size()-i);
+		do
+		{
+			stream.next_out=(Bytef*)&out[0];
+			stream.avail_out=(uInt)out.size();
+			ret=inflate(&stream,Z_NO_FLUSH);
+			size+=out.size()-stream.avail_out;
+		} while(ret==Z_OK && stream.avail_out==0);
+	}
+	inflateEnd(&stream);
+	return size;
+}
+
+/* === E N T R Y P O I N T ================================================= */
+
+int main(int argc, char **argv)
+{
+	const int level(argc>1 ? atoi(argv[1]) : 9);
+	const std::string data(make_data(BENCH_DATA_SIZE));
+	const size_t chunks[]={ 4*1024, 64*1024 };
+	std::vector<char> compressed;
+	etl::clock timer;
+
+	printf("%d MB of canvas text, deflate level %d, best of %d runs\n",
+		BENCH_DATA_SIZE/(1024*1024),level,BENCH_ITERATIONS);
+
+	for(int c=0;c<2;c++)
+	{
+		double crc_time(0),deflate_time(0),inflate_time(0);
+		unsigned long crc(0);
+		size_t compressed_size(0),inflated_size(0);
+		for(int i=0;i<BENCH_ITERATIONS;i++)
+		{
+			timer.reset();
+			crc=crc_test(data,chunks[c]);
+			const double t1(timer());
+			timer.reset();
+			compressed_size=deflate_test(data,chunks[c],level,compressed);
+			const double t2(timer());
+			timer.reset();
+			inflated_size=inflate_test(compressed,chunks[c]);
+			const double t3(timer());
+
+			if(i==0 || t1<crc_time) crc_time=t1;
+			if(i==0 || t2<deflate_time) deflate_time=t2;
+			if(i==0 || t3<inflate_time) inflate_time=t3;
+		}
+		if(inflated_size!=data.size())
+		{
+			printf("%3dK chunks: inflated %lu bytes instead of %lu\n",
+				(int)(chunks[c]/1024),(unsigned long)inflated_size,(unsigned long)data.size());
+			return 1;
+		}
+
+		const double mb(data.size()/(1024.0*1024.0));
+		printf("%3dK chunks: crc32 %8.1f MB/s  deflate %8.1f MB/s  inflate %8.1f MB/s  (crc %08lx, %lu bytes)\n",
+			(int)(chunks[c]/1024),mb/crc_time,mb/deflate_time,mb/inflate_time,
+			crc,(unsigned long)compressed_size);
+	}
+	return 0;
+}
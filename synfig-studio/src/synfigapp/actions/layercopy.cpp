@@ -165,6 +165,8 @@ Action::LayerCopy::prepare()
 				->get_instance()
 				->get_file_system()
 				->directory_create("#images");
+			if (!layer_bitmap->wait_surface())
+				synfig::warning("LayerCopy: the image of the layer could not be decoded");
 			get_canvas_interface()
 				->get_instance()
 				->save_surface(layer_bitmap->surface, filename);
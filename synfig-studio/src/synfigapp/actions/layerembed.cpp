@@ -235,6 +235,8 @@ Action::LayerEmbed::prepare()
 			etl::handle<Layer_Bitmap>::cast_dynamic(layer_import);
 		if (layer_bitmap && instance->is_layer_registered_to_save(layer_bitmap)) {
 			// save surface
+			if (!layer_bitmap->wait_surface())
+				synfig::warning("LayerEmbed: the image of the layer could not be decoded");
 			get_canvas_interface()->get_instance()->save_surface(layer_bitmap->surface, dir + new_filename);
 		} else {
 			// try to copy file
@@ -205,7 +205,20 @@ Action::LayerPaint::PaintStroke::prepare()
 			break;
 		}
 
+	// The image may still be decoding in background
+	if (!layer->wait_surface())
+		synfig::warning("LayerPaint: the image of the layer could not be decoded");
+
 	if (prevSameLayer == NULL) surface = layer->surface;
+
+	{
+		// The pixels may be shared with the importer of the image,
+		// give the layer its own copy before painting on it
+		Mutex::Lock lock(layer->mutex);
+		Surface own_surface(layer->surface);
+		layer->surface = own_surface;
+	}
+
 	new_tl = tl = layer->get_param("tl").get(Point());
 	new_br = br = layer->get_param("br").get(Point());
 
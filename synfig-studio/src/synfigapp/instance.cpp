@@ -532,6 +532,8 @@ Instance::save_as(const synfig::String &file_name)
 		// TODO: literals '#' and 'images/'
 		if (!filename.empty() && filename[0] == '#')
 			filename.insert(1, "images/");
+		if (!layer_bitmap->wait_surface())
+			synfig::warning("Instance: the image of the layer could not be decoded");
 		save_surface(layer_bitmap->surface, filename);
 	}
 